@@ -0,0 +1,1433 @@
+#include "CpuFluidSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "FluidCheckpoint.h"
+
+using namespace std;
+
+
+namespace
+{
+#if defined(__AVX__)
+    typedef __m256 simd_t;
+    const int SIMD_WIDTH = 8;
+    inline simd_t simdLoad(const float* p)       { return _mm256_loadu_ps(p); }
+    inline void   simdStore(float* p, simd_t v)  { _mm256_storeu_ps(p, v); }
+    inline simd_t simdSet(float f)               { return _mm256_set1_ps(f); }
+    inline simd_t simdAdd(simd_t a, simd_t b)    { return _mm256_add_ps(a, b); }
+    inline simd_t simdSub(simd_t a, simd_t b)    { return _mm256_sub_ps(a, b); }
+    inline simd_t simdMul(simd_t a, simd_t b)    { return _mm256_mul_ps(a, b); }
+#elif defined(__SSE2__) || defined(_M_X64)
+    typedef __m128 simd_t;
+    const int SIMD_WIDTH = 4;
+    inline simd_t simdLoad(const float* p)       { return _mm_loadu_ps(p); }
+    inline void   simdStore(float* p, simd_t v)  { _mm_storeu_ps(p, v); }
+    inline simd_t simdSet(float f)               { return _mm_set1_ps(f); }
+    inline simd_t simdAdd(simd_t a, simd_t b)    { return _mm_add_ps(a, b); }
+    inline simd_t simdSub(simd_t a, simd_t b)    { return _mm_sub_ps(a, b); }
+    inline simd_t simdMul(simd_t a, simd_t b)    { return _mm_mul_ps(a, b); }
+#else
+    typedef float simd_t;
+    const int SIMD_WIDTH = 1;
+    inline simd_t simdLoad(const float* p)       { return *p; }
+    inline void   simdStore(float* p, simd_t v)  { *p = v; }
+    inline simd_t simdSet(float f)               { return f; }
+    inline simd_t simdAdd(simd_t a, simd_t b)    { return a + b; }
+    inline simd_t simdSub(simd_t a, simd_t b)    { return a - b; }
+    inline simd_t simdMul(simd_t a, simd_t b)    { return a * b; }
+#endif
+
+    inline float mix(float a, float b, float t)
+    {
+        return a * (1.0f - t) + b * t;
+    }
+}
+
+
+void CpuFluidSolver::Plane::resize(const glm::ivec2& newSize)
+{
+    size = newSize;
+    stride = ((size.x + SIMD_WIDTH - 1) / SIMD_WIDTH) * SIMD_WIDTH;
+    data.assign(stride * size.y, 0.0f);
+}
+
+float* CpuFluidSolver::Plane::row(int y)
+{
+    return data.data() + y * stride;
+}
+
+const float* CpuFluidSolver::Plane::row(int y) const
+{
+    return data.data() + y * stride;
+}
+
+float CpuFluidSolver::Plane::fetch(int x, int y) const
+{
+    if(x < 0 || y < 0 || x >= size.x || y >= size.y)
+        return 0.0f;
+    return data[y * stride + x];
+}
+
+
+CpuFluidSolver::Footprint::Footprint(const glm::ivec2& size,
+                                     const glm::vec2& pos)
+{
+    float u = pos.x - 0.5f;
+    float v = pos.y - 0.5f;
+    float u0 = floor(u);
+    float v0 = floor(v);
+    fu = u - u0;
+    fv = v - v0;
+    i0 = glm::clamp(int(u0),     0, size.x-1);
+    i1 = glm::clamp(int(u0) + 1, 0, size.x-1);
+    j0 = glm::clamp(int(v0),     0, size.y-1);
+    j1 = glm::clamp(int(v0) + 1, 0, size.y-1);
+}
+
+float CpuFluidSolver::Footprint::sample(const Plane& plane) const
+{
+    const float* r0 = plane.row(j0);
+    const float* r1 = plane.row(j1);
+    return mix(mix(r0[i0], r0[i1], fu),
+               mix(r1[i0], r1[i1], fu), fv);
+}
+
+float CpuFluidSolver::Footprint::minimum(const Plane& plane) const
+{
+    const float* r0 = plane.row(j0);
+    const float* r1 = plane.row(j1);
+    return glm::min(glm::min(r0[i0], r0[i1]), glm::min(r1[i0], r1[i1]));
+}
+
+float CpuFluidSolver::Footprint::maximum(const Plane& plane) const
+{
+    const float* r0 = plane.row(j0);
+    const float* r1 = plane.row(j1);
+    return glm::max(glm::max(r0[i0], r0[i1]), glm::max(r1[i0], r1[i1]));
+}
+
+
+CpuFluidSolver::CpuFluidSolver(const FluidSettings& settings) :
+    IFluidSolver(settings),
+    _threadPool(settings.nbThreads),
+    _candlePosition(-WIDTH, -HEIGHT),
+    _cgNbRegions(0),
+    _pressureLevels()
+{
+}
+
+CpuFluidSolver::~CpuFluidSolver()
+{
+
+}
+
+void CpuFluidSolver::initialize()
+{
+    loadObstacles();
+
+    glm::ivec2 size(WIDTH, HEIGHT);
+    for(int c=0; c < NB_CHANNELS; ++c)
+    {
+        _front[c].resize(size);
+        _back[c].resize(size);
+        _predicted[c].resize(size);
+    }
+    _frontierPlane.resize(size);
+    _divergence.resize(size);
+    _curl.resize(size);
+    _diffuseRhs[0].resize(size);
+    _diffuseRhs[1].resize(size);
+    _cgResidual.resize(size);
+    _cgPreconditioned.resize(size);
+    _cgDirection.resize(size);
+    _cgProduct.resize(size);
+    _cgFluid.resize(size);
+    _cgDiagonal.resize(size);
+    _cgRDiagonal.resize(size);
+
+    forEachRow(HEIGHT, [&](int y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            float s = x / (float) WIDTH;
+            float t = y / (float) HEIGHT;
+            glm::vec4 dye      = initDye(s, t);
+            glm::vec4 velocity = initVelocity(s, t);
+            glm::vec4 pressure = initPressure(s, t);
+            glm::vec4 heat     = initHeat(s, t);
+            glm::vec4 frontier = initFrontier(s, t);
+
+            _front[DYE_R].row(y)[x]      = dye.x;
+            _front[DYE_G].row(y)[x]      = dye.y;
+            _front[DYE_B].row(y)[x]      = dye.z;
+            _front[VELOCITY_X].row(y)[x] = velocity.x;
+            _front[VELOCITY_Y].row(y)[x] = velocity.y;
+            _front[HEAT].row(y)[x]       = heat.x;
+            _front[PRESSURE].row(y)[x]   = pressure.x;
+            _frontierPlane.row(y)[x]     = frontier.x;
+        }
+    });
+
+    _boundaryCells = findBoundaryCells();
+    initPressureLevels();
+    initPressureMask();
+}
+
+void CpuFluidSolver::terminate()
+{
+    for(int c=0; c < NB_CHANNELS; ++c)
+    {
+        _front[c] = Plane();
+        _back[c] = Plane();
+        _predicted[c] = Plane();
+    }
+    _frontierPlane = Plane();
+    _boundaryCells.clear();
+    _divergence = Plane();
+    _curl = Plane();
+    _diffuseRhs[0] = Plane();
+    _diffuseRhs[1] = Plane();
+    _cgResidual = Plane();
+    _cgPreconditioned = Plane();
+    _cgDirection = Plane();
+    _cgProduct = Plane();
+    _cgFluid = Plane();
+    _cgDiagonal = Plane();
+    _cgRDiagonal = Plane();
+    _cgRegions.clear();
+    _cgNbRegions = 0;
+    _pressureLevels.clear();
+}
+
+void CpuFluidSolver::initPressureLevels()
+{
+    const int MIN_LEVEL_SIZE = 8;
+
+    glm::ivec2 size(WIDTH, HEIGHT);
+    float dx = DX;
+
+    _pressureLevels.clear();
+    while(true)
+    {
+        PressureLevel level;
+        level.size = size;
+        level.dx = dx;
+        level.ghost = -(dx - DX) / (dx + DX);
+        level.r.resize(size);
+
+        // The finest level solves in place in the pressure planes
+        if(!_pressureLevels.empty())
+        {
+            level.x.resize(size);
+            level.tmp.resize(size);
+            level.b.resize(size);
+        }
+
+        _pressureLevels.push_back(level);
+
+        if(glm::min(size.x, size.y) < 2 * MIN_LEVEL_SIZE)
+            break;
+
+        size = (size + glm::ivec2(1)) / 2;
+        dx *= 2.0f;
+    }
+}
+
+void CpuFluidSolver::initPressureMask()
+{
+    const glm::ivec2 OFFSETS[] = {
+        glm::ivec2(-1, 0), glm::ivec2(1, 0),
+        glm::ivec2(0, -1), glm::ivec2(0, 1)
+    };
+
+    // Solid faces carry no flux and drop out of the diagonal, faces on the
+    // grid edge keep the zero pressure outside. A fluid cell walled in on
+    // all four sides is left out of the system.
+    forEachRow(HEIGHT, [&](int y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            float diagonal = 0.0f;
+            if(_frontierPlane.row(y)[x] != 1.0f)
+            {
+                for(const glm::ivec2& offset : OFFSETS)
+                {
+                    if(_frontierPlane.fetch(x + offset.x, y + offset.y) != 1.0f)
+                        diagonal += 1.0f;
+                }
+            }
+
+            _cgFluid.row(y)[x] = diagonal > 0.0f ? 1.0f : 0.0f;
+            _cgDiagonal.row(y)[x] = diagonal;
+            _cgRDiagonal.row(y)[x] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+        }
+    });
+
+    // Flood fill the fluid regions, those touching the grid edge are
+    // anchored by the zero pressure outside
+    const int UNVISITED = -2;
+    _cgRegions.assign(AREA, -1);
+    for(int y=0; y < HEIGHT; ++y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            if(_cgFluid.row(y)[x] != 0.0f)
+                _cgRegions[y * WIDTH + x] = UNVISITED;
+        }
+    }
+
+    _cgNbRegions = 0;
+    vector<int> region;
+    vector<int> stack;
+    for(int seed=0; seed < AREA; ++seed)
+    {
+        if(_cgRegions[seed] != UNVISITED)
+            continue;
+
+        bool anchored = false;
+        region.clear();
+        stack.assign(1, seed);
+        _cgRegions[seed] = -1;
+        while(!stack.empty())
+        {
+            int cell = stack.back();
+            stack.pop_back();
+            region.push_back(cell);
+
+            int x = cell % WIDTH;
+            int y = cell / WIDTH;
+            anchored |= x == 0 || y == 0 || x == WIDTH-1 || y == HEIGHT-1;
+            for(const glm::ivec2& offset : OFFSETS)
+            {
+                int nx = x + offset.x;
+                int ny = y + offset.y;
+                if(nx < 0 || ny < 0 || nx >= WIDTH || ny >= HEIGHT)
+                    continue;
+
+                int neighbour = ny * WIDTH + nx;
+                if(_cgRegions[neighbour] == UNVISITED)
+                {
+                    _cgRegions[neighbour] = -1;
+                    stack.push_back(neighbour);
+                }
+            }
+        }
+
+        if(!anchored)
+        {
+            for(int cell : region)
+                _cgRegions[cell] = _cgNbRegions;
+            ++_cgNbRegions;
+        }
+    }
+}
+
+template<typename Task>
+void CpuFluidSolver::forEachRow(int height, const Task& task)
+{
+    // A few blocks per thread to even out the load
+    int rowsPerBlock = height / (4 * _threadPool.threadCount());
+    rowsPerBlock = glm::clamp(rowsPerBlock, 4, 64);
+
+    _threadPool.parallelFor(height, rowsPerBlock, [&](int begin, int end)
+    {
+        for(int y=begin; y < end; ++y)
+            task(y);
+    });
+}
+
+template<typename Task>
+double CpuFluidSolver::sumRows(int height, const Task& task)
+{
+    vector<double> rowSums(height);
+    forEachRow(height, [&](int y)
+    {
+        rowSums[y] = task(y);
+    });
+
+    double sum = 0.0;
+    for(double rowSum : rowSums)
+        sum += rowSum;
+    return sum;
+}
+
+glm::vec2 CpuFluidSolver::trace(int x, int y, float direction) const
+{
+    const float DT_RDX = DT * (1.0f / DX);
+
+    glm::vec2 frag(x + 0.5f, y + 0.5f);
+    glm::vec2 pos(frag.x + direction * DT_RDX * _front[VELOCITY_X].row(y)[x],
+                  frag.y + direction * DT_RDX * _front[VELOCITY_Y].row(y)[x]);
+
+    float blocked = _frontierPlane.fetch(int(pos.x), int(pos.y));
+    return glm::vec2(mix(pos.x, frag.x, blocked),
+                     mix(pos.y, frag.y, blocked));
+}
+
+void CpuFluidSolver::advect()
+{
+    const EChannel CHANNELS[] = {
+        DYE_R, DYE_G, DYE_B, HEAT, VELOCITY_X, VELOCITY_Y
+    };
+    const int NB_ADVECTED = sizeof(CHANNELS) / sizeof(CHANNELS[0]);
+    const glm::ivec2 SIZE(WIDTH, HEIGHT);
+
+    // MacCormack corrects the semi-Lagrangian result in a second pass
+    Plane* firstOrder = _advection == EAdvection::MACCORMACK ?
+                            _predicted : _back;
+
+    // Every channel goes back along the same velocity
+    forEachRow(HEIGHT, [&](int y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            Footprint back(SIZE, trace(x, y, -1.0f));
+            for(int c=0; c < NB_ADVECTED; ++c)
+            {
+                firstOrder[CHANNELS[c]].row(y)[x] =
+                    back.sample(_front[CHANNELS[c]]);
+            }
+        }
+    });
+
+    if(_advection == EAdvection::MACCORMACK)
+    {
+        forEachRow(HEIGHT, [&](int y)
+        {
+            for(int x=0; x < WIDTH; ++x)
+            {
+                Footprint back(SIZE, trace(x, y, -1.0f));
+                Footprint forth(SIZE, trace(x, y, 1.0f));
+                for(int c=0; c < NB_ADVECTED; ++c)
+                {
+                    const Plane& phi = _front[CHANNELS[c]];
+                    const Plane& phiHat = _predicted[CHANNELS[c]];
+
+                    // Half the error of a round trip, clamped to the
+                    // texels the prediction was interpolated from
+                    float corrected = phiHat.row(y)[x] +
+                        0.5f * (phi.row(y)[x] - forth.sample(phiHat));
+                    _back[CHANNELS[c]].row(y)[x] = glm::clamp(corrected,
+                        back.minimum(phi), back.maximum(phi));
+                }
+            }
+        });
+    }
+
+    for(int c=0; c < NB_ADVECTED; ++c)
+        swap(_front[CHANNELS[c]], _back[CHANNELS[c]]);
+}
+
+void CpuFluidSolver::diffuse()
+{
+    float velocityResidual;
+    float heatResidual;
+
+    _solveStats.diffuseIterations =
+        diffuseChannels(VELOCITY_X, VELOCITY_Y,
+                        DX*DX / (VISCOSITY*DT),
+                        1.0f / (4.0f + DX*DX/(VISCOSITY*DT)),
+                        velocityResidual) +
+        diffuseChannels(HEAT, HEAT,
+                        DX*DX / (HEATDIFF*DT),
+                        1.0f / (4.0f + DX*DX/(HEATDIFF*DT)),
+                        heatResidual);
+
+    _solveStats.diffuseResidual = glm::max(velocityResidual, heatResidual);
+}
+
+int CpuFluidSolver::diffuseChannels(int first, int last,
+                                    float alpha, float rBeta, float& residual)
+{
+    // SOR solves against the field entering the stage, the plain Jacobi
+    // loop takes each iteration as the right-hand side of the next, with or
+    // without a tolerance
+    const bool fixedRhs = _relaxation == ERelaxation::RED_BLACK_SOR;
+    const Plane* b[2];
+    for(int c=first; c <= last; ++c)
+    {
+        if(fixedRhs)
+        {
+            _diffuseRhs[c-first].data = _front[c].data;
+            b[c-first] = &_diffuseRhs[c-first];
+        }
+        else
+        {
+            b[c-first] = &_front[c];
+        }
+    }
+
+    // Without a fixed right-hand side, the residual against the iterate
+    // itself is the relative update |x' - x| / |x| scaled by 1 / (alpha*rBeta)
+    auto norm = [&]() {
+        double sumSqResidual = 0.0;
+        double sumSqB = 0.0;
+        for(int c=first; c <= last; ++c)
+            accumulateResidual(_front[c], *b[c-first], alpha, rBeta,
+                               sumSqResidual, sumSqB);
+        if(sumSqB <= 0.0)
+            return 0.0f;
+        float relative = float(sqrt(sumSqResidual / sumSqB));
+        return fixedRhs ? relative : relative * alpha * rBeta;
+    };
+
+    if(_relaxation == ERelaxation::RED_BLACK_SOR)
+    {
+        return iterate(NB_SOR_DIFFUSE_ITERATIONS, SOR_CHECK_INTERVAL,
+            [&](int nbIterations) {
+                for(int c=first; c <= last; ++c)
+                {
+                    for(int i=0; i < nbIterations; ++i)
+                    {
+                        sorPass(_front[c], *b[c-first], alpha, rBeta, 1.0f, 0);
+                        sorPass(_front[c], *b[c-first], alpha, rBeta, 1.0f, 1);
+                    }
+                }
+            }, norm, residual);
+    }
+    else
+    {
+        return iterate(NB_JACOBI_ITERATIONS, JACOBI_CHECK_INTERVAL,
+            [&](int nbIterations) {
+                for(int c=first; c <= last; ++c)
+                {
+                    for(int i=0; i < nbIterations; ++i)
+                    {
+                        jacobiPass(_front[c], *b[c-first], _back[c],
+                                   alpha, rBeta, 0.0f, 1.0f);
+                        swap(_front[c], _back[c]);
+                    }
+                }
+            }, norm, residual);
+    }
+}
+
+void CpuFluidSolver::heat()
+{
+    const float HALF_RDX = 0.5f / DX;
+    const float CONFINEMENT = _vorticity * DX * DT;
+    const Plane& heat = _front[HEAT];
+    const Plane& velX = _front[VELOCITY_X];
+    const Plane& velY = _front[VELOCITY_Y];
+
+    // The confinement force reads the curl around each cell
+    if(CONFINEMENT != 0.0f)
+    {
+        forEachRow(HEIGHT, [&](int y)
+        {
+            float* curl = _curl.row(y);
+            for(int x=0; x < WIDTH; ++x)
+            {
+                curl[x] = HALF_RDX * ((velY.fetch(x+1, y) - velY.fetch(x-1, y)) -
+                                      (velX.fetch(x, y+1) - velX.fetch(x, y-1)));
+            }
+        });
+    }
+
+    // Buoyancy and confinement only read the heat and the curl, the
+    // velocity is updated in place
+    forEachRow(HEIGHT, [&](int y)
+    {
+        float* vx = _front[VELOCITY_X].row(y);
+        float* vy = _front[VELOCITY_Y].row(y);
+        for(int x=0; x < WIDTH; ++x)
+        {
+            float hC = heat.row(y)[x];
+            float sum = heat.fetch(x-1, y) + heat.fetch(x+1, y) +
+                        heat.fetch(x, y-1) + heat.fetch(x, y+1);
+            vy[x] += HALF_RDX * (sum - hC) * 0.05f;
+
+            if(CONFINEMENT == 0.0f)
+                continue;
+
+            // Same as heat.frag
+            glm::vec2 grad = HALF_RDX * glm::vec2(
+                fabs(_curl.fetch(x+1, y)) - fabs(_curl.fetch(x-1, y)),
+                fabs(_curl.fetch(x, y+1)) - fabs(_curl.fetch(x, y-1)));
+            float len = glm::length(grad);
+            if(len > 1.0e-5f)
+            {
+                float force = CONFINEMENT * _curl.row(y)[x] / len;
+                vx[x] += force * grad.y;
+                vy[x] -= force * grad.x;
+            }
+        }
+    });
+
+    // Candle
+    const float RADIUS = 10.0f;
+    int minX = glm::max(0,        int(floor(_candlePosition.x - RADIUS)));
+    int maxX = glm::min(WIDTH-1,  int(ceil( _candlePosition.x + RADIUS)));
+    int minY = glm::max(0,        int(floor(_candlePosition.y - RADIUS)));
+    int maxY = glm::min(HEIGHT-1, int(ceil( _candlePosition.y + RADIUS)));
+    for(int y=minY; y <= maxY; ++y)
+    {
+        for(int x=minX; x <= maxX; ++x)
+        {
+            float dx = _candlePosition.x - (x + 0.5f);
+            float dy = _candlePosition.y - (y + 0.5f);
+            if(sqrt(dx*dx + dy*dy) < RADIUS)
+                _front[HEAT].row(y)[x] = 1.0f;
+        }
+    }
+}
+
+void CpuFluidSolver::computePressure()
+{
+    const float HALF_RDX = 0.5f / DX;
+    const Plane& velX = _front[VELOCITY_X];
+    const Plane& velY = _front[VELOCITY_Y];
+
+    forEachRow(HEIGHT, [&](int y)
+    {
+        const float* vx = velX.row(y);
+        const float* vB = y > 0        ? velY.row(y-1) : nullptr;
+        const float* vT = y < HEIGHT-1 ? velY.row(y+1) : nullptr;
+        float* div = _divergence.row(y);
+
+        auto cell = [&](int x)
+        {
+            float dvx = velX.fetch(x+1, y) - velX.fetch(x-1, y);
+            float dvy = velY.fetch(x, y+1) - velY.fetch(x, y-1);
+            div[x] = HALF_RDX * (dvx + dvy);
+        };
+
+        cell(0);
+        int x = 1;
+        if(vB != nullptr && vT != nullptr)
+        {
+            simd_t h = simdSet(HALF_RDX);
+            for(; x + SIMD_WIDTH <= WIDTH-1; x += SIMD_WIDTH)
+            {
+                simd_t dvx = simdSub(simdLoad(vx + x+1), simdLoad(vx + x-1));
+                simd_t dvy = simdSub(simdLoad(vT + x),   simdLoad(vB + x));
+                simdStore(div + x, simdMul(h, simdAdd(dvx, dvy)));
+            }
+        }
+        for(; x < WIDTH; ++x)
+            cell(x);
+    });
+
+
+    switch(_pressureSolver)
+    {
+    case EPressureSolver::JACOBI :
+        if(_relaxation == ERelaxation::RED_BLACK_SOR)
+            sorPressure();
+        else
+            jacobiPressure();
+        break;
+    case EPressureSolver::MULTIGRID :
+        multigridPressure();
+        break;
+    case EPressureSolver::CONJUGATE_GRADIENT :
+        conjugateGradientPressure();
+        break;
+    }
+}
+
+float CpuFluidSolver::pressureResidualNorm()
+{
+    double sumSqResidual = 0.0;
+    double sumSqB = 0.0;
+    accumulateResidual(_front[PRESSURE], _divergence, -DX*DX, 1.0f / 4.0f,
+                       sumSqResidual, sumSqB);
+    return sumSqB > 0.0 ? float(sqrt(sumSqResidual / sumSqB)) : 0.0f;
+}
+
+void CpuFluidSolver::jacobiPressure()
+{
+    _solveStats.pressureIterations = iterate(
+        NB_JACOBI_ITERATIONS, JACOBI_CHECK_INTERVAL,
+        [&](int nbIterations) {
+            for(int i=0; i < nbIterations; ++i)
+            {
+                jacobiPass(_front[PRESSURE], _divergence, _back[PRESSURE],
+                           -DX*DX, 1.0f / 4.0f, 0.0f, 1.0f);
+                swap(_front[PRESSURE], _back[PRESSURE]);
+            }
+        },
+        [&]() { return pressureResidualNorm(); },
+        _solveStats.pressureResidual);
+}
+
+void CpuFluidSolver::sorPressure()
+{
+    _solveStats.pressureIterations = iterate(
+        NB_SOR_PRESSURE_ITERATIONS, SOR_CHECK_INTERVAL,
+        [&](int nbIterations) {
+            for(int i=0; i < nbIterations; ++i)
+            {
+                sorPass(_front[PRESSURE], _divergence,
+                        -DX*DX, 1.0f / 4.0f, SOR_PRESSURE_OMEGA, 0);
+                sorPass(_front[PRESSURE], _divergence,
+                        -DX*DX, 1.0f / 4.0f, SOR_PRESSURE_OMEGA, 1);
+            }
+        },
+        [&]() { return pressureResidualNorm(); },
+        _solveStats.pressureResidual);
+}
+
+void CpuFluidSolver::multigridPressure()
+{
+    // With a tolerance, the residual is checked after every V-cycle
+    _solveStats.pressureIterations = iterate(
+        NB_MULTIGRID_CYCLES, MULTIGRID_CHECK_INTERVAL,
+        [&](int nbCycles) {
+            for(int c=0; c < nbCycles; ++c)
+                vCycle(0, _front[PRESSURE], _back[PRESSURE], _divergence);
+        },
+        [&]() { return pressureResidualNorm(); },
+        _solveStats.pressureResidual);
+}
+
+void CpuFluidSolver::conjugateGradientPressure()
+{
+    // The residual is free to measure, the solve always stops on it
+    const float DEFAULT_TOLERANCE = 1.0e-4f;
+    const int MAX_ITERATIONS = 2 * (WIDTH + HEIGHT);
+
+    float tolerance = _tolerance > 0.0f ? _tolerance : DEFAULT_TOLERANCE;
+    Plane& x = _front[PRESSURE];
+    Plane& r = _cgResidual;
+    Plane& z = _cgPreconditioned;
+    Plane& p = _cgDirection;
+    Plane& q = _cgProduct;
+
+    // D x - fluid neighbours = -dx^2 div on the fluid cells, starting from
+    // the last pressure. Solid cells stay at zero until the end.
+    forEachRow(HEIGHT, [&](int y)
+    {
+        const float* fC = _cgFluid.row(y);
+        float* xC = x.row(y);
+        for(int i=0; i < WIDTH; ++i)
+            xC[i] *= fC[i];
+    });
+
+    double sqRhs = 0.0;
+    double sqResidual = fluidResidual(x, q, r, sqRhs);
+
+    double threshold = double(tolerance) * tolerance * sqRhs;
+    double rz = 0.0;
+    int it = 0;
+    for(; it < MAX_ITERATIONS && sqResidual > threshold; ++it)
+    {
+        double rzNext = preconditionPass(r, q, z);
+        float beta = it == 0 ? 0.0f : float(rzNext / rz);
+        rz = rzNext;
+
+        forEachRow(HEIGHT, [&](int y)
+        {
+            const float* zC = z.row(y);
+            float* pC = p.row(y);
+
+            int i = 0;
+            simd_t vBeta = simdSet(beta);
+            for(; i + SIMD_WIDTH <= WIDTH; i += SIMD_WIDTH)
+            {
+                simdStore(pC + i, simdAdd(simdLoad(zC + i),
+                                          simdMul(simdLoad(pC + i), vBeta)));
+            }
+            for(; i < WIDTH; ++i)
+                pC[i] = zC[i] + pC[i]*beta;
+        });
+
+        double pq = laplacianPass(p, q);
+        if(pq <= 0.0)
+            break;
+        float step = float(rz / pq);
+
+        sqResidual = sumRows(HEIGHT, [&](int y)
+        {
+            const float* pC = p.row(y);
+            const float* qC = q.row(y);
+            float* xC = x.row(y);
+            float* rC = r.row(y);
+
+            int i = 0;
+            simd_t vStep = simdSet(step);
+            for(; i + SIMD_WIDTH <= WIDTH; i += SIMD_WIDTH)
+            {
+                simdStore(xC + i, simdAdd(simdLoad(xC + i),
+                                          simdMul(simdLoad(pC + i), vStep)));
+                simdStore(rC + i, simdSub(simdLoad(rC + i),
+                                          simdMul(simdLoad(qC + i), vStep)));
+            }
+            for(; i < WIDTH; ++i)
+            {
+                xC[i] += pC[i]*step;
+                rC[i] -= qC[i]*step;
+            }
+
+            double sqR = 0.0;
+            for(i=0; i < WIDTH; ++i)
+                sqR += double(rC[i]) * rC[i];
+            return sqR;
+        });
+    }
+
+    // Zero flux through the solid faces for the gradient: the boundary
+    // cells take the mean pressure of their fluid neighbours
+    const glm::ivec2 OFFSETS[] = {
+        glm::ivec2(-1, 0), glm::ivec2(1, 0),
+        glm::ivec2(0, -1), glm::ivec2(0, 1)
+    };
+    int nbCells = (int) _boundaryCells.size();
+    _threadPool.parallelFor(nbCells, 1024, [&](int begin, int end)
+    {
+        for(int i=begin; i < end; ++i)
+        {
+            const FluidBoundaryCell& cell = _boundaryCells[i];
+            int cx = int(cell.cell.x);
+            int cy = int(cell.cell.y);
+
+            float moy = 0.0f;
+            for(int n=0; n < 4; ++n)
+            {
+                if(cell.weights[n] != 0.0f)
+                {
+                    moy += cell.weights[n] *
+                           x.row(cy + OFFSETS[n].y)[cx + OFFSETS[n].x];
+                }
+            }
+            x.row(cy)[cx] = moy;
+        }
+    });
+
+    // Relative residual of the fluid cells system, from the updated residual
+    _solveStats.pressureIterations = it;
+    _solveStats.pressureResidual =
+        sqRhs > 0.0 ? float(sqrt(sqResidual / sqRhs)) : 0.0f;
+}
+
+void CpuFluidSolver::vCycle(int level, Plane& x, Plane& tmp, const Plane& b)
+{
+    const int NB_PRE_SMOOTHING  = 2;
+    const int NB_POST_SMOOTHING = 2;
+    const int NB_COARSEST_ITERATIONS = 16;
+
+    if(level+1 == (int) _pressureLevels.size())
+    {
+        relaxLevel(level, x, tmp, b, NB_COARSEST_ITERATIONS);
+        return;
+    }
+
+    PressureLevel& fine = _pressureLevels[level];
+    PressureLevel& coarse = _pressureLevels[level+1];
+
+    relaxLevel(level, x, tmp, b, NB_PRE_SMOOTHING);
+
+    residualPass(x, b, fine.r, -fine.dx*fine.dx, 1.0f / 4.0f, fine.ghost);
+    restrictPass(fine.r, coarse.b);
+
+    // Coarse correction starts from zero
+    fill(coarse.x.data.begin(), coarse.x.data.end(), 0.0f);
+    vCycle(level+1, coarse.x, coarse.tmp, coarse.b);
+
+    prolongatePass(coarse.x, x);
+
+    relaxLevel(level, x, tmp, b, NB_POST_SMOOTHING);
+}
+
+void CpuFluidSolver::relaxLevel(int level, Plane& x, Plane& tmp,
+                                const Plane& b, int nbIterations)
+{
+    // Damped Jacobi, plain Jacobi doesn't smooth the checkerboard mode
+    const float OMEGA = 0.8f;
+
+    const PressureLevel& lvl = _pressureLevels[level];
+    for(int i=0; i < nbIterations; ++i)
+    {
+        jacobiPass(x, b, tmp, -lvl.dx*lvl.dx, 1.0f / 4.0f, lvl.ghost, OMEGA);
+        swap(x, tmp);
+    }
+}
+
+void CpuFluidSolver::jacobiPass(const Plane& x, const Plane& b, Plane& out,
+                                float alpha, float rBeta,
+                                float ghost, float omega)
+{
+    const int W = x.size.x;
+    const int H = x.size.y;
+
+    forEachRow(H, [&](int y)
+    {
+        const float* xC = x.row(y);
+        const float* xB = y > 0   ? x.row(y-1) : nullptr;
+        const float* xT = y < H-1 ? x.row(y+1) : nullptr;
+        const float* bC = b.row(y);
+        float* o = out.row(y);
+
+        // Cells outside the grid hold a fraction of the edge cell
+        auto cell = [&](int i)
+        {
+            float c = xC[i];
+            float l = i > 0   ? xC[i-1] : ghost*c;
+            float r = i < W-1 ? xC[i+1] : ghost*c;
+            float d = xB != nullptr ? xB[i] : ghost*c;
+            float u = xT != nullptr ? xT[i] : ghost*c;
+            o[i] = mix(c, (l + r + d + u + bC[i]*alpha) * rBeta, omega);
+        };
+
+        cell(0);
+        int i = 1;
+        if(xB != nullptr && xT != nullptr)
+        {
+            simd_t vAlpha = simdSet(alpha);
+            simd_t vRBeta = simdSet(rBeta);
+            simd_t vOmega = simdSet(omega);
+            simd_t vKeep  = simdSet(1.0f - omega);
+            for(; i + SIMD_WIDTH <= W-1; i += SIMD_WIDTH)
+            {
+                simd_t c = simdLoad(xC + i);
+                simd_t sum = simdAdd(simdLoad(xC + i-1), simdLoad(xC + i+1));
+                sum = simdAdd(sum, simdLoad(xB + i));
+                sum = simdAdd(sum, simdLoad(xT + i));
+                sum = simdAdd(sum, simdMul(simdLoad(bC + i), vAlpha));
+                simd_t jac = simdMul(sum, vRBeta);
+                simdStore(o + i, simdAdd(simdMul(c, vKeep),
+                                         simdMul(jac, vOmega)));
+            }
+        }
+        for(; i < W; ++i)
+            cell(i);
+    });
+}
+
+void CpuFluidSolver::residualPass(const Plane& x, const Plane& b, Plane& r,
+                                  float alpha, float rBeta, float ghost)
+{
+    const int W = x.size.x;
+    const int H = x.size.y;
+    const float beta = 1.0f / rBeta;
+    const float rAlpha = 1.0f / alpha;
+
+    forEachRow(H, [&](int y)
+    {
+        const float* xC = x.row(y);
+        const float* xB = y > 0   ? x.row(y-1) : nullptr;
+        const float* xT = y < H-1 ? x.row(y+1) : nullptr;
+        const float* bC = b.row(y);
+        float* o = r.row(y);
+
+        auto cell = [&](int i)
+        {
+            float c = xC[i];
+            float l = i > 0   ? xC[i-1] : ghost*c;
+            float rr = i < W-1 ? xC[i+1] : ghost*c;
+            float d = xB != nullptr ? xB[i] : ghost*c;
+            float u = xT != nullptr ? xT[i] : ghost*c;
+            o[i] = (l + rr + d + u + bC[i]*alpha - c*beta) * rAlpha;
+        };
+
+        cell(0);
+        int i = 1;
+        if(xB != nullptr && xT != nullptr)
+        {
+            simd_t vAlpha  = simdSet(alpha);
+            simd_t vBeta   = simdSet(beta);
+            simd_t vRAlpha = simdSet(rAlpha);
+            for(; i + SIMD_WIDTH <= W-1; i += SIMD_WIDTH)
+            {
+                simd_t sum = simdAdd(simdLoad(xC + i-1), simdLoad(xC + i+1));
+                sum = simdAdd(sum, simdLoad(xB + i));
+                sum = simdAdd(sum, simdLoad(xT + i));
+                sum = simdAdd(sum, simdMul(simdLoad(bC + i), vAlpha));
+                sum = simdSub(sum, simdMul(simdLoad(xC + i), vBeta));
+                simdStore(o + i, simdMul(sum, vRAlpha));
+            }
+        }
+        for(; i < W; ++i)
+            cell(i);
+    });
+}
+
+double CpuFluidSolver::fluidResidual(const Plane& x, Plane& q, Plane& r,
+                                     double& sqRhs)
+{
+    const float ALPHA = -DX*DX;
+
+    // Walled in regions only have a solution when their right-hand side
+    // sums to zero
+    vector<double> regionSums(_cgNbRegions, 0.0);
+    vector<int> regionSizes(_cgNbRegions, 0);
+    for(int y=0; y < HEIGHT; ++y)
+    {
+        const float* bC = _divergence.row(y);
+        for(int i=0; i < WIDTH; ++i)
+        {
+            int region = _cgRegions[y * WIDTH + i];
+            if(region >= 0)
+            {
+                regionSums[region] += bC[i]*ALPHA;
+                ++regionSizes[region];
+            }
+        }
+    }
+    vector<float> regionMeans(_cgNbRegions);
+    for(int g=0; g < _cgNbRegions; ++g)
+        regionMeans[g] = float(regionSums[g] / regionSizes[g]);
+
+    auto rhs = [&](const float* bC, const float* fC, int y, int i)
+    {
+        int region = _cgRegions[y * WIDTH + i];
+        return fC[i] * (bC[i]*ALPHA -
+                        (region >= 0 ? regionMeans[region] : 0.0f));
+    };
+
+    laplacianPass(x, q);
+    sqRhs = sumRows(HEIGHT, [&](int y)
+    {
+        const float* bC = _divergence.row(y);
+        const float* fC = _cgFluid.row(y);
+        double sqB = 0.0;
+        for(int i=0; i < WIDTH; ++i)
+        {
+            float b = rhs(bC, fC, y, i);
+            sqB += double(b) * b;
+        }
+        return sqB;
+    });
+    return sumRows(HEIGHT, [&](int y)
+    {
+        const float* bC = _divergence.row(y);
+        const float* fC = _cgFluid.row(y);
+        const float* qC = q.row(y);
+        float* rC = r.row(y);
+
+        double sqR = 0.0;
+        for(int i=0; i < WIDTH; ++i)
+        {
+            rC[i] = rhs(bC, fC, y, i) - qC[i];
+            sqR += double(rC[i]) * rC[i];
+        }
+        return sqR;
+    });
+}
+
+double CpuFluidSolver::pressureResidual()
+{
+    if(_pressureSolver != EPressureSolver::CONJUGATE_GRADIENT)
+        return IFluidSolver::pressureResidual();
+
+    // Solid cells hold mirrored pressures, they are out of the system
+    Plane& x = _cgDirection;
+    forEachRow(HEIGHT, [&](int y)
+    {
+        const float* pC = _front[PRESSURE].row(y);
+        const float* fC = _cgFluid.row(y);
+        float* xC = x.row(y);
+        for(int i=0; i < WIDTH; ++i)
+            xC[i] = pC[i] * fC[i];
+    });
+
+    double sqRhs = 0.0;
+    double sqResidual = fluidResidual(x, _cgProduct, _cgResidual, sqRhs);
+    return sqRhs > 0.0 ? sqrt(sqResidual / sqRhs) : 0.0;
+}
+
+double CpuFluidSolver::laplacianPass(const Plane& p, Plane& q)
+{
+    const int W = p.size.x;
+    const int H = p.size.y;
+
+    return sumRows(H, [&](int y)
+    {
+        const float* pC = p.row(y);
+        const float* pB = y > 0   ? p.row(y-1) : nullptr;
+        const float* pT = y < H-1 ? p.row(y+1) : nullptr;
+        const float* fC = _cgFluid.row(y);
+        const float* dC = _cgDiagonal.row(y);
+        float* o = q.row(y);
+
+        // Solid neighbours are zero, solid cells have a zero diagonal
+        auto cell = [&](int i)
+        {
+            float l = i > 0   ? pC[i-1] : 0.0f;
+            float r = i < W-1 ? pC[i+1] : 0.0f;
+            float d = pB != nullptr ? pB[i] : 0.0f;
+            float u = pT != nullptr ? pT[i] : 0.0f;
+            o[i] = dC[i]*pC[i] - fC[i]*(l + r + d + u);
+        };
+
+        cell(0);
+        int i = 1;
+        if(pB != nullptr && pT != nullptr)
+        {
+            for(; i + SIMD_WIDTH <= W-1; i += SIMD_WIDTH)
+            {
+                simd_t sum = simdAdd(simdLoad(pC + i-1), simdLoad(pC + i+1));
+                sum = simdAdd(sum, simdLoad(pB + i));
+                sum = simdAdd(sum, simdLoad(pT + i));
+                simdStore(o + i, simdSub(
+                    simdMul(simdLoad(pC + i), simdLoad(dC + i)),
+                    simdMul(simdLoad(fC + i), sum)));
+            }
+        }
+        for(; i < W; ++i)
+            cell(i);
+
+        double dot = 0.0;
+        for(i=0; i < W; ++i)
+            dot += double(pC[i]) * o[i];
+        return dot;
+    });
+}
+
+double CpuFluidSolver::preconditionPass(const Plane& r, Plane& tmp, Plane& z)
+{
+    const int W = r.size.x;
+    const int H = r.size.y;
+
+    // tmp = H^T r, upper triangle: right and top neighbours over the
+    // diagonal of the cell. r is zero on the solid cells.
+    forEachRow(H, [&](int y)
+    {
+        const float* rC = r.row(y);
+        const float* rT = y < H-1 ? r.row(y+1) : nullptr;
+        const float* dC = _cgRDiagonal.row(y);
+        float* o = tmp.row(y);
+
+        int i = 0;
+        if(rT != nullptr)
+        {
+            for(; i + SIMD_WIDTH <= W-1; i += SIMD_WIDTH)
+            {
+                simd_t sum = simdAdd(simdLoad(rC + i+1), simdLoad(rT + i));
+                simdStore(o + i, simdAdd(simdLoad(rC + i),
+                                         simdMul(sum, simdLoad(dC + i))));
+            }
+        }
+        for(; i < W; ++i)
+        {
+            float right = i < W-1 ? rC[i+1] : 0.0f;
+            float top = rT != nullptr ? rT[i] : 0.0f;
+            o[i] = rC[i] + dC[i]*(right + top);
+        }
+    });
+
+    // z = H tmp, lower triangle: left and bottom neighbours over their own
+    // diagonal, nothing on the solid cells
+    return sumRows(H, [&](int y)
+    {
+        const float* tC = tmp.row(y);
+        const float* tB = y > 0 ? tmp.row(y-1) : nullptr;
+        const float* dC = _cgRDiagonal.row(y);
+        const float* dB = y > 0 ? _cgRDiagonal.row(y-1) : nullptr;
+        const float* fC = _cgFluid.row(y);
+        const float* rC = r.row(y);
+        float* o = z.row(y);
+
+        o[0] = fC[0] * (tC[0] + (tB != nullptr ? dB[0]*tB[0] : 0.0f));
+        int i = 1;
+        if(tB != nullptr)
+        {
+            for(; i + SIMD_WIDTH <= W; i += SIMD_WIDTH)
+            {
+                simd_t sum = simdAdd(
+                    simdMul(simdLoad(dC + i-1), simdLoad(tC + i-1)),
+                    simdMul(simdLoad(dB + i), simdLoad(tB + i)));
+                simdStore(o + i, simdMul(simdLoad(fC + i),
+                                         simdAdd(simdLoad(tC + i), sum)));
+            }
+        }
+        for(; i < W; ++i)
+        {
+            float bottom = tB != nullptr ? dB[i]*tB[i] : 0.0f;
+            o[i] = fC[i] * (tC[i] + dC[i-1]*tC[i-1] + bottom);
+        }
+
+        double dot = 0.0;
+        for(i=0; i < W; ++i)
+            dot += double(rC[i]) * o[i];
+        return dot;
+    });
+}
+
+void CpuFluidSolver::accumulateResidual(const Plane& x, const Plane& b,
+                                        float alpha, float rBeta,
+                                        double& sumSqResidual, double& sumSqB)
+{
+    const int W = x.size.x;
+    const int H = x.size.y;
+    const float beta = 1.0f / rBeta;
+    const float rAlpha = 1.0f / alpha;
+
+    // One partial sum per row keeps the total independent of the threads
+    vector<double> rowSqResidual(H);
+    vector<double> rowSqB(H);
+
+    forEachRow(H, [&](int y)
+    {
+        const float* bC = b.row(y);
+        double sqResidual = 0.0;
+        double sqB = 0.0;
+        for(int i=0; i < W; ++i)
+        {
+            float sum = x.fetch(i-1, y) + x.fetch(i+1, y) +
+                        x.fetch(i, y-1) + x.fetch(i, y+1);
+            float r = (sum + bC[i]*alpha - x.row(y)[i]*beta) * rAlpha;
+            sqResidual += double(r) * r;
+            sqB += double(bC[i]) * bC[i];
+        }
+        rowSqResidual[y] = sqResidual;
+        rowSqB[y] = sqB;
+    });
+
+    for(int y=0; y < H; ++y)
+    {
+        sumSqResidual += rowSqResidual[y];
+        sumSqB += rowSqB[y];
+    }
+}
+
+void CpuFluidSolver::sorPass(Plane& x, const Plane& b, float alpha,
+                             float rBeta, float omega, int parity)
+{
+    const int W = x.size.x;
+    const int H = x.size.y;
+
+    // Neighbours have the other color, rows can be updated in place
+    forEachRow(H, [&](int y)
+    {
+        float* xC = x.row(y);
+        const float* xB = y > 0   ? x.row(y-1) : nullptr;
+        const float* xT = y < H-1 ? x.row(y+1) : nullptr;
+        const float* bC = b.row(y);
+
+        for(int i=(y + parity) % 2; i < W; i += 2)
+        {
+            float l = i > 0   ? xC[i-1] : 0.0f;
+            float r = i < W-1 ? xC[i+1] : 0.0f;
+            float d = xB != nullptr ? xB[i] : 0.0f;
+            float u = xT != nullptr ? xT[i] : 0.0f;
+            xC[i] = mix(xC[i], (l + r + d + u + bC[i]*alpha) * rBeta, omega);
+        }
+    });
+}
+
+void CpuFluidSolver::restrictPass(const Plane& fine, Plane& coarse)
+{
+    // Average of the four fine children, clamped on odd sized grids
+    forEachRow(coarse.size.y, [&](int y)
+    {
+        const float* f0 = fine.row(2*y);
+        const float* f1 = fine.row(glm::min(2*y+1, fine.size.y-1));
+        float* c = coarse.row(y);
+
+        for(int x=0; x < coarse.size.x; ++x)
+        {
+            int i0 = 2*x;
+            int i1 = glm::min(2*x+1, fine.size.x-1);
+            c[x] = mix(mix(f0[i0], f0[i1], 0.5f),
+                       mix(f1[i0], f1[i1], 0.5f), 0.5f);
+        }
+    });
+}
+
+void CpuFluidSolver::prolongatePass(const Plane& coarse, Plane& x)
+{
+    // Bilinear interpolation of the coarse correction, zero outside the grid
+    auto weights = [](int p, int size, int& i0, int& i1, float& w1)
+    {
+        int k = p / 2;
+        i0 = (p % 2 == 0) ? k-1 : k;
+        i1 = i0 + 1;
+        w1 = (p % 2 == 0) ? 0.75f : 0.25f;
+        if(i1 >= size) i1 = -1;
+    };
+
+    forEachRow(x.size.y, [&](int y)
+    {
+        int j0, j1;
+        float fv;
+        weights(y, coarse.size.y, j0, j1, fv);
+
+        float* o = x.row(y);
+        for(int px=0; px < x.size.x; ++px)
+        {
+            int i0, i1;
+            float fu;
+            weights(px, coarse.size.x, i0, i1, fu);
+
+            float c00 = (i0 < 0 || j0 < 0) ? 0.0f : coarse.row(j0)[i0];
+            float c10 = (i1 < 0 || j0 < 0) ? 0.0f : coarse.row(j0)[i1];
+            float c01 = (i0 < 0 || j1 < 0) ? 0.0f : coarse.row(j1)[i0];
+            float c11 = (i1 < 0 || j1 < 0) ? 0.0f : coarse.row(j1)[i1];
+
+            o[px] += mix(mix(c00, c10, fu), mix(c01, c11, fu), fv);
+        }
+    });
+}
+
+void CpuFluidSolver::substractPressureGradient()
+{
+    const float HALF_RDX = 0.5f / DX;
+    const Plane& pressure = _front[PRESSURE];
+
+    forEachRow(HEIGHT, [&](int y)
+    {
+        const float* pC = pressure.row(y);
+        const float* pB = y > 0        ? pressure.row(y-1) : nullptr;
+        const float* pT = y < HEIGHT-1 ? pressure.row(y+1) : nullptr;
+        float* vx = _front[VELOCITY_X].row(y);
+        float* vy = _front[VELOCITY_Y].row(y);
+
+        auto cell = [&](int x)
+        {
+            vx[x] -= HALF_RDX * (pressure.fetch(x+1, y) - pressure.fetch(x-1, y));
+            vy[x] -= HALF_RDX * (pressure.fetch(x, y+1) - pressure.fetch(x, y-1));
+        };
+
+        cell(0);
+        int x = 1;
+        if(pB != nullptr && pT != nullptr)
+        {
+            simd_t h = simdSet(HALF_RDX);
+            for(; x + SIMD_WIDTH <= WIDTH-1; x += SIMD_WIDTH)
+            {
+                simd_t gx = simdSub(simdLoad(pC + x+1), simdLoad(pC + x-1));
+                simd_t gy = simdSub(simdLoad(pT + x),   simdLoad(pB + x));
+                simdStore(vx + x, simdSub(simdLoad(vx + x), simdMul(h, gx)));
+                simdStore(vy + x, simdSub(simdLoad(vy + x), simdMul(h, gy)));
+            }
+        }
+        for(; x < WIDTH; ++x)
+            cell(x);
+    });
+}
+
+void CpuFluidSolver::frontier()
+{
+    Plane& velX = _front[VELOCITY_X];
+    Plane& velY = _front[VELOCITY_Y];
+    Plane& pressure = _front[PRESSURE];
+    const glm::ivec2 OFFSETS[] = {
+        glm::ivec2(-1, 0), glm::ivec2(1, 0),
+        glm::ivec2(0, -1), glm::ivec2(0, 1)
+    };
+
+    // Boundary cells only read fluid cells, they are updated in place
+    int nbCells = (int) _boundaryCells.size();
+    _threadPool.parallelFor(nbCells, 1024, [&](int begin, int end)
+    {
+        for(int i=begin; i < end; ++i)
+        {
+            const FluidBoundaryCell& cell = _boundaryCells[i];
+            int x = int(cell.cell.x);
+            int y = int(cell.cell.y);
+
+            // Mirror the average of the fluid neighbours
+            glm::vec3 moy(0.0f);
+            for(int n=0; n < 4; ++n)
+            {
+                float weight = cell.weights[n];
+                if(weight == 0.0f)
+                    continue;
+
+                int nx = x + OFFSETS[n].x;
+                int ny = y + OFFSETS[n].y;
+                moy += glm::vec3(velX.row(ny)[nx],
+                                 velY.row(ny)[nx],
+                                 pressure.row(ny)[nx]) * weight;
+            }
+
+            velX.row(y)[x] = -moy.x;
+            velY.row(y)[x] = -moy.y;
+            pressure.row(y)[x] = moy.z + cell.keep * pressure.row(y)[x];
+        }
+    });
+}
+
+void CpuFluidSolver::setCandlePosition(const glm::vec2& position)
+{
+    _candlePosition = position;
+}
+
+glm::vec2 CpuFluidSolver::candlePosition() const
+{
+    return _candlePosition;
+}
+
+bool CpuFluidSolver::restoreCheckpoint(const FluidCheckpoint& checkpoint)
+{
+    if(checkpoint.gridSize != gridSize())
+        return false;
+
+    for(int y=0; y < HEIGHT; ++y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            glm::vec4 dye      = checkpoint.fieldTexel(EFluidField::DYE, x, y);
+            glm::vec4 velocity = checkpoint.fieldTexel(EFluidField::VELOCITY, x, y);
+            glm::vec4 pressure = checkpoint.fieldTexel(EFluidField::PRESSURE, x, y);
+            glm::vec4 heat     = checkpoint.fieldTexel(EFluidField::HEAT, x, y);
+            glm::vec4 frontier = checkpoint.fieldTexel(EFluidField::FRONTIER, x, y);
+
+            _front[DYE_R].row(y)[x]      = dye.x;
+            _front[DYE_G].row(y)[x]      = dye.y;
+            _front[DYE_B].row(y)[x]      = dye.z;
+            _front[VELOCITY_X].row(y)[x] = velocity.x;
+            _front[VELOCITY_Y].row(y)[x] = velocity.y;
+            _front[HEAT].row(y)[x]       = heat.x;
+            _front[PRESSURE].row(y)[x]   = pressure.x;
+            _frontierPlane.row(y)[x]     = frontier.x;
+        }
+    }
+
+    _candlePosition = checkpoint.candlePosition;
+    _boundaryCells = findBoundaryCells();
+    initPressureMask();
+
+    return true;
+}
+
+std::vector<glm::vec4> CpuFluidSolver::fieldData(EFluidField field)
+{
+    vector<glm::vec4> data(AREA);
+    for(int y=0; y < HEIGHT; ++y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            glm::vec4& texel = data[y*WIDTH + x];
+            switch(field)
+            {
+            case EFluidField::DYE :
+                texel = glm::vec4(_front[DYE_R].row(y)[x],
+                                  _front[DYE_G].row(y)[x],
+                                  _front[DYE_B].row(y)[x], 1.0f);
+                break;
+            case EFluidField::VELOCITY :
+                texel = glm::vec4(_front[VELOCITY_X].row(y)[x],
+                                  _front[VELOCITY_Y].row(y)[x], 0, 0);
+                break;
+            case EFluidField::PRESSURE :
+                texel = glm::vec4(_front[PRESSURE].row(y)[x], 0, 0, 0);
+                break;
+            case EFluidField::HEAT :
+                texel = glm::vec4(_front[HEAT].row(y)[x], 0, 0, 0);
+                break;
+            case EFluidField::DIVERGENCE :
+                texel = glm::vec4(_divergence.row(y)[x], 0, 0, 0);
+                break;
+            case EFluidField::FRONTIER :
+                texel = glm::vec4(_frontierPlane.row(y)[x], 0, 0, 0);
+                break;
+            }
+        }
+    }
+    return data;
+}
+
+int CpuFluidSolver::threadCount() const
+{
+    return _threadPool.threadCount();
+}
@@ -0,0 +1,188 @@
+#ifndef CPU_FLUID_SOLVER_H
+#define CPU_FLUID_SOLVER_H
+
+#include <vector>
+
+#include "IFluidSolver.h"
+#include "ThreadPool.h"
+
+
+// Reference implementation of the fluid shaders, one float plane per
+// channel, rows split in blocks across a thread pool
+class CpuFluidSolver : public IFluidSolver
+{
+public:
+    CpuFluidSolver(const FluidSettings& settings);
+    virtual ~CpuFluidSolver();
+
+    virtual void initialize() override;
+    virtual void terminate() override;
+
+    virtual void advect() override;
+    virtual void diffuse() override;
+    virtual void heat() override;
+    virtual void computePressure() override;
+    virtual void substractPressureGradient() override;
+    virtual void frontier() override;
+
+    virtual void setCandlePosition(const glm::vec2& position) override;
+    virtual glm::vec2 candlePosition() const override;
+
+    virtual bool restoreCheckpoint(const FluidCheckpoint& checkpoint) override;
+
+    virtual std::vector<glm::vec4> fieldData(EFluidField field) override;
+
+    // The conjugate gradient measures the fluid cells system it solves
+    virtual double pressureResidual() override;
+
+    int threadCount() const;
+
+
+protected:
+    // Rows are padded so that SIMD loads never straddle two rows
+    struct Plane
+    {
+        glm::ivec2 size;
+        int stride;
+        std::vector<float> data;
+
+        void resize(const glm::ivec2& size);
+        float* row(int y);
+        const float* row(int y) const;
+
+        // Zero outside the plane, like texelFetch out of bounds
+        float fetch(int x, int y) const;
+    };
+
+    // Texels and weights of a linear texture() lookup with clamp to edge
+    struct Footprint
+    {
+        Footprint(const glm::ivec2& size, const glm::vec2& pos);
+
+        float sample(const Plane& plane) const;
+        float minimum(const Plane& plane) const;
+        float maximum(const Plane& plane) const;
+
+        int i0, i1;
+        int j0, j1;
+        float fu, fv;
+    };
+
+    // Where advect.frag fetches cell (x, y) from when direction is -1,
+    // where the cell goes when it is 1
+    glm::vec2 trace(int x, int y, float direction) const;
+
+    // Same system as jacobi.frag. x and b may be the same plane.
+    void jacobiPass(const Plane& x, const Plane& b, Plane& out,
+                    float alpha, float rBeta, float ghost, float omega);
+    void residualPass(const Plane& x, const Plane& b, Plane& r,
+                      float alpha, float rBeta, float ghost);
+    // Relaxes in place the cells where (x+y)%2 == parity
+    void sorPass(Plane& x, const Plane& b, float alpha, float rBeta,
+                 float omega, int parity);
+    void restrictPass(const Plane& fine, Plane& coarse);
+    void prolongatePass(const Plane& coarse, Plane& x);
+    // q = D p - fluid neighbours on the fluid cells and zero on the solid
+    // ones, where D counts the faces not against a solid. p must be zero on
+    // the solid cells. Returns p.q
+    double laplacianPass(const Plane& p, Plane& q);
+    // r = b - A x for the laplacianPass() system, where b is the scaled
+    // divergence of the fluid cells less the mean of their walled in
+    // region. Returns r.r and sets b.b
+    double fluidResidual(const Plane& x, Plane& q, Plane& r, double& sqRhs);
+    // Incomplete Poisson preconditioner z = H * H^T * r, where H is the
+    // identity plus the left and bottom fluid neighbours over their D.
+    // Returns r.z
+    double preconditionPass(const Plane& r, Plane& tmp, Plane& z);
+
+    // Adds the squared residuals of the jacobiPass() system and the squared
+    // right-hand side, zero outside the grid
+    void accumulateResidual(const Plane& x, const Plane& b,
+                            float alpha, float rBeta,
+                            double& sumSqResidual, double& sumSqB);
+
+    void initPressureLevels();
+    // Fluid cells, diagonal and enclosed fluid regions of the conjugate
+    // gradient system, from the frontier
+    void initPressureMask();
+    float pressureResidualNorm();
+    // Diffuses the channels first to last together, returns the number of
+    // iterations done
+    int diffuseChannels(int first, int last, float alpha, float rBeta,
+                        float& residual);
+    void jacobiPressure();
+    void sorPressure();
+    void multigridPressure();
+    // Preconditioned conjugate gradient on the fluid cells only, with no
+    // flux through the solid faces
+    void conjugateGradientPressure();
+    void vCycle(int level, Plane& x, Plane& tmp, const Plane& b);
+    void relaxLevel(int level, Plane& x, Plane& tmp, const Plane& b,
+                    int nbIterations);
+
+    // Runs task(y) over every row of a grid of the given height
+    template<typename Task>
+    void forEachRow(int height, const Task& task);
+    // Sum of the task(y) of every row, independent of the threads
+    template<typename Task>
+    double sumRows(int height, const Task& task);
+
+
+private:
+    enum EChannel
+    {
+        DYE_R,
+        DYE_G,
+        DYE_B,
+        VELOCITY_X,
+        VELOCITY_Y,
+        HEAT,
+        PRESSURE,
+        NB_CHANNELS
+    };
+
+    ThreadPool _threadPool;
+
+    // Each stage writes in _back before swapping with _front
+    Plane _front[NB_CHANNELS];
+    Plane _back[NB_CHANNELS];
+    Plane _predicted[NB_CHANNELS];
+    Plane _frontierPlane;
+    std::vector<FluidBoundaryCell> _boundaryCells;
+    Plane _divergence;
+    Plane _curl;
+    Plane _diffuseRhs[2];
+    glm::vec2 _candlePosition;
+
+    // Conjugate gradient vectors, x is the pressure plane
+    Plane _cgResidual;
+    Plane _cgPreconditioned;
+    Plane _cgDirection;
+    Plane _cgProduct;
+
+    // 1 on the fluid cells and 0 on the solid ones, the diagonal D and its
+    // inverse, both 0 on the solid cells
+    Plane _cgFluid;
+    Plane _cgDiagonal;
+    Plane _cgRDiagonal;
+    // Fluid regions walled in by solids have no pressure reference, their
+    // right-hand side loses its mean. Index of the region of each cell,
+    // -1 outside of them.
+    std::vector<int> _cgRegions;
+    int _cgNbRegions;
+
+    // Multigrid pyramid, level 0 solves in the pressure planes
+    struct PressureLevel
+    {
+        glm::ivec2 size;
+        float dx;
+        float ghost;
+        Plane x;
+        Plane tmp;
+        Plane b;
+        Plane r;
+    };
+    std::vector<PressureLevel> _pressureLevels;
+};
+
+#endif // CPU_FLUID_SOLVER_H
@@ -1,10 +1,30 @@
 SET(FLUID2D_SRC_DIR ${CMAKE_CURRENT_SOURCE_DIR}/Fluid2D)
 
 SET(FLUID2D_HEADERS
-    ${FLUID2D_SRC_DIR}/FluidCharacter.h)
+    ${FLUID2D_SRC_DIR}/CpuFluidSolver.h
+    ${FLUID2D_SRC_DIR}/FluidBatchRunner.h
+    ${FLUID2D_SRC_DIR}/FluidCharacter.h
+    ${FLUID2D_SRC_DIR}/FluidCheckpoint.h
+    ${FLUID2D_SRC_DIR}/FluidFrameExporter.h
+    ${FLUID2D_SRC_DIR}/FluidSettings.h
+    ${FLUID2D_SRC_DIR}/GlAsyncReadback.h
+    ${FLUID2D_SRC_DIR}/GlFluidSolver.h
+    ${FLUID2D_SRC_DIR}/GlStageTimer.h
+    ${FLUID2D_SRC_DIR}/IFluidSolver.h
+    ${FLUID2D_SRC_DIR}/ThreadPool.h)
     
 SET(FLUID2D_SOURCES
-    ${FLUID2D_SRC_DIR}/FluidCharacter.cpp)
+    ${FLUID2D_SRC_DIR}/CpuFluidSolver.cpp
+    ${FLUID2D_SRC_DIR}/FluidBatchRunner.cpp
+    ${FLUID2D_SRC_DIR}/FluidCharacter.cpp
+    ${FLUID2D_SRC_DIR}/FluidCheckpoint.cpp
+    ${FLUID2D_SRC_DIR}/FluidFrameExporter.cpp
+    ${FLUID2D_SRC_DIR}/FluidSettings.cpp
+    ${FLUID2D_SRC_DIR}/GlAsyncReadback.cpp
+    ${FLUID2D_SRC_DIR}/GlFluidSolver.cpp
+    ${FLUID2D_SRC_DIR}/GlStageTimer.cpp
+    ${FLUID2D_SRC_DIR}/IFluidSolver.cpp
+    ${FLUID2D_SRC_DIR}/ThreadPool.cpp)
 
 SET(FLUID2D_RCC_FILES
     ${FLUID2D_SRC_DIR}/resources/Fluid2D.qrc)
@@ -14,9 +34,21 @@ SET(FLUID2D_SHADER_FILES
     ${FLUID2D_SRC_DIR}/resources/shaders/drawFluid.frag
     ${FLUID2D_SRC_DIR}/resources/shaders/drawFluid.vert
     ${FLUID2D_SRC_DIR}/resources/shaders/frontier.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/frontier.vert
+    ${FLUID2D_SRC_DIR}/resources/shaders/frontierScatter.frag
     ${FLUID2D_SRC_DIR}/resources/shaders/gradSub.frag
     ${FLUID2D_SRC_DIR}/resources/shaders/heat.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/jacobi.comp
     ${FLUID2D_SRC_DIR}/resources/shaders/jacobi.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/maccormack.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/prolongate.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/residual.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/residualNorm.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/restrict.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/sor.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/tileActivity.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/tileCopy.frag
+    ${FLUID2D_SRC_DIR}/resources/shaders/tileDilate.frag
     ${FLUID2D_SRC_DIR}/resources/shaders/update.vert)
 SET(FLUID2D_TEXTURES_FILES
     ${FLUID2D_SRC_DIR}/resources/textures/statsPanel.bmp)
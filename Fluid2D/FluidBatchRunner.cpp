@@ -0,0 +1,528 @@
+#include "FluidBatchRunner.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include <GL3/gl3w.h>
+
+#ifdef EXTH_DEMOS_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "CpuFluidSolver.h"
+#include "GlFluidSolver.h"
+
+using namespace std;
+
+
+const int FluidBatchRunner::NB_WARMUP_STEPS = 10;
+
+FluidBatchRunner::FluidBatchRunner(const FluidSettings& settings) :
+    _settings(settings),
+    _display(nullptr),
+    _context(nullptr),
+    _summaries(),
+    _restoredState(),
+    _checkpointSaved(false)
+{
+}
+
+FluidBatchRunner::~FluidBatchRunner()
+{
+    destroyContext();
+}
+
+int FluidBatchRunner::run()
+{
+    if(!_settings.restoreFile.empty() &&
+       !_restoredState.load(_settings.restoreFile))
+        return 1;
+
+    if(_settings.batchBackend != EFluidBackend::CPU && !createContext())
+        return 1;
+
+    vector<ERelaxation> relaxations;
+    if(_settings.compareRelaxations)
+    {
+        relaxations.push_back(ERelaxation::JACOBI);
+        relaxations.push_back(ERelaxation::RED_BLACK_SOR);
+    }
+    else
+    {
+        relaxations.push_back(_settings.relaxation);
+    }
+
+    vector<EAdvection> advections;
+    if(_settings.compareAdvections)
+    {
+        advections.push_back(EAdvection::SEMI_LAGRANGIAN);
+        advections.push_back(EAdvection::MACCORMACK);
+    }
+    else
+    {
+        advections.push_back(_settings.advection);
+    }
+
+    _summaries.clear();
+    for(ERelaxation relaxation : relaxations)
+    {
+        for(EAdvection advection : advections)
+        {
+            FluidSettings settings = _settings;
+            settings.relaxation = relaxation;
+            settings.advection = advection;
+            runBackends(settings);
+        }
+    }
+
+    if(_summaries.size() > 1)
+        printSummaries();
+
+    destroyContext();
+    return 0;
+}
+
+void FluidBatchRunner::runBackends(const FluidSettings& settings)
+{
+    EFluidBackend backend = settings.batchBackend;
+    string relaxation = relaxationName(settings.relaxation);
+    if(settings.advection == EAdvection::MACCORMACK)
+        relaxation += " maccormack";
+    if(settings.vorticity != 0.0f)
+        relaxation += " vorticity";
+
+    // Other storages are measured against the full precision one
+    FluidSettings gpuSettings = settings;
+    if(settings.compareStorages)
+        gpuSettings.textureStorage = ETextureStorage::FULL;
+    string gpuName = "GPU " + relaxation +
+                     storageName(gpuSettings.textureStorage);
+    if(gpuSettings.tileSize != 0)
+        gpuName += " tiles " + to_string(gpuSettings.tileSize);
+    if(gpuSettings.jacobiCompute)
+        gpuName += " compute";
+
+    GlFluidSolver gpuSolver(gpuSettings);
+    CpuFluidSolver cpuSolver(settings);
+
+    if(backend != EFluidBackend::CPU)
+    {
+        double startupTime = initializeSolver(gpuSolver);
+        runSolver(gpuName, gpuSolver, startupTime);
+        if(gpuSettings.tileSize != 0)
+        {
+            cout << "  active tiles   " << fixed << setprecision(1)
+                 << gpuSolver.activeTileRatio() * 100.0f
+                 << " % of the grid" << endl;
+        }
+    }
+
+    if(backend != EFluidBackend::GPU)
+    {
+        double startupTime = initializeSolver(cpuSolver);
+        runSolver("CPU " + relaxation + " (" +
+                  to_string(cpuSolver.threadCount()) + " threads)",
+                  cpuSolver, startupTime);
+    }
+
+    if(backend == EFluidBackend::COMPARE)
+        compareSolvers(gpuSolver, cpuSolver, "CPU against " + gpuName);
+
+    if(settings.compareStorages && backend != EFluidBackend::CPU)
+    {
+        const ETextureStorage STORAGES[] = {
+            ETextureStorage::PACKED,
+            ETextureStorage::HALF
+        };
+
+        for(ETextureStorage storage : STORAGES)
+        {
+            FluidSettings storageSettings = settings;
+            storageSettings.textureStorage = storage;
+            string storageSolverName = "GPU " + relaxation +
+                                       storageName(storage);
+
+            GlFluidSolver storageSolver(storageSettings);
+            double startupTime = initializeSolver(storageSolver);
+            runSolver(storageSolverName, storageSolver, startupTime);
+            compareSolvers(gpuSolver, storageSolver,
+                           storageSolverName + " against " + gpuName);
+            storageSolver.terminate();
+        }
+    }
+
+    if(backend != EFluidBackend::CPU)
+        gpuSolver.terminate();
+    if(backend != EFluidBackend::GPU)
+        cpuSolver.terminate();
+}
+
+double FluidBatchRunner::initializeSolver(IFluidSolver& solver)
+{
+    typedef chrono::high_resolution_clock clock;
+    clock::time_point start = clock::now();
+    solver.initialize();
+    solver.finish();
+    return chrono::duration<double>(clock::now() - start).count();
+}
+
+void FluidBatchRunner::runSolver(const string& name, IFluidSolver& solver,
+                                 double startupTime)
+{
+    const int NB_STAGES = IFluidSolver::NB_STAGES;
+
+    if(!_settings.restoreFile.empty() &&
+       !solver.restoreCheckpoint(_restoredState))
+    {
+        cerr << "Checkpoint grid size doesn't match, "
+             << name << " starts from the initial state" << endl;
+    }
+
+    double initialContrast = dyeContrast(solver);
+
+    for(int i=0; i < NB_WARMUP_STEPS; ++i)
+        solver.step();
+    solver.finish();
+
+    vector<StageTiming> stageTimes;
+    for(int s=0; s < NB_STAGES; ++s)
+        stageTimes.push_back(StageTiming{IFluidSolver::STAGE_NAMES[s], 0.0});
+
+    // Each stage is drained before the next one starts so that its wall
+    // time is not hidden by the driver's command queue.
+    typedef chrono::high_resolution_clock clock;
+    clock::time_point runStart = clock::now();
+    FluidSolveStats statsSum;
+    statsSum.diffuseResidual = 0.0f;
+    statsSum.pressureResidual = 0.0f;
+    for(int i=0; i < _settings.batchSteps; ++i)
+    {
+        solver.beginStages();
+        for(int s=0; s < NB_STAGES; ++s)
+        {
+            clock::time_point stageStart = clock::now();
+            (solver.*IFluidSolver::STAGES[s])();
+            solver.finish();
+            stageTimes[s].seconds += chrono::duration<double>(
+                clock::now() - stageStart).count();
+        }
+        solver.endStages();
+
+        const FluidSolveStats& stats = solver.solveStats();
+        statsSum.diffuseIterations  += stats.diffuseIterations;
+        statsSum.diffuseResidual    += stats.diffuseResidual;
+        statsSum.pressureIterations += stats.pressureIterations;
+        statsSum.pressureResidual   += stats.pressureResidual;
+    }
+    double totalTime = chrono::duration<double>(
+        clock::now() - runStart).count();
+
+    // One more step, untimed, to look at the pressure solve
+    solver.beginStages();
+    solver.advect();
+    solver.diffuse();
+    solver.heat();
+    solver.computePressure();
+    double residual = solver.pressureResidual();
+    solver.substractPressureGradient();
+    solver.frontier();
+    solver.endStages();
+
+    // Numerical diffusion wears the dye contrast down
+    double contrast = dyeContrast(solver) / initialContrast;
+
+    double nbSteps = _settings.batchSteps;
+    printReport(name, stageTimes, totalTime);
+    cout << "  startup        " << fixed << setprecision(1)
+         << startupTime * 1.0e3 << " ms to generate and upload the fields"
+         << endl;
+    cout << "  iterations     " << fixed << setprecision(1)
+         << statsSum.diffuseIterations / nbSteps << " diffuse, "
+         << statsSum.pressureIterations / nbSteps << " pressure per step"
+         << endl;
+    if(solver.tolerance() > 0.0f)
+    {
+        // The Jacobi diffusion measures its update, not a residual
+        const char* diffuseMeasure =
+            solver.relaxation() == ERelaxation::JACOBI ? " diffuse update, "
+                                                       : " diffuse, ";
+        cout << "  achieved       " << scientific << setprecision(2)
+             << statsSum.diffuseResidual / nbSteps << diffuseMeasure
+             << statsSum.pressureResidual / nbSteps << " pressure"
+             << " (mean relative residual, tolerance "
+             << solver.tolerance() << ")" << endl;
+    }
+    cout << "  pressure residual " << scientific << setprecision(2)
+         << residual << " (relative)" << endl;
+    cout << "  dye contrast " << fixed << setprecision(1)
+         << contrast * 100.0 << " % of the initial one" << endl;
+
+    double pressureTime = 0.0;
+    for(int s=0; s < NB_STAGES; ++s)
+    {
+        if(IFluidSolver::STAGES[s] == &IFluidSolver::computePressure)
+            pressureTime = stageTimes[s].seconds;
+    }
+
+    _summaries.push_back(RunSummary{
+        name, totalTime * 1.0e3 / nbSteps, pressureTime * 1.0e3 / nbSteps,
+        statsSum.pressureIterations / nbSteps, residual, contrast});
+
+    saveCheckpoint(solver);
+}
+
+void FluidBatchRunner::saveCheckpoint(IFluidSolver& solver)
+{
+    // Later runs would only overwrite it with a state of another scheme
+    if(_settings.checkpointFile.empty() || _checkpointSaved)
+        return;
+
+    typedef chrono::high_resolution_clock clock;
+    clock::time_point start = clock::now();
+
+    FluidCheckpoint checkpoint;
+    solver.requestCheckpoint();
+    solver.finish();
+    if(!solver.takeCheckpoint(checkpoint) ||
+       !checkpoint.save(_settings.checkpointFile,
+                        _settings.compressCheckpoints))
+        return;
+
+    double ms = chrono::duration<double>(clock::now() - start).count() * 1.0e3;
+    cout << "  checkpoint     " << _settings.checkpointFile << " written in "
+         << fixed << setprecision(1) << ms << " ms" << endl;
+    _checkpointSaved = true;
+}
+
+void FluidBatchRunner::compareSolvers(IFluidSolver& reference,
+                                      IFluidSolver& candidate,
+                                      const string& title)
+{
+    const EFluidField FIELDS[] = {
+        EFluidField::DYE,
+        EFluidField::VELOCITY,
+        EFluidField::PRESSURE,
+        EFluidField::HEAT
+    };
+    const char* FIELD_NAMES[] = {
+        "dye", "velocity", "pressure", "heat"
+    };
+    const int NB_FIELDS = 4;
+
+    cout << title << " after " << NB_WARMUP_STEPS + _settings.batchSteps + 1
+         << " steps" << endl;
+    cout << scientific << setprecision(2);
+
+    for(int f=0; f < NB_FIELDS; ++f)
+    {
+        vector<glm::vec4> ref = reference.fieldData(FIELDS[f]);
+        vector<glm::vec4> cand = candidate.fieldData(FIELDS[f]);
+
+        double maxRef = 0.0;
+        double maxDiff = 0.0;
+        double sumSqDiff = 0.0;
+        for(size_t i=0; i < ref.size(); ++i)
+        {
+            for(int c=0; c < 4; ++c)
+            {
+                double diff = glm::abs(cand[i][c] - ref[i][c]);
+                maxRef = glm::max(maxRef, (double) glm::abs(ref[i][c]));
+                maxDiff = glm::max(maxDiff, diff);
+                sumSqDiff += diff * diff;
+            }
+        }
+
+        cout << "  " << left << setw(10) << FIELD_NAMES[f] << right
+             << "max |diff| " << maxDiff
+             << ", rms " << sqrt(sumSqDiff / (ref.size() * 4))
+             << ", max |value| " << maxRef << endl;
+    }
+}
+
+#ifdef EXTH_DEMOS_HEADLESS_EGL
+bool FluidBatchRunner::createContext()
+{
+    // Mesa's surfaceless platform needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay != nullptr)
+    {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if(display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if(display == EGL_NO_DISPLAY ||
+       !eglInitialize(display, nullptr, nullptr) ||
+       !eglBindAPI(EGL_OPENGL_API))
+    {
+        cerr << "Could not initialize an EGL display" << endl;
+        return false;
+    }
+    _display = display;
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+            EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(
+        display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if(context == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        cerr << "Could not create an offscreen OpenGL context" << endl;
+        return false;
+    }
+    _context = context;
+
+    if(gl3wInit() != 0)
+    {
+        cerr << "Could not load OpenGL functions" << endl;
+        return false;
+    }
+
+    cout << "OpenGL renderer: " << glGetString(GL_RENDERER) << endl;
+    return true;
+}
+
+void FluidBatchRunner::destroyContext()
+{
+    if(_context != nullptr)
+    {
+        eglMakeCurrent(_display, EGL_NO_SURFACE,
+                       EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(_display, _context);
+        _context = nullptr;
+    }
+
+    if(_display != nullptr)
+    {
+        eglTerminate(_display);
+        _display = nullptr;
+    }
+}
+#else
+bool FluidBatchRunner::createContext()
+{
+    cerr << "Batch mode needs an EGL offscreen context, "
+         << "which was not available at build time" << endl;
+    return false;
+}
+
+void FluidBatchRunner::destroyContext()
+{
+}
+#endif
+
+void FluidBatchRunner::printReport(const string& name,
+                                   const vector<StageTiming>& stageTimes,
+                                   double totalTime) const
+{
+    int nbSteps = _settings.batchSteps;
+    double nbCells = double(_settings.gridSize.x) * _settings.gridSize.y;
+
+    cout << name << " fluid batch: " << nbSteps << " steps on a "
+         << _settings.gridSize.x << "x" << _settings.gridSize.y << " grid ("
+         << pressureSolverName(_settings.pressureSolver) << " pressure)"
+         << endl;
+
+    cout << fixed << setprecision(3);
+    for(const StageTiming& stage : stageTimes)
+    {
+        cout << "  " << left << setw(10) << stage.name << right
+             << setw(10) << stage.seconds * 1.0e3 / nbSteps << " ms/step"
+             << setw(8) << setprecision(1)
+             << stage.seconds * 100.0 / totalTime << " %"
+             << setprecision(3) << endl;
+    }
+    cout << "  " << left << setw(10) << "total" << right
+         << setw(10) << totalTime * 1.0e3 / nbSteps << " ms/step" << endl;
+
+    cout << setprecision(1);
+    cout << "  " << nbSteps / totalTime << " steps/s, "
+         << nbSteps * nbCells / totalTime / 1.0e6 << " Mcells/s" << endl;
+}
+
+void FluidBatchRunner::printSummaries() const
+{
+    // The SOR diffusion solves against the field entering the stage while
+    // the Jacobi one smooths its own iterates, only the pressure solves
+    // are the same system and can be timed against each other
+    bool pressureOnly = _settings.compareRelaxations;
+    if(pressureOnly)
+        cout << "Summary (pressure solve only, the diffusions differ)" << endl;
+    else
+        cout << "Summary" << endl;
+
+    for(const RunSummary& summary : _summaries)
+    {
+        double msPerStep = pressureOnly ? summary.pressureMsPerStep
+                                        : summary.msPerStep;
+        cout << "  " << left << setw(32) << summary.name << right
+             << fixed << setprecision(3) << setw(10) << msPerStep
+             << " ms/step, " << setprecision(1) << summary.pressureIterations
+             << " pressure iterations, residual "
+             << scientific << setprecision(2) << summary.residual
+             << ", dye contrast " << fixed << setprecision(1)
+             << summary.dyeContrast * 100.0 << " %" << endl;
+    }
+}
+
+string FluidBatchRunner::pressureSolverName(EPressureSolver solver)
+{
+    switch(solver)
+    {
+    case EPressureSolver::JACOBI :             return "single grid";
+    case EPressureSolver::MULTIGRID :          return "multigrid";
+    case EPressureSolver::CONJUGATE_GRADIENT : return "conjugate gradient";
+    }
+    return "";
+}
+
+string FluidBatchRunner::relaxationName(ERelaxation relaxation)
+{
+    switch(relaxation)
+    {
+    case ERelaxation::JACOBI :        return "jacobi";
+    case ERelaxation::RED_BLACK_SOR : return "red-black SOR";
+    }
+    return "";
+}
+
+string FluidBatchRunner::storageName(ETextureStorage storage)
+{
+    // Full precision is the default and goes unmentioned
+    switch(storage)
+    {
+    case ETextureStorage::FULL :   return "";
+    case ETextureStorage::PACKED : return " packed";
+    case ETextureStorage::HALF :   return " half";
+    }
+    return "";
+}
+
+double FluidBatchRunner::dyeContrast(IFluidSolver& solver)
+{
+    vector<glm::vec4> dye = solver.fieldData(EFluidField::DYE);
+
+    // Standard deviation of the red channel
+    double sum = 0.0;
+    double sumSq = 0.0;
+    for(const glm::vec4& texel : dye)
+    {
+        sum += texel.x;
+        sumSq += double(texel.x) * texel.x;
+    }
+
+    double mean = sum / dye.size();
+    return sqrt(glm::max(0.0, sumSq / dye.size() - mean * mean));
+}
@@ -0,0 +1,74 @@
+#ifndef FLUID_BATCH_RUNNER_H
+#define FLUID_BATCH_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include "FluidCheckpoint.h"
+#include "FluidSettings.h"
+
+class IFluidSolver;
+
+
+// Runs the fluid simulation for a fixed number of steps, on the GPU in an
+// offscreen context and/or on the CPU, and prints the wall time spent in
+// each stage.
+class FluidBatchRunner
+{
+public:
+    FluidBatchRunner(const FluidSettings& settings);
+    virtual ~FluidBatchRunner();
+
+    // Returns the process exit code
+    virtual int run();
+
+
+protected:
+    struct StageTiming
+    {
+        std::string name;
+        double seconds;
+    };
+
+    struct RunSummary
+    {
+        std::string name;
+        double msPerStep;
+        double pressureMsPerStep;
+        double pressureIterations;
+        double residual;
+        double dyeContrast;
+    };
+
+    bool createContext();
+    void destroyContext();
+    void runBackends(const FluidSettings& settings);
+    // Returns the time taken by initialize(), in seconds
+    double initializeSolver(IFluidSolver& solver);
+    void runSolver(const std::string& name, IFluidSolver& solver,
+                   double startupTime);
+    void saveCheckpoint(IFluidSolver& solver);
+    void printReport(const std::string& name,
+                     const std::vector<StageTiming>& stageTimes,
+                     double totalTime) const;
+    void compareSolvers(IFluidSolver& reference, IFluidSolver& candidate,
+                        const std::string& title);
+    void printSummaries() const;
+    static std::string pressureSolverName(EPressureSolver solver);
+    static std::string relaxationName(ERelaxation relaxation);
+    static std::string storageName(ETextureStorage storage);
+    static double dyeContrast(IFluidSolver& solver);
+
+    static const int NB_WARMUP_STEPS;
+
+
+private:
+    FluidSettings _settings;
+    void* _display;
+    void* _context;
+    std::vector<RunSummary> _summaries;
+    FluidCheckpoint _restoredState;
+    bool _checkpointSaved;
+};
+
+#endif // FLUID_BATCH_RUNNER_H
@@ -1,5 +1,6 @@
 #include "FluidCharacter.h"
 
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <memory>
@@ -9,7 +10,6 @@
 #include <GL3/gl3w.h>
 
 #include <CellarWorkbench/Misc/StringUtils.h>
-#include <CellarWorkbench/Misc/SimplexNoise.h>
 
 #include <PropRoom2D/Team/AbstractTeam.h>
 
@@ -27,25 +27,31 @@ using namespace prop2;
 using namespace scaena;
 
 
-const int FluidCharacter::WIDTH = 256;
-const int FluidCharacter::HEIGHT = 256;
-const int FluidCharacter::AREA = WIDTH * HEIGHT;
-const int FluidCharacter::POINT_SIZE = 3;
+namespace
+{
+    // Fixed step mode catches up on at most that many steps per draw
+    const int MAX_PENDING_STEPS = 8;
+}
 
 
-FluidCharacter::FluidCharacter() :
+FluidCharacter::FluidCharacter(const FluidSettings& settings) :
     Character("FluidCharacter"),
-    DX(1.0f),
-    DT(1.0f),
-    VISCOSITY(0.01f),
-    HEATDIFF(0.01f),
+    _settings(settings),
+    _solver(settings),
     _drawShader(),
     _vao(),
-    DRAW_TEX(1),
-    FETCH_TEX(0),
+    _stageTimer(),
+    _stageTimerFrame(0),
     _statsPanel(),
     _fps(),
-    _ups()
+    _ups(),
+    _solverTime(),
+    _solverIterations(),
+    _stageTimes(),
+    _stepAccumulator(0.0),
+    _pendingSteps(0),
+    _checkpointPending(false),
+    _exporter()
 {
 }
 
@@ -67,92 +73,6 @@ void FluidCharacter::enterStage()
     _vao.createBuffer("position", buffPos);
 
 
-    GlInputsOutputs updateLocations;
-    updateLocations.setInput(buffPos.attribLocation, "position");
-    updateLocations.setOutput(0, "FragOut");
-
-    _advectShader.setInAndOutLocations(updateLocations);
-    _advectShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _advectShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/advect.frag");
-    _advectShader.link();
-    _advectShader.pushProgram();
-    _advectShader.setInt("FragInTex", 0);
-    _advectShader.setInt("VelocityTex", 1);
-    _advectShader.setInt("FrontierTex", 2);
-    _advectShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _advectShader.setFloat("rDx", 1.0f / DX);
-    _advectShader.setFloat("Dt",  DT);
-    _advectShader.popProgram();
-
-
-    _jacobiShader.setInAndOutLocations(updateLocations);
-    _jacobiShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _jacobiShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/jacobi.frag");
-    _jacobiShader.link();
-    _jacobiShader.pushProgram();
-    _jacobiShader.setInt("XTex", 0);
-    _jacobiShader.setInt("BTex", 1);
-    _jacobiShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _jacobiShader.setFloat("Alpha", 1);
-    _jacobiShader.setFloat("rBeta", 1);
-    _jacobiShader.popProgram();
-
-    _divergenceShader.setInAndOutLocations(updateLocations);
-    _divergenceShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _divergenceShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/divergence.frag");
-    _divergenceShader.link();
-    _divergenceShader.pushProgram();
-    _divergenceShader.setInt("VelocityTex", 0);
-    _divergenceShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _divergenceShader.setFloat("HalfrDx", 0.5f / DX);
-    _divergenceShader.popProgram();
-
-
-    _gradSubShader.setInAndOutLocations(updateLocations);
-    _gradSubShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _gradSubShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/gradSub.frag");
-    _gradSubShader.link();
-    _gradSubShader.pushProgram();
-    _gradSubShader.setInt("PressureTex", 0);
-    _gradSubShader.setInt("VelocityTex", 1);
-    _gradSubShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _gradSubShader.setFloat("HalfrDx", 0.5f / DX);
-    _gradSubShader.popProgram();
-
-
-    GlInputsOutputs heatLocations;
-    heatLocations.setInput(buffPos.attribLocation, "position");
-    heatLocations.setOutput(0, "Velocity");
-    heatLocations.setOutput(1, "Heat");
-    _heatShader.setInAndOutLocations(heatLocations);
-    _heatShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _heatShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/heat.frag");
-    _heatShader.link();
-    _heatShader.pushProgram();
-    _heatShader.setInt("VelocityTex", 0);
-    _heatShader.setInt("HeatTex", 1);
-    _heatShader.setVec2f("MousePos", -glm::vec2(WIDTH, HEIGHT));
-    _heatShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _heatShader.setFloat("HalfrDx", 0.5f / DX);
-    _heatShader.popProgram();
-
-
-    GlInputsOutputs frontierLocations;
-    frontierLocations.setInput(buffPos.attribLocation, "position");
-    frontierLocations.setOutput(0, "Velocity");
-    frontierLocations.setOutput(1, "Pressure");
-    _frontierShader.setInAndOutLocations(frontierLocations);
-    _frontierShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
-    _frontierShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/frontier.frag");
-    _frontierShader.link();
-    _frontierShader.pushProgram();
-    _frontierShader.setInt("VelocityTex", 0);
-    _frontierShader.setInt("PressureTex", 1);
-    _frontierShader.setInt("FrontierTex", 2);
-    _frontierShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
-    _frontierShader.popProgram();
-
-
     GlInputsOutputs drawLocations;
     drawLocations.setInput(buffPos.attribLocation, "position");
     drawLocations.setOutput(0, "FragColor");
@@ -166,6 +86,31 @@ void FluidCharacter::enterStage()
     _drawShader.setInt("PressureTex", 2);
     _drawShader.setInt("HeatTex",     3);
     _drawShader.popProgram();
+
+    typedef chrono::high_resolution_clock clock;
+    clock::time_point initStart = clock::now();
+    _solver.initialize();
+    _solver.finish();
+    cout << "Fluid solver started in " << chrono::duration<double, milli>(
+                clock::now() - initStart).count() << " ms" << endl;
+
+    // Restarts go back to the restored state as well
+    if(!_settings.restoreFile.empty())
+    {
+        FluidCheckpoint checkpoint;
+        if(checkpoint.load(_settings.restoreFile) &&
+           !_solver.restoreCheckpoint(checkpoint))
+        {
+            cerr << "Checkpoint grid size doesn't match: "
+                 << _settings.restoreFile << endl;
+        }
+    }
+    _checkpointPending = false;
+    _stepAccumulator = 0.0;
+    _pendingSteps = 0;
+
+    if(_settings.exportFrames)
+        startExport();
     // End GL resources
 
 
@@ -190,180 +135,64 @@ void FluidCharacter::enterStage()
     _ups->setHandlePosition(_statsPanel->handlePosition() + glm::dvec2(50, 9));
     _ups->setHorizontalAnchor(_statsPanel->horizontalAnchor());
     _ups->setVerticalAnchor(_statsPanel->verticalAnchor());
-    // End Stats Panel
-
 
-    // OpenGL states
-    glClearColor(0.2, 0.2, 0.2, 1.0);
-    glGenTextures(2, _dyeTex);
-    glGenTextures(2, _velocityTex);
-    glGenTextures(2, _pressureTex);
-    glGenTextures(2, _heatTex);
-    glGenTextures(1, &_frontierTex);
-    glGenTextures(1, &_tempDivTex);
-
-    typedef float texComp_t;
-    typedef glm::tvec4<texComp_t> texVec_t;
-    vector<texVec_t> dyeImg(AREA);
-    vector<texVec_t> velocityImg(AREA);
-    vector<texVec_t> pressureImg(AREA);
-    vector<texVec_t> heatImg(AREA);
-    vector<texVec_t> frontierImg(AREA);
-    for(int i=0; i<AREA; ++i)
+    _solverTime = play().propTeam2D()->createTextHud();
+    _solverTime->setColor(glm::vec4(1.0, 1.0, 1.0, 1.0));
+    _solverTime->setHeight(16);
+    _solverTime->setHandlePosition(_statsPanel->handlePosition() + glm::dvec2(0, -20));
+    _solverTime->setHorizontalAnchor(_statsPanel->horizontalAnchor());
+    _solverTime->setVerticalAnchor(_statsPanel->verticalAnchor());
+
+    _solverIterations = play().propTeam2D()->createTextHud();
+    _solverIterations->setColor(_solverTime->color());
+    _solverIterations->setHeight(16);
+    _solverIterations->setHandlePosition(_solverTime->handlePosition() + glm::dvec2(0, -20));
+    _solverIterations->setHorizontalAnchor(_statsPanel->horizontalAnchor());
+    _solverIterations->setVerticalAnchor(_statsPanel->verticalAnchor());
+
+    for(int s=0; s < IFluidSolver::NB_STAGES; ++s)
     {
-        float s = (i%WIDTH)/(float)WIDTH;
-        float t = (i/WIDTH)/(float)HEIGHT;
-        dyeImg[i]      = initDye(s, t);
-        velocityImg[i] = initVelocity(s, t);
-        pressureImg[i] = initPressure(s, t);
-        heatImg[i]     = initHeat(s, t);
-        frontierImg[i] = initFrontier(s, t);
+        shared_ptr<TextHud> stageTime = play().propTeam2D()->createTextHud();
+        stageTime->setColor(_solverTime->color());
+        stageTime->setHeight(14);
+        stageTime->setHandlePosition(_solverIterations->handlePosition() +
+                                     glm::dvec2(0, -20 - 16 * s));
+        stageTime->setHorizontalAnchor(_statsPanel->horizontalAnchor());
+        stageTime->setVerticalAnchor(_statsPanel->verticalAnchor());
+        _stageTimes.push_back(stageTime);
     }
+    // End Stats Panel
 
-    initTexture(_dyeTex[0],      dyeImg);
-    initTexture(_dyeTex[1],      dyeImg);
-    initTexture(_velocityTex[0], velocityImg);
-    initTexture(_velocityTex[1], velocityImg);
-    initTexture(_pressureTex[0], pressureImg);
-    initTexture(_pressureTex[1], pressureImg);
-    initTexture(_heatTex[0],     heatImg);
-    initTexture(_heatTex[1],     heatImg);
-    initTexture(_frontierTex,    frontierImg);
-    initTexture(_tempDivTex,     vector<texVec_t>(AREA));
-
-    _dyeAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT0;
-    _dyeAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT1;
-    _velocityAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT2;
-    _velocityAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT3;
-    _pressureAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT4;
-    _pressureAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT5;
-    _heatAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT6;
-    _heatAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT7;
-
-
-    glGenFramebuffers(1, &_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _dyeAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _dyeTex[DRAW_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _dyeAtt[FETCH_TEX],
-                           GL_TEXTURE_2D,  _dyeTex[FETCH_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _velocityAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _velocityTex[DRAW_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _velocityAtt[FETCH_TEX],
-                           GL_TEXTURE_2D,  _velocityTex[FETCH_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _pressureAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _pressureTex[DRAW_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _pressureAtt[FETCH_TEX],
-                           GL_TEXTURE_2D,  _pressureTex[FETCH_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _heatTex[DRAW_TEX], 0);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[FETCH_TEX],
-                           GL_TEXTURE_2D,  _heatTex[FETCH_TEX], 0);
 
+    // OpenGL states
+    glClearColor(0.2, 0.2, 0.2, 1.0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    const int NB_TIMED_FRAMES = 120;
+    vector<string> stageNames(IFluidSolver::STAGE_NAMES,
+                              IFluidSolver::STAGE_NAMES + IFluidSolver::NB_STAGES);
+    // Each step is timed, a draw can run all the pending ones before the
+    // GPU gets to the first of them
+    _stageTimer.initialize(stageNames, NB_TIMED_FRAMES, MAX_PENDING_STEPS + 1);
+    if(!_settings.stageCsvFile.empty())
+        _stageTimer.openCsv(_settings.stageCsvFile);
+    _stageTimerFrame = 0;
     // End OpenGL states
 
 
     play().view()->camera2D()->registerObserver(*this);
 }
 
-glm::vec4 FluidCharacter::initDye(float s, float t)
-{
-    float zoom = 4.0f;
-    float dye = SimplexNoise::noise2d(s*zoom, t*zoom);
-    return glm::vec4(dye, dye, dye, 1.0);
-}
-
-glm::vec4 FluidCharacter::initVelocity(float s, float t)
-{
-    /* Swirl
-    const float cx = 0.5f, cy = 0.5f;
-    const float ed = 0.35f;
-    float dist = glm::vec2(s, t).distanceTo(cx, cy);
-    if(dist < ed)
-        return glm::vec4(t-cx, -(s-cy), 0, 0) * 3.0 + glm::vec4(1.0, 1.0, 0, 0) * 1.0;
-    return glm::vec4();
-    //*/
-
-    /* Plank
-    if(cellar::inRange(s, 0.3f, 0.5f) &&
-       cellar::inRange(t, 0.2f, 0.40f))
-    {
-        return glm::vec4(0.0, 1.0, 0.0, 0.0) * (0.1-glm::abs(t-0.3f))*10.0;
-    }
-    if(cellar::inRange(s, 0.5f, 0.7f) &&
-       cellar::inRange(t, 0.6f, 0.8f))
-    {
-        return glm::vec4(0.0, -1.0, 0.0, 0.0) * (0.1-glm::abs(t-0.7f))*10.0;
-    }
-    return glm::vec4();
-    //*/
-
-    return glm::vec4();
-}
-
-glm::vec4 FluidCharacter::initPressure(float s, float t)
-{
-    return glm::vec4();
-}
-
-glm::vec4 FluidCharacter::initHeat(float s, float t)
-{
-    if(glm::length(glm::vec2(s, t) - glm::vec2(0.2, 0.8))< 0.08)
-        return glm::vec4(-5, 0, 0, 0);
-    if(glm::length(glm::vec2(s, t) - glm::vec2(0.5, 0.2)) < 0.08)
-        return glm::vec4(5, 0, 0, 0);
-    return glm::vec4();
-}
-
-glm::vec4 FluidCharacter::initFrontier(float s, float t)
+void FluidCharacter::beginStep(const scaena::StageTime &time)
 {
-    const glm::vec4 block(1.0, 1.0, 1.0, 1.0);
-    const glm::vec4 fluid(0.0, 0.0, 0.0, 0.0);
-
-    const float W = 0.03;
-    if(s < W || s > 1-W || t < W || t > 1-W)
-        return block;
-
-    if((t > 0.45 && t < 0.52) && (
-        (s < 0.22f || s > 0.24f) &&
-        (s < 0.50f || s > 0.53f) &&
-        (s < 0.78f || s > 0.80f)))
-        return block;
-/*
-    if(glm::vec2(s, t).distanceTo(0.75, 0.66) < 0.2)
-        return block;
-
-    if(glm::vec2(s, t).distanceTo(0.3, 0.2) < 0.03)
-        return block;
-*/
-    return fluid;
-}
+    if(_settings.schedule != EFluidSchedule::FIXED_STEP)
+        return;
 
-template<typename T>
-void FluidCharacter::initTexture(unsigned int texId, const T& img)
-{
-    glBindTexture(GL_TEXTURE_2D, texId);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0,
-                 GL_RGBA, GL_FLOAT, img.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
+    _stepAccumulator += time.elapsedTime();
+    int nbSteps = int(_stepAccumulator * _settings.stepRate);
+    _stepAccumulator -= nbSteps / double(_settings.stepRate);
 
-void FluidCharacter::beginStep(const scaena::StageTime &time)
-{
+    // Steps over the cap are dropped, the simulation slows down instead
+    _pendingSteps = glm::min(_pendingSteps + nbSteps, MAX_PENDING_STEPS);
 }
 
 void FluidCharacter::endStep(const scaena::StageTime &time)
@@ -376,220 +205,50 @@ void FluidCharacter::draw(const std::shared_ptr<scaena::View> &,
 {
     _fps->setText(toString(time.framesPerSecond()));
 
-    _vao.bind();
     glDisable(GL_DEPTH_TEST);
 
-    glViewport(0, 0, WIDTH, HEIGHT);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
-    advect();
-    diffuse();
-    heat();
-    computePressure();
-    substractPressureGradient();
-    frontier();
-
-    glm::ivec2 viewport = play().view()->viewport();
-    glViewport(0, 0, viewport.x, viewport.y);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    drawFluid();
-
-    glEnable(GL_DEPTH_TEST);
-    _vao.unbind();
-
-    //exit(0);
-}
-
-void FluidCharacter::advect()
-{
-    _advectShader.pushProgram();
-
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, _frontierTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-    glActiveTexture(GL_TEXTURE0);
-
-    // Dye
-    glBindTexture(GL_TEXTURE_2D, _dyeTex[FETCH_TEX]);
-    glDrawBuffer(_dyeAtt[DRAW_TEX]);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    swap(_dyeTex[FETCH_TEX], _dyeTex[DRAW_TEX]);
-    swap(_dyeAtt[FETCH_TEX], _dyeAtt[DRAW_TEX]);
-
-    // Heat
-    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
-    glDrawBuffer(_heatAtt[DRAW_TEX]);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    swap(_heatTex[FETCH_TEX], _heatTex[DRAW_TEX]);
-    swap(_heatAtt[FETCH_TEX], _heatAtt[DRAW_TEX]);
-
-    // Velocity
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-    glDrawBuffer(_velocityAtt[DRAW_TEX]);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
-    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
-
-    _advectShader.popProgram();
-}
-
-void FluidCharacter::diffuse()
-{
-    const int NB_ITERATIONS = 60;
-
-    _jacobiShader.pushProgram();
-
-    // Velocity
-    _jacobiShader.setFloat("Alpha", DX*DX / (VISCOSITY*DT));
-    _jacobiShader.setFloat("rBeta", 1.0f / (4.0f + DX*DX/(VISCOSITY*DT)) );
-
-    for(int i=0; i < (NB_ITERATIONS/2)*2; ++i)
+    // Update ticks own the solver's pace in fixed step mode
+    int nbSteps = 1;
+    if(_settings.schedule == EFluidSchedule::FIXED_STEP)
     {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-
-        glDrawBuffer(_velocityAtt[DRAW_TEX]);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-        // Swap textures
-        swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
-        swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
+        nbSteps = _pendingSteps;
+        _pendingSteps = 0;
     }
 
-    // Heat
-    _jacobiShader.setFloat("Alpha", DX*DX / (HEATDIFF*DT));
-    _jacobiShader.setFloat("rBeta", 1.0f / (4.0f + DX*DX/(HEATDIFF*DT)) );
-    for(int i=0; i < (NB_ITERATIONS/2)*2; ++i)
-    {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
-
-        glDrawBuffer(_heatAtt[DRAW_TEX]);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    for(int i=0; i < nbSteps; ++i)
+        stepSolver();
+    updateSolverIterations();
+    updateCheckpoint();
 
-        // Swap textures
-        swap(_heatTex[FETCH_TEX], _heatTex[DRAW_TEX]);
-        swap(_heatAtt[FETCH_TEX], _heatAtt[DRAW_TEX]);
+    if(!_settings.simulateOnly)
+    {
+        glm::ivec2 viewport = play().view()->viewport();
+        glViewport(0, 0, viewport.x, viewport.y);
+        _vao.bind();
+        drawFluid();
+        _vao.unbind();
     }
 
-
-    _jacobiShader.popProgram();
-}
-
-void FluidCharacter::heat()
-{
-    const GLenum drawBuffers [] = {
-        _velocityAtt[DRAW_TEX],
-        _heatAtt[DRAW_TEX],
-    };
-
-    _heatShader.pushProgram();
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-
-    glDrawBuffers(2, drawBuffers);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-    swap(_heatTex[FETCH_TEX],     _heatTex[DRAW_TEX]);
-    swap(_heatAtt[FETCH_TEX],     _heatAtt[DRAW_TEX]);
-    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
-    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
-
-    _heatShader.popProgram();
+    glEnable(GL_DEPTH_TEST);
 }
 
-void FluidCharacter::computePressure()
+void FluidCharacter::stepSolver()
 {
-    _divergenceShader.pushProgram();
-
-    // Manque de color attachement oblige...
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _tempDivTex, 0);
-
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-    glDrawBuffer(_heatAtt[DRAW_TEX]);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-    // Et on remet comme c'etait :)
-    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[DRAW_TEX],
-                           GL_TEXTURE_2D,  _heatTex[DRAW_TEX], 0);
-
-    _divergenceShader.popProgram();
-
-
-    _jacobiShader.pushProgram();
-    _jacobiShader.setFloat("Alpha", -DX*DX);
-    _jacobiShader.setFloat("rBeta", 1.0f / 4.0f);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _tempDivTex);
-    glActiveTexture(GL_TEXTURE0);
-
-    const int NB_ITERATIONS = 60;
-    for(int i=0; i < (NB_ITERATIONS/2)*2; ++i)
+    // Same as _solver.step(), a query around each stage
+    _stageTimer.beginFrame();
+    _solver.beginStages();
+    for(int s=0; s < IFluidSolver::NB_STAGES; ++s)
     {
-        glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
-
-        glDrawBuffer(_pressureAtt[DRAW_TEX]);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-        // Swap textures
-        swap(_pressureTex[FETCH_TEX], _pressureTex[DRAW_TEX]);
-        swap(_pressureAtt[FETCH_TEX], _pressureAtt[DRAW_TEX]);
+        _stageTimer.beginStage(s);
+        (_solver.*IFluidSolver::STAGES[s])();
+        _stageTimer.endStage();
     }
+    _solver.endStages();
+    _stageTimer.endFrame();
 
-    _jacobiShader.popProgram();
-}
-
-void FluidCharacter::substractPressureGradient()
-{
-    _gradSubShader.pushProgram();
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
-
-    glDrawBuffer(_velocityAtt[DRAW_TEX]);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
-    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
-
-    _gradSubShader.popProgram();
-}
-
-void FluidCharacter::frontier()
-{
-    const GLenum drawBuffers [] = {
-        _velocityAtt[DRAW_TEX],
-        _pressureAtt[DRAW_TEX],
-    };
-
-    _frontierShader.pushProgram();
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, _frontierTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
-
-    glDrawBuffers(2, drawBuffers);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
-    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
-    swap(_pressureTex[FETCH_TEX], _pressureTex[DRAW_TEX]);
-    swap(_pressureAtt[FETCH_TEX], _pressureAtt[DRAW_TEX]);
-
-    _frontierShader.popProgram();
+    if(_exporter.isRecording())
+        _exporter.capture(_solver.fieldTexture(_exporter.field()));
+    updateSolverTime();
 }
 
 void FluidCharacter::drawFluid()
@@ -597,17 +256,15 @@ void FluidCharacter::drawFluid()
     _drawShader.pushProgram();
 
     glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
+    glBindTexture(GL_TEXTURE_2D, _solver.heatTexture());
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
+    glBindTexture(GL_TEXTURE_2D, _solver.pressureTexture());
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glBindTexture(GL_TEXTURE_2D, _solver.velocityTexture());
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _dyeTex[FETCH_TEX]);
+    glBindTexture(GL_TEXTURE_2D, _solver.dyeTexture());
 
-    glPointSize(POINT_SIZE);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glPointSize(1.0f);
 
     _drawShader.popProgram();
 }
@@ -619,6 +276,15 @@ void FluidCharacter::exitStage()
     play().propTeam2D()->deleteImageHud(_statsPanel);
     play().propTeam2D()->deleteTextHud(_fps);
     play().propTeam2D()->deleteTextHud(_ups);
+    play().propTeam2D()->deleteTextHud(_solverTime);
+    play().propTeam2D()->deleteTextHud(_solverIterations);
+    for(const shared_ptr<TextHud>& stageTime : _stageTimes)
+        play().propTeam2D()->deleteTextHud(stageTime);
+    _stageTimes.clear();
+
+    stopExport();
+    _solver.terminate();
+    _stageTimer.terminate();
 }
 
 bool FluidCharacter::keyPressEvent(const KeyboardEvent &event)
@@ -632,8 +298,90 @@ bool FluidCharacter::keyPressEvent(const KeyboardEvent &event)
     {
         _fps->setIsVisible(!_statsPanel->isVisible());
         _ups->setIsVisible(!_statsPanel->isVisible());
+        _solverTime->setIsVisible(!_statsPanel->isVisible());
+        _solverIterations->setIsVisible(!_statsPanel->isVisible());
+        for(const shared_ptr<TextHud>& stageTime : _stageTimes)
+            stageTime->setIsVisible(!_statsPanel->isVisible());
         _statsPanel->setIsVisible(!_statsPanel->isVisible());
     }
+    else if(event.getAscii() == 'P')
+    {
+        if(_solver.pressureSolver() == EPressureSolver::JACOBI)
+        {
+            _solver.setPressureSolver(EPressureSolver::MULTIGRID);
+            cout << "Pressure solver: multigrid V-cycles" << endl;
+        }
+        else
+        {
+            _solver.setPressureSolver(EPressureSolver::JACOBI);
+            cout << "Pressure solver: Jacobi" << endl;
+        }
+        return true;
+    }
+    else if(event.getAscii() == 'G')
+    {
+        if(_solver.relaxation() == ERelaxation::JACOBI)
+        {
+            _solver.setRelaxation(ERelaxation::RED_BLACK_SOR);
+            cout << "Relaxation: red-black SOR" << endl;
+        }
+        else
+        {
+            _solver.setRelaxation(ERelaxation::JACOBI);
+            cout << "Relaxation: Jacobi" << endl;
+        }
+        return true;
+    }
+    else if(event.getAscii() == 'C')
+    {
+        if(!_checkpointPending)
+        {
+            _solver.requestCheckpoint();
+            _checkpointPending = true;
+        }
+        return true;
+    }
+    else if(event.getAscii() == 'E')
+    {
+        if(_exporter.isRecording())
+            stopExport();
+        else
+            startExport();
+        return true;
+    }
+    else if(event.getAscii() == 'V')
+    {
+        // Strength given on the command line, or a moderate one
+        const float DEFAULT_VORTICITY = 0.3f;
+
+        if(_solver.vorticity() == 0.0f)
+        {
+            float vorticity = _settings.vorticity != 0.0f ?
+                              _settings.vorticity : DEFAULT_VORTICITY;
+            _solver.setVorticity(vorticity);
+            cout << "Vorticity confinement: " << vorticity << endl;
+        }
+        else
+        {
+            _solver.setVorticity(0.0f);
+            cout << "Vorticity confinement: off" << endl;
+        }
+        return true;
+    }
+    else if(event.getAscii() == 'M')
+    {
+        if(_solver.advection() == EAdvection::SEMI_LAGRANGIAN)
+        {
+            _solver.setAdvection(EAdvection::MACCORMACK);
+            cout << "Advection: MacCormack" << endl;
+        }
+        else
+        {
+            _solver.setAdvection(EAdvection::SEMI_LAGRANGIAN);
+            cout << "Advection: semi-Lagrangian" << endl;
+        }
+        return true;
+    }
 
     return false;
 }
@@ -664,13 +412,101 @@ void FluidCharacter::moveCandleTo(const glm::ivec2& position)
 {
     glm::ivec2 viewport = play().view()->viewport();
     glm::vec2 candlePos(position.x, viewport.y - position.y);
-    candlePos *= 2.0f / POINT_SIZE;
-    _heatShader.pushProgram();
-    _heatShader.setVec2f("MousePos", candlePos);
-    _heatShader.popProgram();
+    candlePos *= 2.0f * glm::vec2(_solver.gridSize()) / glm::vec2(viewport);
+    _solver.setCandlePosition(candlePos);
     cout << "(" << candlePos.x << ", " << candlePos.y << ")" << endl;
 }
 
+void FluidCharacter::updateSolverTime()
+{
+    const int NB_REFRESH_FRAMES = 30;
+
+    if(++_stageTimerFrame < NB_REFRESH_FRAMES ||
+       _stageTimer.sampleCount() == 0)
+        return;
+    _stageTimerFrame = 0;
+
+    auto toMs = [](double ms) {
+        return toString(floor(ms * 100.0) / 100.0);
+    };
+
+    GlStageTimer::StageStats frame = _stageTimer.frameStats();
+    glm::ivec2 gridSize = _solver.gridSize();
+    double cellNs = frame.avgMs * 1.0e6 / (gridSize.x * gridSize.y);
+    _solverTime->setText("Solver: " + toMs(frame.avgMs) + " ms, " +
+                         toString(floor(cellNs * 100.0) / 100.0) + " ns/cell");
+
+    // Rolling min / avg / p99 of each stage
+    for(int s=0; s < _stageTimer.stageCount(); ++s)
+    {
+        GlStageTimer::StageStats stage = _stageTimer.stageStats(s);
+        _stageTimes[s]->setText(_stageTimer.stageName(s) + ": " +
+                                toMs(stage.minMs) + " / " +
+                                toMs(stage.avgMs) + " / " +
+                                toMs(stage.p99Ms) + " ms");
+    }
+}
+
+void FluidCharacter::updateSolverIterations()
+{
+    const FluidSolveStats& stats = _solver.solveStats();
+
+    string text = "Iterations: " + toString(stats.diffuseIterations) +
+                  " diffuse, " + toString(stats.pressureIterations) +
+                  " pressure";
+
+    // Residuals are only measured when the solves have a tolerance
+    if(stats.pressureResidual >= 0.0f)
+    {
+        text += " (residual " +
+                toString(floor(stats.pressureResidual * 1.0e3) / 1.0e3) + ")";
+    }
+
+    _solverIterations->setText(text);
+}
+
+void FluidCharacter::updateCheckpoint()
+{
+    if(!_checkpointPending)
+        return;
+
+    // Polled every frame until the readback lands
+    FluidCheckpoint checkpoint;
+    if(!_solver.takeCheckpoint(checkpoint))
+        return;
+    _checkpointPending = false;
+
+    string fileName = _settings.checkpointFile.empty() ?
+                          "fluid.checkpoint" : _settings.checkpointFile;
+    if(checkpoint.save(fileName, _settings.compressCheckpoints))
+        cout << "Checkpoint saved to " << fileName << endl;
+}
+
+void FluidCharacter::startExport()
+{
+    const int EXPORT_RING_SIZE = 4;
+
+    string field = FluidFrameExporter::fieldName(_settings.exportField);
+    string fileName = _settings.exportFile.empty() ?
+                          "fluid-" + field + ".frames" : _settings.exportFile;
+
+    if(_exporter.start(fileName, _settings.exportField, _solver.gridSize(),
+                       _settings.compressExport, EXPORT_RING_SIZE))
+    {
+        cout << "Exporting " << field << " frames to " << fileName << endl;
+    }
+}
+
+void FluidCharacter::stopExport()
+{
+    if(!_exporter.isRecording())
+        return;
+
+    _exporter.stop();
+    cout << "Exported " << _exporter.writtenFrameCount() << " frames, "
+         << _exporter.droppedFrameCount() << " dropped" << endl;
+}
+
 void FluidCharacter::notify(cellar::CameraMsg &)
 {
 }
@@ -2,6 +2,7 @@
 #define FLUID_CHARACTER_H
 
 #include <memory>
+#include <vector>
 
 #include <CellarWorkbench/Camera/Camera.h>
 #include <CellarWorkbench/Camera/CameraManFree.h>
@@ -14,12 +15,17 @@
 
 #include <Scaena/Play/Character.h>
 
+#include "FluidFrameExporter.h"
+#include "FluidSettings.h"
+#include "GlFluidSolver.h"
+#include "GlStageTimer.h"
+
 
 class FluidCharacter : public scaena::Character,
                        public cellar::SpecificObserver<cellar::CameraMsg>
 {
 public:
-    FluidCharacter();
+    FluidCharacter(const FluidSettings& settings);
     virtual ~FluidCharacter();
 
     virtual void enterStage() override;
@@ -35,71 +41,46 @@ public:
 
     virtual void notify(cellar::CameraMsg &msg) override;
 
-    static const int WIDTH;
-    static const int HEIGHT;
-    static const int AREA;
-    static const int POINT_SIZE;
-
 
 protected:
-    glm::vec4 initDye(float s, float t);
-    glm::vec4 initVelocity(float s, float t);
-    glm::vec4 initPressure(float s, float t);
-    glm::vec4 initHeat(float s, float t);
-    glm::vec4 initFrontier(float s, float t);
-
-    template<typename T>
-    void initTexture(unsigned int texId, const T& img);
-
-    void advect();
-    void diffuse();
-    void heat();
-    void computePressure();
-    void substractPressureGradient();
-    void frontier();
+    void stepSolver();
     void drawFluid();
 
     void moveCandleTo(const glm::ivec2& position);
+    void updateSolverTime();
+    void updateSolverIterations();
+    void updateCheckpoint();
+    void startExport();
+    void stopExport();
 
 
 private:
-    // Size
-    const float DX;
-    const float DT;
-    const float VISCOSITY;
-    const float HEATDIFF;
-
-    // Fluid simulation GL specific attributes
-    cellar::GlProgram _advectShader;
-    cellar::GlProgram _heatShader;
-    cellar::GlProgram _jacobiShader;
-    cellar::GlProgram _divergenceShader;
-    cellar::GlProgram _gradSubShader;
-    cellar::GlProgram _frontierShader;
+    FluidSettings _settings;
+    GlFluidSolver _solver;
     cellar::GlProgram _drawShader;
     cellar::GlVao _vao;
 
-    const int DRAW_TEX;
-    const int FETCH_TEX;
-
-    unsigned int _dyeTex[2];
-    unsigned int _velocityTex[2];
-    unsigned int _pressureTex[2];
-    unsigned int _heatTex[2];
-    unsigned int _frontierTex;
-    unsigned int _tempDivTex;
-
-    GLenum _dyeAtt[2];
-    GLenum _velocityAtt[2];
-    GLenum _pressureAtt[2];
-    GLenum _heatAtt[2];
-
-    unsigned int _fbo;
+    // Solver GPU time per stage, shown every few frames
+    GlStageTimer _stageTimer;
+    int _stageTimerFrame;
 
     // Stats panel (FPS, UPS)
     std::shared_ptr<prop2::ImageHud> _statsPanel;
     std::shared_ptr<prop2::TextHud> _fps;
     std::shared_ptr<prop2::TextHud> _ups;
+    std::shared_ptr<prop2::TextHud> _solverTime;
+    std::shared_ptr<prop2::TextHud> _solverIterations;
+    std::vector<std::shared_ptr<prop2::TextHud>> _stageTimes;
+
+    // Simulated time not run yet and the steps it is worth, capped so
+    // that a slow frame doesn't snowball into slower ones
+    double _stepAccumulator;
+    int _pendingSteps;
+
+    // Requested by the 'C' key, saved once the readback is done
+    bool _checkpointPending;
+
+    FluidFrameExporter _exporter;
 };
 
 #endif // FLUID_CHARACTER_H
@@ -0,0 +1,328 @@
+#include "FluidCheckpoint.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <QByteArray>
+
+using namespace std;
+
+
+// File layout, native little endian:
+//   header  "FLCP", uint32 version, int32 width, height, float candle x, y
+//   chunks  char[4] field tag, uint32 channels, first row, row count,
+//           encoding, payload bytes, then the payload
+//   end     "END " tag alone
+// Readers skip the chunks whose tag they don't know.
+namespace
+{
+    const char MAGIC[4] = {'F', 'L', 'C', 'P'};
+    const char END_TAG[4] = {'E', 'N', 'D', ' '};
+    const char FIELD_TAGS[FluidCheckpoint::NB_FIELDS][4] = {
+        {'D', 'Y', 'E', ' '},
+        {'V', 'E', 'L', 'O'},
+        {'P', 'R', 'E', 'S'},
+        {'H', 'E', 'A', 'T'},
+        {'F', 'R', 'N', 'T'}
+    };
+    const uint32_t VERSION = 1;
+    const int ROWS_PER_CHUNK = 64;
+
+    enum EEncoding : uint32_t
+    {
+        RAW = 0,
+        ZLIB = 1 // qCompress() format
+    };
+
+    struct ChunkHeader
+    {
+        char tag[4];
+        uint32_t nbChannels;
+        uint32_t firstRow;
+        uint32_t nbRows;
+        uint32_t encoding;
+        uint32_t payloadSize;
+    };
+
+    template<typename T>
+    void writeValue(ostream& stream, const T& value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool readValue(istream& stream, T& value)
+    {
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return bool(stream);
+    }
+}
+
+const EFluidField FluidCheckpoint::FIELDS[FluidCheckpoint::NB_FIELDS] = {
+    EFluidField::DYE,
+    EFluidField::VELOCITY,
+    EFluidField::PRESSURE,
+    EFluidField::HEAT,
+    EFluidField::FRONTIER
+};
+
+
+FluidCheckpoint::FluidCheckpoint() :
+    gridSize(0, 0),
+    candlePosition(0, 0)
+{
+}
+
+FluidCheckpoint::~FluidCheckpoint()
+{
+}
+
+void FluidCheckpoint::reset(const glm::ivec2& size)
+{
+    gridSize = size;
+    for(int f=0; f < NB_FIELDS; ++f)
+        _fields[f].assign(size.x * size.y * channelCount(FIELDS[f]), 0.0f);
+}
+
+int FluidCheckpoint::channelCount(EFluidField field)
+{
+    switch(field)
+    {
+    case EFluidField::DYE :      return 4;
+    case EFluidField::VELOCITY : return 2;
+    default :                    return 1;
+    }
+}
+
+int FluidCheckpoint::fieldIndex(EFluidField field)
+{
+    for(int f=0; f < NB_FIELDS; ++f)
+    {
+        if(FIELDS[f] == field)
+            return f;
+    }
+    return -1;
+}
+
+std::vector<float>& FluidCheckpoint::field(EFluidField field)
+{
+    return _fields[fieldIndex(field)];
+}
+
+const std::vector<float>& FluidCheckpoint::field(EFluidField field) const
+{
+    return _fields[fieldIndex(field)];
+}
+
+void FluidCheckpoint::setFieldTexels(EFluidField f,
+                                     const std::vector<glm::vec4>& texels)
+{
+    int nbChannels = channelCount(f);
+    vector<float>& data = field(f);
+    data.resize(texels.size() * nbChannels);
+    for(size_t i=0; i < texels.size(); ++i)
+    {
+        for(int c=0; c < nbChannels; ++c)
+            data[i*nbChannels + c] = texels[i][c];
+    }
+}
+
+glm::vec4 FluidCheckpoint::fieldTexel(EFluidField f, int x, int y) const
+{
+    int nbChannels = channelCount(f);
+    const float* cell = &field(f)[(y*gridSize.x + x) * nbChannels];
+
+    glm::vec4 texel(0.0f);
+    for(int c=0; c < nbChannels; ++c)
+        texel[c] = cell[c];
+    return texel;
+}
+
+bool FluidCheckpoint::save(const std::string& fileName, bool compress) const
+{
+    ofstream stream(fileName, ios::binary | ios::trunc);
+    if(!stream)
+    {
+        cerr << "Could not open checkpoint file for writing: "
+             << fileName << endl;
+        return false;
+    }
+
+    stream.write(MAGIC, 4);
+    writeValue(stream, VERSION);
+    writeValue(stream, int32_t(gridSize.x));
+    writeValue(stream, int32_t(gridSize.y));
+    writeValue(stream, candlePosition.x);
+    writeValue(stream, candlePosition.y);
+
+    for(int f=0; f < NB_FIELDS; ++f)
+    {
+        int nbChannels = channelCount(FIELDS[f]);
+        int rowSize = gridSize.x * nbChannels * sizeof(float);
+
+        for(int y=0; y < gridSize.y; y += ROWS_PER_CHUNK)
+        {
+            ChunkHeader header;
+            memcpy(header.tag, FIELD_TAGS[f], 4);
+            header.nbChannels = nbChannels;
+            header.firstRow = y;
+            header.nbRows = glm::min(ROWS_PER_CHUNK, gridSize.y - y);
+            header.encoding = RAW;
+            header.payloadSize = header.nbRows * rowSize;
+
+            const char* payload = reinterpret_cast<const char*>(
+                &_fields[f][y * gridSize.x * nbChannels]);
+
+            QByteArray compressed;
+            if(compress)
+            {
+                compressed = qCompress(
+                    reinterpret_cast<const uchar*>(payload),
+                    header.payloadSize);
+
+                // Noisy rows may not shrink, keep them raw then
+                if(uint32_t(compressed.size()) < header.payloadSize)
+                {
+                    header.encoding = ZLIB;
+                    header.payloadSize = compressed.size();
+                    payload = compressed.constData();
+                }
+            }
+
+            writeValue(stream, header);
+            stream.write(payload, header.payloadSize);
+        }
+    }
+
+    stream.write(END_TAG, 4);
+
+    if(!stream)
+    {
+        cerr << "Could not write checkpoint file: " << fileName << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool FluidCheckpoint::load(const std::string& fileName)
+{
+    ifstream stream(fileName, ios::binary);
+    if(!stream)
+    {
+        cerr << "Could not open checkpoint file: " << fileName << endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    int32_t width = 0, height = 0;
+    stream.read(magic, 4);
+    if(!stream || memcmp(magic, MAGIC, 4) != 0 ||
+       !readValue(stream, version) || version != VERSION)
+    {
+        cerr << "Not a fluid checkpoint of version " << VERSION << ": "
+             << fileName << endl;
+        return false;
+    }
+
+    if(!readValue(stream, width) || !readValue(stream, height) ||
+       !readValue(stream, candlePosition.x) ||
+       !readValue(stream, candlePosition.y) ||
+       width <= 0 || height <= 0 ||
+       width > FluidSettings::MAX_GRID_SIZE ||
+       height > FluidSettings::MAX_GRID_SIZE)
+    {
+        cerr << "Corrupted fluid checkpoint header: " << fileName << endl;
+        return false;
+    }
+
+    reset(glm::ivec2(width, height));
+
+    while(true)
+    {
+        ChunkHeader header;
+        stream.read(header.tag, 4);
+        if(!stream)
+            break;
+
+        if(memcmp(header.tag, END_TAG, 4) == 0)
+            return true;
+
+        if(!readValue(stream, header.nbChannels) ||
+           !readValue(stream, header.firstRow) ||
+           !readValue(stream, header.nbRows) ||
+           !readValue(stream, header.encoding) ||
+           !readValue(stream, header.payloadSize))
+            break;
+
+        int f = 0;
+        while(f < NB_FIELDS && memcmp(header.tag, FIELD_TAGS[f], 4) != 0)
+            ++f;
+        if(f == NB_FIELDS)
+        {
+            stream.seekg(header.payloadSize, ios::cur);
+            if(!stream)
+                break;
+            continue;
+        }
+
+        // Everything is checked before the payload is allocated, the sizes
+        // come from the file
+        int nbChannels = channelCount(FIELDS[f]);
+        size_t rowSize = size_t(width) * nbChannels * sizeof(float);
+        if(header.nbChannels != uint32_t(nbChannels) ||
+           header.nbRows > uint32_t(height) ||
+           header.firstRow > uint32_t(height) - header.nbRows)
+            break;
+
+        // zlib grows incompressible data by a few bytes per kilobyte,
+        // qCompress() prepends the uncompressed size
+        size_t dataSize = header.nbRows * rowSize;
+        if(header.encoding == RAW)
+        {
+            if(header.payloadSize != dataSize)
+                break;
+        }
+        else if(header.encoding == ZLIB)
+        {
+            if(header.payloadSize < 4 ||
+               header.payloadSize > dataSize + dataSize / 1000 + 64)
+                break;
+        }
+        else
+        {
+            break;
+        }
+
+        QByteArray payload(int(header.payloadSize), Qt::Uninitialized);
+        stream.read(payload.data(), header.payloadSize);
+        if(!stream)
+            break;
+
+        if(header.encoding == ZLIB)
+        {
+            // qUncompress() allocates whatever size the prefix announces
+            const uchar* prefix =
+                reinterpret_cast<const uchar*>(payload.constData());
+            uint32_t announced = (uint32_t(prefix[0]) << 24) |
+                                 (uint32_t(prefix[1]) << 16) |
+                                 (uint32_t(prefix[2]) << 8) |
+                                  uint32_t(prefix[3]);
+            if(announced != dataSize)
+                break;
+            payload = qUncompress(payload);
+        }
+
+        if(size_t(payload.size()) != dataSize)
+            break;
+
+        memcpy(&_fields[f][size_t(header.firstRow) * width * nbChannels],
+               payload.constData(), payload.size());
+    }
+
+    cerr << "Corrupted or truncated fluid checkpoint: " << fileName << endl;
+    return false;
+}
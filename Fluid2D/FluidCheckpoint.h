@@ -0,0 +1,52 @@
+#ifndef FLUID_CHECKPOINT_H
+#define FLUID_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include "IFluidSolver.h"
+
+
+// Simulation state saved by the solvers, streamed to disk in chunks of rows
+// that may each be compressed
+class FluidCheckpoint
+{
+public:
+    // Fields of a state, the frontier is saved along with the fluid
+    static const int NB_FIELDS = 5;
+    static const EFluidField FIELDS[NB_FIELDS];
+
+    FluidCheckpoint();
+    virtual ~FluidCheckpoint();
+
+    // Grid size is that of the solver the state comes from
+    void reset(const glm::ivec2& gridSize);
+
+    // Channels in use by each field
+    static int channelCount(EFluidField field);
+    static int fieldIndex(EFluidField field);
+
+    // Row major, channelCount() interleaved floats per cell
+    std::vector<float>& field(EFluidField field);
+    const std::vector<float>& field(EFluidField field) const;
+
+    // Same layout as IFluidSolver::fieldData()
+    void setFieldTexels(EFluidField field, const std::vector<glm::vec4>& texels);
+    glm::vec4 fieldTexel(EFluidField field, int x, int y) const;
+
+    // Both return false and leave a message on cerr when the file can't
+    // be written or read
+    bool save(const std::string& fileName, bool compress) const;
+    bool load(const std::string& fileName);
+
+    glm::ivec2 gridSize;
+    glm::vec2 candlePosition;
+
+
+private:
+    std::vector<float> _fields[NB_FIELDS];
+};
+
+#endif // FLUID_CHECKPOINT_H
@@ -0,0 +1,282 @@
+#include "FluidFrameExporter.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <QByteArray>
+
+#include "FluidCheckpoint.h"
+
+using namespace std;
+
+
+// File layout, native little endian:
+//   header  "FLSQ", uint32 version, int32 width, height, uint32 channels,
+//           char[8] field name padded with zeros
+//   frames  int32 frame index, uint32 encoding, payload bytes, then the
+//           payload of width * height * channels floats, row major
+// Dropped frames leave gaps in the indices.
+namespace
+{
+    const char MAGIC[4] = {'F', 'L', 'S', 'Q'};
+    const uint32_t VERSION = 1;
+
+    enum EEncoding : uint32_t
+    {
+        RAW = 0,
+        ZLIB = 1 // qCompress() format
+    };
+
+    template<typename T>
+    void writeValue(ostream& stream, const T& value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+}
+
+
+FluidFrameExporter::FluidFrameExporter() :
+    _field(EFluidField::DYE),
+    _compress(false),
+    _recording(false),
+    _stream(),
+    _slots(),
+    _ringSize(0),
+    _nextSlot(0),
+    _frame(0),
+    _nbDropped(0),
+    _nbWritten(0),
+    _worker(),
+    _mutex(),
+    _frameReady(),
+    _queue(),
+    _stopping(false)
+{
+}
+
+FluidFrameExporter::~FluidFrameExporter()
+{
+    // Buffers can't be unmapped without the GL context, the worker can
+    // still be joined
+    if(_worker.joinable())
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _frameReady.notify_all();
+        _worker.join();
+    }
+}
+
+bool FluidFrameExporter::start(const std::string& fileName, EFluidField field,
+                               const glm::ivec2& size, bool compress,
+                               int ringSize)
+{
+    if(_recording)
+        stop();
+
+    _stream.open(fileName, ios::binary | ios::trunc);
+    if(!_stream)
+    {
+        cerr << "Could not open export file for writing: "
+             << fileName << endl;
+        return false;
+    }
+
+    int nbChannels = FluidCheckpoint::channelCount(field);
+    char name[8] = {0};
+    strncpy(name, fieldName(field).c_str(), sizeof(name));
+
+    _stream.write(MAGIC, 4);
+    writeValue(_stream, VERSION);
+    writeValue(_stream, int32_t(size.x));
+    writeValue(_stream, int32_t(size.y));
+    writeValue(_stream, uint32_t(nbChannels));
+    _stream.write(name, sizeof(name));
+
+    _field = field;
+    _compress = compress;
+    _ringSize = glm::max(2, ringSize);
+    _slots.reset(new Slot[_ringSize]);
+    for(int i=0; i < _ringSize; ++i)
+    {
+        _slots[i].readback.initialize(size, nbChannels);
+        _slots[i].state = ESlotState::FREE;
+        _slots[i].frame = 0;
+        _slots[i].pixels = nullptr;
+    }
+
+    _nextSlot = 0;
+    _frame = 0;
+    _nbDropped = 0;
+    _nbWritten = 0;
+    _stopping = false;
+    _worker = thread(&FluidFrameExporter::workerLoop, this);
+    _recording = true;
+
+    return true;
+}
+
+void FluidFrameExporter::stop()
+{
+    if(!_recording)
+        return;
+
+    // Hand every pending frame to the worker and let it drain the queue
+    collect(true);
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _frameReady.notify_all();
+    _worker.join();
+
+    collect(false);
+    for(int i=0; i < _ringSize; ++i)
+        _slots[i].readback.terminate();
+    _slots.reset();
+    _stream.close();
+
+    _recording = false;
+}
+
+bool FluidFrameExporter::isRecording() const
+{
+    return _recording;
+}
+
+EFluidField FluidFrameExporter::field() const
+{
+    return _field;
+}
+
+void FluidFrameExporter::capture(unsigned int texId)
+{
+    collect(false);
+
+    // The next slot in the ring holds the oldest frame
+    Slot& slot = _slots[_nextSlot];
+    if(slot.state != ESlotState::FREE)
+    {
+        ++_nbDropped;
+        ++_frame;
+        return;
+    }
+
+    slot.readback.start(texId);
+    slot.frame = _frame++;
+    slot.state = ESlotState::COPYING;
+    _nextSlot = (_nextSlot + 1) % _ringSize;
+}
+
+int FluidFrameExporter::writtenFrameCount() const
+{
+    return _nbWritten;
+}
+
+int FluidFrameExporter::droppedFrameCount() const
+{
+    return _nbDropped;
+}
+
+std::string FluidFrameExporter::fieldName(EFluidField field)
+{
+    switch(field)
+    {
+    case EFluidField::DYE :        return "dye";
+    case EFluidField::VELOCITY :   return "velocity";
+    case EFluidField::PRESSURE :   return "pressure";
+    case EFluidField::HEAT :       return "heat";
+    case EFluidField::DIVERGENCE : return "div";
+    case EFluidField::FRONTIER :   return "frontier";
+    }
+    return "";
+}
+
+void FluidFrameExporter::collect(bool wait)
+{
+    // Oldest first, so that frames reach the worker in order
+    for(int i=0; i < _ringSize; ++i)
+    {
+        Slot& slot = _slots[(_nextSlot + i) % _ringSize];
+
+        if(slot.state == ESlotState::WRITTEN)
+        {
+            slot.readback.unmap();
+            slot.pixels = nullptr;
+            slot.state = ESlotState::FREE;
+        }
+        else if(slot.state == ESlotState::COPYING)
+        {
+            // Fences signal in order, younger copies aren't done either
+            if(!slot.readback.isDone(wait))
+                break;
+
+            slot.pixels = slot.readback.map();
+            slot.state = ESlotState::MAPPED;
+            {
+                lock_guard<mutex> lock(_mutex);
+                _queue.push_back(&slot);
+            }
+            _frameReady.notify_one();
+        }
+    }
+}
+
+void FluidFrameExporter::workerLoop()
+{
+    while(true)
+    {
+        Slot* slot = nullptr;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _frameReady.wait(lock, [this]() {
+                return _stopping || !_queue.empty();
+            });
+
+            if(_queue.empty())
+                return;
+
+            slot = _queue.front();
+            _queue.pop_front();
+        }
+
+        writeFrame(*slot);
+        slot->state = ESlotState::WRITTEN;
+    }
+}
+
+void FluidFrameExporter::writeFrame(Slot& slot)
+{
+    glm::ivec2 size = slot.readback.size();
+    uint32_t payloadSize = size.x * size.y *
+                           slot.readback.channelCount() * sizeof(float);
+    uint32_t encoding = RAW;
+    const char* payload = reinterpret_cast<const char*>(slot.pixels);
+
+    // A failed map leaves a gap in the sequence
+    if(payload == nullptr)
+        return;
+
+    QByteArray compressed;
+    if(_compress)
+    {
+        compressed = qCompress(reinterpret_cast<const uchar*>(payload),
+                               payloadSize);
+        if(uint32_t(compressed.size()) < payloadSize)
+        {
+            encoding = ZLIB;
+            payloadSize = compressed.size();
+            payload = compressed.constData();
+        }
+    }
+
+    writeValue(_stream, int32_t(slot.frame));
+    writeValue(_stream, encoding);
+    writeValue(_stream, payloadSize);
+    _stream.write(payload, payloadSize);
+
+    ++_nbWritten;
+}
@@ -0,0 +1,87 @@
+#ifndef FLUID_FRAME_EXPORTER_H
+#define FLUID_FRAME_EXPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "GlAsyncReadback.h"
+#include "IFluidSolver.h"
+
+
+// Records a field of every frame to a file through a ring of pixel buffers.
+// The GL thread only queues copies and maps the buffers that are done, a
+// worker compresses and writes them. Frames are dropped rather than waited
+// for when the whole ring is still busy.
+class FluidFrameExporter
+{
+public:
+    FluidFrameExporter();
+    virtual ~FluidFrameExporter();
+
+    // Both need a current GL context
+    bool start(const std::string& fileName, EFluidField field,
+               const glm::ivec2& size, bool compress, int ringSize);
+    void stop();
+
+    bool isRecording() const;
+    EFluidField field() const;
+
+    // Queues the readback of the frame held by texId
+    void capture(unsigned int texId);
+
+    int writtenFrameCount() const;
+    int droppedFrameCount() const;
+
+    static std::string fieldName(EFluidField field);
+
+
+protected:
+    enum class ESlotState
+    {
+        FREE,
+        COPYING, // Readback queued on the GPU
+        MAPPED,  // Waiting for or being written by the worker
+        WRITTEN  // Ready to be unmapped
+    };
+
+    struct Slot
+    {
+        GlAsyncReadback readback;
+        std::atomic<ESlotState> state;
+        int frame;
+        const float* pixels;
+    };
+
+    // Maps the finished copies, unmaps the written ones
+    void collect(bool wait);
+    void workerLoop();
+    void writeFrame(Slot& slot);
+
+
+private:
+    EFluidField _field;
+    bool _compress;
+    bool _recording;
+    std::ofstream _stream;
+
+    std::unique_ptr<Slot[]> _slots;
+    int _ringSize;
+    int _nextSlot;
+    int _frame;
+    int _nbDropped;
+    std::atomic<int> _nbWritten;
+
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _frameReady;
+    std::deque<Slot*> _queue;
+    bool _stopping;
+};
+
+#endif // FLUID_FRAME_EXPORTER_H
@@ -0,0 +1,259 @@
+#include "FluidSettings.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+
+const int FluidSettings::MIN_GRID_SIZE = 64;
+const int FluidSettings::MAX_GRID_SIZE = 2048;
+const int FluidSettings::WINDOW_SIZE = 768;
+const int FluidSettings::MAX_TILE_SIZE = 128;
+
+
+FluidSettings::FluidSettings() :
+    gridSize(256, 256),
+    pressureSolver(EPressureSolver::JACOBI),
+    relaxation(ERelaxation::JACOBI),
+    advection(EAdvection::SEMI_LAGRANGIAN),
+    textureStorage(ETextureStorage::FULL),
+    sorOmega(0.0f),
+    tolerance(0.0f),
+    tileSize(0),
+    tileThreshold(1.0e-3f),
+    jacobiCompute(false),
+    vorticity(0.0f),
+    schedule(EFluidSchedule::PER_FRAME),
+    stepRate(60.0f),
+    updateRate(60),
+    simulateOnly(false),
+    batchSteps(0),
+    batchBackend(EFluidBackend::GPU),
+    compareRelaxations(false),
+    compareAdvections(false),
+    compareStorages(false),
+    nbThreads(0),
+    checkpointFile(),
+    restoreFile(),
+    compressCheckpoints(true),
+    exportFrames(false),
+    exportField(EFluidField::DYE),
+    exportFile(),
+    compressExport(false),
+    stageCsvFile(),
+    obstacleFile()
+{
+}
+
+void FluidSettings::parseArguments(int argc, char* argv[])
+{
+    for(int i=1; i < argc; ++i)
+    {
+        string arg = argv[i];
+
+        if(arg == "--fluid-size" && i+1 < argc)
+        {
+            // Either "512" or "512x256"
+            string value = argv[++i];
+            size_t sep = value.find('x');
+            glm::ivec2 size;
+            size.x = atoi(value.substr(0, sep).c_str());
+            size.y = sep == string::npos ? size.x :
+                     atoi(value.substr(sep+1).c_str());
+
+            gridSize = glm::clamp(size,
+                glm::ivec2(MIN_GRID_SIZE),
+                glm::ivec2(MAX_GRID_SIZE));
+
+            if(gridSize != size)
+            {
+                cerr << "Fluid grid size clamped to "
+                     << gridSize.x << "x" << gridSize.y << endl;
+            }
+        }
+        else if(arg == "--fluid-pressure" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "jacobi")
+                pressureSolver = EPressureSolver::JACOBI;
+            else if(value == "multigrid")
+                pressureSolver = EPressureSolver::MULTIGRID;
+            else if(value == "cg")
+                pressureSolver = EPressureSolver::CONJUGATE_GRADIENT;
+            else
+                cerr << "Unknown pressure solver: " << value << endl;
+        }
+        else if(arg == "--fluid-relaxation" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "jacobi")
+                relaxation = ERelaxation::JACOBI;
+            else if(value == "sor")
+                relaxation = ERelaxation::RED_BLACK_SOR;
+            else if(value == "compare")
+                compareRelaxations = true;
+            else
+                cerr << "Unknown relaxation: " << value << endl;
+        }
+        else if(arg == "--fluid-advection" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "semi-lagrangian")
+                advection = EAdvection::SEMI_LAGRANGIAN;
+            else if(value == "maccormack")
+                advection = EAdvection::MACCORMACK;
+            else if(value == "compare")
+                compareAdvections = true;
+            else
+                cerr << "Unknown advection: " << value << endl;
+        }
+        else if(arg == "--fluid-storage" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "full")
+                textureStorage = ETextureStorage::FULL;
+            else if(value == "packed")
+                textureStorage = ETextureStorage::PACKED;
+            else if(value == "half")
+                textureStorage = ETextureStorage::HALF;
+            else if(value == "compare")
+                compareStorages = true;
+            else
+                cerr << "Unknown texture storage: " << value << endl;
+        }
+        else if(arg == "--fluid-sor-omega" && i+1 < argc)
+        {
+            // SOR diverges outside of ]0, 2[
+            sorOmega = glm::clamp((float) atof(argv[++i]), 0.0f, 1.99f);
+        }
+        else if(arg == "--fluid-tolerance" && i+1 < argc)
+        {
+            tolerance = glm::max(0.0f, (float) atof(argv[++i]));
+        }
+        else if(arg == "--fluid-batch" && i+1 < argc)
+        {
+            batchSteps = glm::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--fluid-schedule" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "frame")
+                schedule = EFluidSchedule::PER_FRAME;
+            else if(value == "fixed")
+                schedule = EFluidSchedule::FIXED_STEP;
+            else
+                cerr << "Unknown fluid schedule: " << value << endl;
+        }
+        else if(arg == "--fluid-step-rate" && i+1 < argc)
+        {
+            stepRate = glm::max(1.0f, (float) atof(argv[++i]));
+        }
+        else if(arg == "--fluid-update-rate" && i+1 < argc)
+        {
+            updateRate = glm::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--fluid-sim-only")
+        {
+            simulateOnly = true;
+        }
+        else if(arg == "--fluid-backend" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "gpu")
+                batchBackend = EFluidBackend::GPU;
+            else if(value == "cpu")
+                batchBackend = EFluidBackend::CPU;
+            else if(value == "compare")
+                batchBackend = EFluidBackend::COMPARE;
+            else
+                cerr << "Unknown fluid backend: " << value << endl;
+        }
+        else if(arg == "--fluid-threads" && i+1 < argc)
+        {
+            nbThreads = glm::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--fluid-checkpoint" && i+1 < argc)
+        {
+            checkpointFile = argv[++i];
+        }
+        else if(arg == "--fluid-restore" && i+1 < argc)
+        {
+            restoreFile = argv[++i];
+        }
+        else if(arg == "--fluid-checkpoint-compression" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "zlib")
+                compressCheckpoints = true;
+            else if(value == "none")
+                compressCheckpoints = false;
+            else
+                cerr << "Unknown checkpoint compression: " << value << endl;
+        }
+        else if(arg == "--fluid-export" && i+1 < argc)
+        {
+            string value = argv[++i];
+            exportFrames = true;
+            if(value == "dye")
+                exportField = EFluidField::DYE;
+            else if(value == "velocity")
+                exportField = EFluidField::VELOCITY;
+            else if(value == "pressure")
+                exportField = EFluidField::PRESSURE;
+            else if(value == "heat")
+                exportField = EFluidField::HEAT;
+            else
+            {
+                cerr << "Unknown exported field: " << value << endl;
+                exportFrames = false;
+            }
+        }
+        else if(arg == "--fluid-export-file" && i+1 < argc)
+        {
+            exportFile = argv[++i];
+        }
+        else if(arg == "--fluid-export-compression" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "zlib")
+                compressExport = true;
+            else if(value == "none")
+                compressExport = false;
+            else
+                cerr << "Unknown export compression: " << value << endl;
+        }
+        else if(arg == "--fluid-stage-csv" && i+1 < argc)
+        {
+            stageCsvFile = argv[++i];
+        }
+        else if(arg == "--fluid-tiles" && i+1 < argc)
+        {
+            tileSize = glm::clamp(atoi(argv[++i]), 0, MAX_TILE_SIZE);
+        }
+        else if(arg == "--fluid-tile-threshold" && i+1 < argc)
+        {
+            tileThreshold = glm::max(0.0f, (float) atof(argv[++i]));
+        }
+        else if(arg == "--fluid-jacobi-compute")
+        {
+            jacobiCompute = true;
+        }
+        else if(arg == "--fluid-vorticity" && i+1 < argc)
+        {
+            vorticity = glm::max(0.0f, (float) atof(argv[++i]));
+        }
+        else if(arg == "--fluid-obstacles" && i+1 < argc)
+        {
+            obstacleFile = argv[++i];
+        }
+    }
+}
+
+glm::ivec2 FluidSettings::windowSize() const
+{
+    // Keep the window around the same size whatever the grid resolution
+    float scale = WINDOW_SIZE / (float) glm::max(gridSize.x, gridSize.y);
+    return glm::ivec2(glm::vec2(gridSize) * scale);
+}
@@ -0,0 +1,145 @@
+#ifndef FLUID_SETTINGS_H
+#define FLUID_SETTINGS_H
+
+#include <string>
+
+#include <GLM/glm.hpp>
+
+
+enum class EPressureSolver
+{
+    JACOBI,
+    MULTIGRID,
+    CONJUGATE_GRADIENT // CPU solver only, the GPU one relaxes instead
+};
+
+// Iterative scheme of diffuse() and of the single grid pressure solve
+enum class ERelaxation
+{
+    JACOBI,
+    RED_BLACK_SOR
+};
+
+enum class EAdvection
+{
+    SEMI_LAGRANGIAN,
+    MACCORMACK // Second order correction, clamped to the backtraced texels
+};
+
+// Internal formats of the GL solver textures. Half floats drift from the
+// full precision solution when the Jacobi diffusion rounds its own iterates
+// 120 times a step, solves with a fixed right-hand side hold up better.
+enum class ETextureStorage
+{
+    FULL,   // RGBA32F everywhere
+    PACKED, // Only the channels in use, 32 bits floats
+    HALF    // Only the channels in use, 16 bits floats
+};
+
+enum class EFluidField
+{
+    DYE,
+    VELOCITY,
+    PRESSURE,
+    HEAT,
+    DIVERGENCE,
+    FRONTIER
+};
+
+enum class EFluidBackend
+{
+    GPU,
+    CPU,
+    COMPARE // Runs both and reports how far the CPU drifts from the GPU
+};
+
+// When the demo advances the simulation
+enum class EFluidSchedule
+{
+    PER_FRAME, // One step per drawn frame
+    FIXED_STEP // A fixed number of steps per second, whatever the frame rate
+};
+
+class FluidSettings
+{
+public:
+    FluidSettings();
+
+    // Picks the --fluid-* options, other arguments are left to Qt
+    void parseArguments(int argc, char* argv[]);
+
+    glm::ivec2 windowSize() const;
+
+    glm::ivec2 gridSize;
+    EPressureSolver pressureSolver;
+    ERelaxation relaxation;
+    EAdvection advection;
+    ETextureStorage textureStorage;
+
+    // Over-relaxation factor of the pressure solve, 0 for the default
+    float sorOmega;
+
+    // Relative residual under which the diffusion and pressure solves
+    // stop early, 0 to always run every iteration. The Jacobi diffusion
+    // has no fixed right-hand side and stops on its relative update.
+    float tolerance;
+
+    // Side of the tiles the GL solver skips when nothing moves in them
+    // and around them, in cells, 0 to always update the whole grid. Speed
+    // or heat under the threshold is considered still.
+    int tileSize;
+    float tileThreshold;
+
+    // Jacobi iterations of the GL solver run by a compute shader, several
+    // per dispatch, when the context has GL 4.3. Skipped tiles are left as
+    // they are, as in the fragment path.
+    bool jacobiCompute;
+
+    // Vorticity confinement strength of the heat stage, 0 to disable it
+    float vorticity;
+
+    // Fixed steps are owed by update ticks and run before the next draw,
+    // only the latest state is shown. Simulation only mode never draws
+    // the fields, only the stats panel.
+    EFluidSchedule schedule;
+    float stepRate;
+    int updateRate;
+    bool simulateOnly;
+
+    // Headless run of that many steps when non zero
+    int batchSteps;
+    EFluidBackend batchBackend;
+    bool compareRelaxations;
+    bool compareAdvections;
+    bool compareStorages;
+
+    // CPU solver workers, 0 for one per hardware thread
+    int nbThreads;
+
+    // State saved by the 'C' key or, when set, at the end of the first
+    // batch run, and the one solvers start from instead of the procedural
+    // fields when set
+    std::string checkpointFile;
+    std::string restoreFile;
+    bool compressCheckpoints;
+
+    // Field recorded every frame from the start, the 'E' key toggles it
+    bool exportFrames;
+    EFluidField exportField;
+    std::string exportFile;
+    bool compressExport;
+
+    // GPU time of each stage of every frame, in ms, when set
+    std::string stageCsvFile;
+
+    // Image whose dark pixels are obstacles, stretched over the grid.
+    // The built-in walls are used when empty.
+    std::string obstacleFile;
+
+    static const int MIN_GRID_SIZE;
+    static const int MAX_GRID_SIZE;
+    static const int WINDOW_SIZE;
+    static const int MAX_TILE_SIZE;
+};
+
+#endif // FLUID_SETTINGS_H
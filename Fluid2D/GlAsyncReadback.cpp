@@ -0,0 +1,119 @@
+#include "GlAsyncReadback.h"
+
+#include <cstring>
+
+using namespace std;
+
+
+GlAsyncReadback::GlAsyncReadback() :
+    _size(0, 0),
+    _nbChannels(0),
+    _pbo(0),
+    _fence(nullptr)
+{
+}
+
+GlAsyncReadback::~GlAsyncReadback()
+{
+}
+
+void GlAsyncReadback::initialize(const glm::ivec2& size, int nbChannels)
+{
+    _size = size;
+    _nbChannels = nbChannels;
+
+    glGenBuffers(1, &_pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER,
+                 _size.x * _size.y * _nbChannels * sizeof(float),
+                 nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void GlAsyncReadback::terminate()
+{
+    if(_fence != nullptr)
+    {
+        glDeleteSync(_fence);
+        _fence = nullptr;
+    }
+
+    glDeleteBuffers(1, &_pbo);
+    _pbo = 0;
+}
+
+void GlAsyncReadback::start(unsigned int texId)
+{
+    const GLenum FORMATS[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+    if(_fence != nullptr)
+        glDeleteSync(_fence);
+
+    // With a bound pack buffer, glGetTexImage returns right away
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glGetTexImage(GL_TEXTURE_2D, 0, FORMATS[_nbChannels-1], GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool GlAsyncReadback::isPending() const
+{
+    return _fence != nullptr;
+}
+
+bool GlAsyncReadback::isDone(bool wait)
+{
+    if(_fence == nullptr)
+        return false;
+
+    // The flush makes sure the fence eventually signals while polling
+    GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+    GLenum status = glClientWaitSync(_fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void GlAsyncReadback::read(std::vector<float>& data)
+{
+    size_t nbFloats = size_t(_size.x) * _size.y * _nbChannels;
+    data.resize(nbFloats);
+
+    const float* pixels = map();
+    if(pixels != nullptr)
+        memcpy(data.data(), pixels, nbFloats * sizeof(float));
+    unmap();
+}
+
+const float* GlAsyncReadback::map()
+{
+    size_t nbFloats = size_t(_size.x) * _size.y * _nbChannels;
+
+    glDeleteSync(_fence);
+    _fence = nullptr;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+        nbFloats * sizeof(float), GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return static_cast<const float*>(pixels);
+}
+
+void GlAsyncReadback::unmap()
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+glm::ivec2 GlAsyncReadback::size() const
+{
+    return _size;
+}
+
+int GlAsyncReadback::channelCount() const
+{
+    return _nbChannels;
+}
@@ -0,0 +1,52 @@
+#ifndef GL_ASYNC_READBACK_H
+#define GL_ASYNC_READBACK_H
+
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include <GL3/gl3w.h>
+
+
+// Texture read back through a pixel buffer object. start() only queues the
+// copy, a fence tells when the buffer can be mapped without stalling.
+class GlAsyncReadback
+{
+public:
+    GlAsyncReadback();
+    virtual ~GlAsyncReadback();
+
+    // Both need a current GL context
+    void initialize(const glm::ivec2& size, int nbChannels);
+    void terminate();
+
+    // Queues the copy of the first nbChannels of the texture level 0
+    void start(unsigned int texId);
+
+    // True between start() and read()
+    bool isPending() const;
+
+    // Polls the fence, blocks until the copy is done when wait is set
+    bool isDone(bool wait = false);
+
+    // Copies the floats out, row major with interleaved channels.
+    // Must only be called once isDone() returned true.
+    void read(std::vector<float>& data);
+
+    // Same as read() without the copy. The pointer may be used from any
+    // thread, but map() and unmap() need the GL context.
+    const float* map();
+    void unmap();
+
+    glm::ivec2 size() const;
+    int channelCount() const;
+
+
+private:
+    glm::ivec2 _size;
+    int _nbChannels;
+    unsigned int _pbo;
+    GLsync _fence;
+};
+
+#endif // GL_ASYNC_READBACK_H
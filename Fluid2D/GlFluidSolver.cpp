@@ -0,0 +1,1634 @@
+#include "GlFluidSolver.h"
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+#include <GLM/gtc/matrix_transform.hpp>
+
+#include <GL3/gl3w.h>
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace cellar;
+
+
+GlFluidSolver::GlFluidSolver(const FluidSettings& settings) :
+    IFluidSolver(settings),
+    _vao(),
+    DRAW_TEX(1),
+    FETCH_TEX(0),
+    _storage(settings.textureStorage),
+    _candlePosition(-WIDTH, -HEIGHT),
+    _checkpointCandlePosition(0, 0),
+    _boundaryVao(0),
+    _boundaryVbo(0),
+    _nbBoundaryCells(0),
+    _boundaryScratchSize(0, 0),
+    _tileSize(settings.tileSize),
+    _tileThreshold(settings.tileThreshold),
+    _tileCount(0, 0),
+    _fullGrid(false),
+    _jacobiCompute(settings.jacobiCompute),
+    _normTopLevel(0),
+    _pressureLevels()
+{
+}
+
+GlFluidSolver::~GlFluidSolver()
+{
+
+}
+
+void GlFluidSolver::initialize()
+{
+    loadObstacles();
+
+    if(_pressureSolver == EPressureSolver::CONJUGATE_GRADIENT)
+    {
+        cerr << "Conjugate gradient pressure is CPU only, "
+                "the GPU solver relaxes on a single grid" << endl;
+    }
+
+    // GL resources
+    GlVbo2Df buffPos;
+    buffPos.attribLocation = 0;
+    buffPos.dataArray.push_back(glm::vec2(-1.0, -1.0));
+    buffPos.dataArray.push_back(glm::vec2( 1.0, -1.0));
+    buffPos.dataArray.push_back(glm::vec2( 1.0,  1.0));
+    buffPos.dataArray.push_back(glm::vec2(-1.0,  1.0));
+
+    _vao.createBuffer("position", buffPos);
+
+
+    GlInputsOutputs updateLocations;
+    updateLocations.setInput(buffPos.attribLocation, "position");
+    updateLocations.setOutput(0, "FragOut");
+
+    // Dye, heat and velocity are advected in a single pass
+    GlInputsOutputs advectLocations;
+    advectLocations.setInput(buffPos.attribLocation, "position");
+    advectLocations.setOutput(0, "Dye");
+    advectLocations.setOutput(1, "Heat");
+    advectLocations.setOutput(2, "Velocity");
+    _advectShader.setInAndOutLocations(advectLocations);
+    _advectShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _advectShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/advect.frag");
+    _advectShader.link();
+    _advectShader.pushProgram();
+    _advectShader.setInt("DyeTex", 0);
+    _advectShader.setInt("HeatTex", 1);
+    _advectShader.setInt("VelocityTex", 2);
+    _advectShader.setInt("FrontierTex", 3);
+    _advectShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _advectShader.setFloat("rDx", 1.0f / DX);
+    _advectShader.setFloat("Dt",  DT);
+    _advectShader.popProgram();
+
+
+    _macCormackShader.setInAndOutLocations(advectLocations);
+    _macCormackShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _macCormackShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/maccormack.frag");
+    _macCormackShader.link();
+    _macCormackShader.pushProgram();
+    _macCormackShader.setInt("DyeTex", 0);
+    _macCormackShader.setInt("HeatTex", 1);
+    _macCormackShader.setInt("VelocityTex", 2);
+    _macCormackShader.setInt("FrontierTex", 3);
+    _macCormackShader.setInt("PredictedDyeTex", 4);
+    _macCormackShader.setInt("PredictedHeatTex", 5);
+    _macCormackShader.setInt("PredictedVelocityTex", 6);
+    _macCormackShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _macCormackShader.setFloat("rDx", 1.0f / DX);
+    _macCormackShader.setFloat("Dt",  DT);
+    _macCormackShader.popProgram();
+
+
+    _jacobiShader.setInAndOutLocations(updateLocations);
+    _jacobiShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _jacobiShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/jacobi.frag");
+    _jacobiShader.link();
+    _jacobiShader.pushProgram();
+    _jacobiShader.setInt("XTex", 0);
+    _jacobiShader.setInt("BTex", 1);
+    _jacobiShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _jacobiShader.setFloat("Alpha", 1);
+    _jacobiShader.setFloat("rBeta", 1);
+    _jacobiShader.setFloat("Ghost", 0);
+    _jacobiShader.setFloat("Omega", 1);
+    _jacobiShader.popProgram();
+
+    if(_jacobiCompute && !hasComputeShaders())
+    {
+        cerr << "Compute shaders need GL 4.3, "
+                "Jacobi iterations are drawn instead" << endl;
+        _jacobiCompute = false;
+    }
+
+    if(_jacobiCompute)
+    {
+        _jacobiComputeShader.addShader(GL_COMPUTE_SHADER, ":/shaders/jacobi.comp");
+        _jacobiComputeShader.link();
+        _jacobiComputeShader.pushProgram();
+        _jacobiComputeShader.setInt("XTex", 0);
+        _jacobiComputeShader.setInt("BTex", 1);
+        _jacobiComputeShader.setInt("XOut", 0);
+        _jacobiComputeShader.setInt("TileFlagsTex", 7);
+        _jacobiComputeShader.setInt("TileSize", glm::max(_tileSize, 1));
+        _jacobiComputeShader.popProgram();
+    }
+
+    _sorShader.setInAndOutLocations(updateLocations);
+    _sorShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _sorShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/sor.frag");
+    _sorShader.link();
+    _sorShader.pushProgram();
+    _sorShader.setInt("XTex", 0);
+    _sorShader.setInt("BTex", 1);
+    _sorShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _sorShader.popProgram();
+
+    _residualShader.setInAndOutLocations(updateLocations);
+    _residualShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _residualShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/residual.frag");
+    _residualShader.link();
+    _residualShader.pushProgram();
+    _residualShader.setInt("XTex", 0);
+    _residualShader.setInt("BTex", 1);
+    _residualShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _residualShader.setFloat("Ghost", 0);
+    _residualShader.popProgram();
+
+    _restrictShader.setInAndOutLocations(updateLocations);
+    _restrictShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _restrictShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/restrict.frag");
+    _restrictShader.link();
+    _restrictShader.pushProgram();
+    _restrictShader.setInt("FineTex", 0);
+    _restrictShader.popProgram();
+
+    _prolongateShader.setInAndOutLocations(updateLocations);
+    _prolongateShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _prolongateShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/prolongate.frag");
+    _prolongateShader.link();
+    _prolongateShader.pushProgram();
+    _prolongateShader.setInt("XTex", 0);
+    _prolongateShader.setInt("CoarseTex", 1);
+    _prolongateShader.popProgram();
+
+    _residualNormShader.setInAndOutLocations(updateLocations);
+    _residualNormShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _residualNormShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/residualNorm.frag");
+    _residualNormShader.link();
+    _residualNormShader.pushProgram();
+    _residualNormShader.setInt("XTex", 0);
+    _residualNormShader.setInt("BTex", 1);
+    _residualNormShader.popProgram();
+
+    _divergenceShader.setInAndOutLocations(updateLocations);
+    _divergenceShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _divergenceShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/divergence.frag");
+    _divergenceShader.link();
+    _divergenceShader.pushProgram();
+    _divergenceShader.setInt("VelocityTex", 0);
+    _divergenceShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _divergenceShader.setFloat("HalfrDx", 0.5f / DX);
+    _divergenceShader.popProgram();
+
+
+    _gradSubShader.setInAndOutLocations(updateLocations);
+    _gradSubShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _gradSubShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/gradSub.frag");
+    _gradSubShader.link();
+    _gradSubShader.pushProgram();
+    _gradSubShader.setInt("PressureTex", 0);
+    _gradSubShader.setInt("VelocityTex", 1);
+    _gradSubShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _gradSubShader.setFloat("HalfrDx", 0.5f / DX);
+    _gradSubShader.popProgram();
+
+
+    GlInputsOutputs heatLocations;
+    heatLocations.setInput(buffPos.attribLocation, "position");
+    heatLocations.setOutput(0, "Velocity");
+    heatLocations.setOutput(1, "Heat");
+    _heatShader.setInAndOutLocations(heatLocations);
+    _heatShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _heatShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/heat.frag");
+    _heatShader.link();
+    _heatShader.pushProgram();
+    _heatShader.setInt("VelocityTex", 0);
+    _heatShader.setInt("HeatTex", 1);
+    _candlePosition = -glm::vec2(WIDTH, HEIGHT);
+    _heatShader.setVec2f("MousePos", _candlePosition);
+    _heatShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _heatShader.setFloat("HalfrDx", 0.5f / DX);
+    _heatShader.setFloat("Confinement", 0.0f);
+    _heatShader.popProgram();
+
+
+    // Boundary cells are drawn as points
+    GlInputsOutputs frontierLocations;
+    frontierLocations.setInput(0, "cell");
+    frontierLocations.setInput(1, "weights");
+    frontierLocations.setInput(2, "keep");
+    frontierLocations.setOutput(0, "Velocity");
+    frontierLocations.setOutput(1, "Pressure");
+    _frontierShader.setInAndOutLocations(frontierLocations);
+    _frontierShader.addShader(GL_VERTEX_SHADER, ":/shaders/frontier.vert");
+    _frontierShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/frontier.frag");
+    _frontierShader.link();
+    _frontierShader.pushProgram();
+    _frontierShader.setInt("VelocityTex", 0);
+    _frontierShader.setInt("PressureTex", 1);
+    _frontierShader.setInt("Scatter", 0);
+    _frontierShader.setInt("ScratchWidth", WIDTH);
+    _frontierShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _frontierShader.popProgram();
+
+    _frontierScatterShader.setInAndOutLocations(frontierLocations);
+    _frontierScatterShader.addShader(GL_VERTEX_SHADER, ":/shaders/frontier.vert");
+    _frontierScatterShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/frontierScatter.frag");
+    _frontierScatterShader.link();
+    _frontierScatterShader.pushProgram();
+    _frontierScatterShader.setInt("VelocityTex", 0);
+    _frontierScatterShader.setInt("PressureTex", 1);
+    _frontierScatterShader.setInt("Scatter", 1);
+    _frontierScatterShader.setInt("ScratchWidth", WIDTH);
+    _frontierScatterShader.setVec2f("TargetSize", glm::vec2(WIDTH, HEIGHT));
+    _frontierScatterShader.popProgram();
+    // End GL resources
+
+
+    // OpenGL states
+    glGenTextures(2, _dyeTex);
+    glGenTextures(2, _velocityTex);
+    glGenTextures(2, _pressureTex);
+    glGenTextures(2, _heatTex);
+    glGenTextures(1, &_frontierTex);
+    glGenTextures(1, &_tempDivTex);
+    glGenTextures(3, _predictedTex);
+
+    // Only the channels in use are generated and uploaded, rows are
+    // split between the hardware threads
+    vector<float> dyeImg(AREA * 4);
+    vector<float> velocityImg(AREA * 2);
+    vector<float> pressureImg(AREA);
+    vector<float> heatImg(AREA);
+    vector<float> frontierImg(AREA);
+    ThreadPool threadPool;
+    threadPool.parallelFor(HEIGHT, 8, [&](int begin, int end)
+    {
+        for(int j=begin; j < end; ++j)
+        {
+            for(int i=0; i < WIDTH; ++i)
+            {
+                int c = j*WIDTH + i;
+                float s = i / (float) WIDTH;
+                float t = j / (float) HEIGHT;
+                glm::vec4 dye      = initDye(s, t);
+                glm::vec4 velocity = initVelocity(s, t);
+
+                for(int k=0; k < 4; ++k)
+                    dyeImg[c*4 + k] = dye[k];
+                velocityImg[c*2]     = velocity.x;
+                velocityImg[c*2 + 1] = velocity.y;
+                pressureImg[c] = initPressure(s, t).x;
+                heatImg[c]     = initHeat(s, t).x;
+                frontierImg[c] = initFrontier(s, t).x;
+            }
+        }
+    });
+
+    // Draw textures get a copy of the fetch ones once _fbo is complete.
+    // The divergence texture also holds the velocity during diffuse().
+    GLenum frontierFormat = _storage == ETextureStorage::FULL ?
+                                GL_RGBA32F : GL_R8;
+    glm::ivec2 size(WIDTH, HEIGHT);
+    initTexture(_dyeTex[FETCH_TEX],      textureFormat(4), 4, dyeImg);
+    initTexture(_dyeTex[DRAW_TEX],       textureFormat(4), size);
+    initTexture(_velocityTex[FETCH_TEX], textureFormat(2), 2, velocityImg);
+    initTexture(_velocityTex[DRAW_TEX],  textureFormat(2), size);
+    initTexture(_pressureTex[FETCH_TEX], textureFormat(1), 1, pressureImg);
+    initTexture(_pressureTex[DRAW_TEX],  textureFormat(1), size);
+    initTexture(_heatTex[FETCH_TEX],     textureFormat(1), 1, heatImg);
+    initTexture(_heatTex[DRAW_TEX],      textureFormat(1), size);
+    initTexture(_frontierTex,     frontierFormat,   1, frontierImg);
+    initTexture(_tempDivTex,      textureFormat(2), size);
+    initTexture(_predictedTex[0], textureFormat(4), size);
+    initTexture(_predictedTex[1], textureFormat(1), size);
+    initTexture(_predictedTex[2], textureFormat(2), size);
+
+    _dyeAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT0;
+    _dyeAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT1;
+    _velocityAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT2;
+    _velocityAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT3;
+    _pressureAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT4;
+    _pressureAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT5;
+    _heatAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT6;
+    _heatAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT7;
+
+
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _dyeAtt[DRAW_TEX],
+                           GL_TEXTURE_2D,  _dyeTex[DRAW_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _dyeAtt[FETCH_TEX],
+                           GL_TEXTURE_2D,  _dyeTex[FETCH_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _velocityAtt[DRAW_TEX],
+                           GL_TEXTURE_2D,  _velocityTex[DRAW_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _velocityAtt[FETCH_TEX],
+                           GL_TEXTURE_2D,  _velocityTex[FETCH_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _pressureAtt[DRAW_TEX],
+                           GL_TEXTURE_2D,  _pressureTex[DRAW_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _pressureAtt[FETCH_TEX],
+                           GL_TEXTURE_2D,  _pressureTex[FETCH_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[DRAW_TEX],
+                           GL_TEXTURE_2D,  _heatTex[DRAW_TEX], 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, _heatAtt[FETCH_TEX],
+                           GL_TEXTURE_2D,  _heatTex[FETCH_TEX], 0);
+
+    const GLenum* fieldAtts[] = {_dyeAtt, _velocityAtt, _pressureAtt, _heatAtt};
+    for(const GLenum* att : fieldAtts)
+    {
+        glReadBuffer(att[FETCH_TEX]);
+        glDrawBuffer(att[DRAW_TEX]);
+        glBlitFramebuffer(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+
+    glGenFramebuffers(1, &_advectFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _advectFbo);
+    const GLenum predictedBuffers[] = {
+        GL_COLOR_ATTACHMENT0,
+        GL_COLOR_ATTACHMENT1,
+        GL_COLOR_ATTACHMENT2,
+    };
+    const GLfloat ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glDrawBuffers(3, predictedBuffers);
+    for(int i=0; i < 3; ++i)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, predictedBuffers[i],
+                               GL_TEXTURE_2D,  _predictedTex[i], 0);
+        glClearBufferfv(GL_COLOR, i, ZERO);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+
+    // Mean of the squared residuals by mipmap reduction. Odd sizes drop
+    // their last row or column at each level, close enough for a tolerance.
+    glGenTextures(1, &_normTex);
+    glBindTexture(GL_TEXTURE_2D, _normTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, WIDTH, HEIGHT, 0,
+                 GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _normTopLevel = int(floor(log2(float(glm::max(WIDTH, HEIGHT)))));
+
+    glGenFramebuffers(1, &_normFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _normFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,  _normTex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    initBoundary();
+    initTiles();
+    initPressureLevels();
+    // End OpenGL states
+}
+
+void GlFluidSolver::terminate()
+{
+    deletePressureLevels();
+    deleteBoundary();
+    deleteTiles();
+
+    glDeleteFramebuffers(1, &_fbo);
+    glDeleteFramebuffers(1, &_normFbo);
+    glDeleteFramebuffers(1, &_advectFbo);
+    glDeleteTextures(2, _dyeTex);
+    glDeleteTextures(2, _velocityTex);
+    glDeleteTextures(2, _pressureTex);
+    glDeleteTextures(2, _heatTex);
+    glDeleteTextures(1, &_frontierTex);
+    glDeleteTextures(1, &_tempDivTex);
+    glDeleteTextures(1, &_normTex);
+    glDeleteTextures(3, _predictedTex);
+
+    for(GlAsyncReadback& readback : _checkpointReadbacks)
+    {
+        if(readback.channelCount() != 0)
+            readback.terminate();
+        readback = GlAsyncReadback();
+    }
+}
+
+void GlFluidSolver::initTexture(unsigned int texId, GLenum format,
+                                int nbChannels, const std::vector<float>& img)
+{
+    const GLenum FORMATS[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, WIDTH, HEIGHT, 0,
+                 FORMATS[nbChannels-1], GL_FLOAT, img.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GlFluidSolver::initTexture(unsigned int texId, GLenum format,
+                                const glm::ivec2& size)
+{
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, size.x, size.y, 0,
+                 GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLenum GlFluidSolver::textureFormat(int nbChannels) const
+{
+    const GLenum PACKED_FORMATS[] = {GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F};
+    const GLenum HALF_FORMATS[]   = {GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F};
+
+    switch(_storage)
+    {
+    case ETextureStorage::FULL :   return GL_RGBA32F;
+    case ETextureStorage::PACKED : return PACKED_FORMATS[nbChannels-1];
+    case ETextureStorage::HALF :   return HALF_FORMATS[nbChannels-1];
+    }
+
+    return GL_RGBA32F;
+}
+
+void GlFluidSolver::initPressureLevels()
+{
+    const int MIN_LEVEL_SIZE = 8;
+
+    glm::ivec2 size(WIDTH, HEIGHT);
+    float dx = DX;
+
+    while(true)
+    {
+        // Coarse ghost cells keep the zero boundary where the finest grid has it
+        PressureLevel level;
+        level.size = size;
+        level.dx = dx;
+        level.ghost = -(dx - DX) / (dx + DX);
+
+        if(_pressureLevels.empty())
+        {
+            // The finest level solves in place in the pressure textures
+            level.xTex[DRAW_TEX]  = _pressureTex[DRAW_TEX];
+            level.xTex[FETCH_TEX] = _pressureTex[FETCH_TEX];
+            level.bTex = _tempDivTex;
+        }
+        else
+        {
+            glGenTextures(2, level.xTex);
+            glGenTextures(1, &level.bTex);
+            initTexture(level.xTex[DRAW_TEX],  textureFormat(1), size);
+            initTexture(level.xTex[FETCH_TEX], textureFormat(1), size);
+            initTexture(level.bTex,            textureFormat(1), size);
+
+            // Interpolated corrections fade to zero outside the grid
+            for(int i=0; i < 2; ++i)
+            {
+                glBindTexture(GL_TEXTURE_2D, level.xTex[i]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        glGenTextures(1, &level.rTex);
+        initTexture(level.rTex, textureFormat(1), size);
+
+        level.xAtt[DRAW_TEX]  = GL_COLOR_ATTACHMENT0;
+        level.xAtt[FETCH_TEX] = GL_COLOR_ATTACHMENT1;
+        level.bAtt = GL_COLOR_ATTACHMENT2;
+        level.rAtt = GL_COLOR_ATTACHMENT3;
+
+        glGenFramebuffers(1, &level.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, level.fbo);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, level.xAtt[DRAW_TEX],
+                               GL_TEXTURE_2D,  level.xTex[DRAW_TEX], 0);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, level.xAtt[FETCH_TEX],
+                               GL_TEXTURE_2D,  level.xTex[FETCH_TEX], 0);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, level.bAtt,
+                               GL_TEXTURE_2D,  level.bTex, 0);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, level.rAtt,
+                               GL_TEXTURE_2D,  level.rTex, 0);
+
+        // No divergence before the first step
+        if(_pressureLevels.empty())
+        {
+            const GLfloat ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
+            glDrawBuffer(level.bAtt);
+            glClearBufferfv(GL_COLOR, 0, ZERO);
+        }
+
+        _pressureLevels.push_back(level);
+
+        if(glm::min(size.x, size.y) < 2 * MIN_LEVEL_SIZE)
+            break;
+
+        size = (size + glm::ivec2(1)) / 2;
+        dx *= 2.0f;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GlFluidSolver::deletePressureLevels()
+{
+    for(size_t l=0; l < _pressureLevels.size(); ++l)
+    {
+        PressureLevel& level = _pressureLevels[l];
+        glDeleteFramebuffers(1, &level.fbo);
+        glDeleteTextures(1, &level.rTex);
+
+        if(l != 0)
+        {
+            glDeleteTextures(2, level.xTex);
+            glDeleteTextures(1, &level.bTex);
+        }
+    }
+
+    _pressureLevels.clear();
+}
+
+void GlFluidSolver::initBoundary()
+{
+    vector<FluidBoundaryCell> cells = findBoundaryCells();
+    _nbBoundaryCells = (int) cells.size();
+    if(_nbBoundaryCells == 0)
+        return;
+
+    glGenVertexArrays(1, &_boundaryVao);
+    glBindVertexArray(_boundaryVao);
+
+    glGenBuffers(1, &_boundaryVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _boundaryVbo);
+    glBufferData(GL_ARRAY_BUFFER, cells.size() * sizeof(FluidBoundaryCell),
+                 cells.data(), GL_STATIC_DRAW);
+
+    const GLsizei stride = sizeof(FluidBoundaryCell);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+        (void*) offsetof(FluidBoundaryCell, cell));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+        (void*) offsetof(FluidBoundaryCell, weights));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride,
+        (void*) offsetof(FluidBoundaryCell, keep));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+
+    // Rows of WIDTH cells
+    _boundaryScratchSize = glm::ivec2(WIDTH,
+        (_nbBoundaryCells + WIDTH - 1) / WIDTH);
+
+    glGenTextures(2, _boundaryTex);
+    const GLenum formats[] = {textureFormat(2), textureFormat(1)};
+    for(int i=0; i < 2; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, _boundaryTex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i],
+                     _boundaryScratchSize.x, _boundaryScratchSize.y, 0,
+                     GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &_boundaryFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _boundaryFbo);
+    for(int i=0; i < 2; ++i)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                               GL_TEXTURE_2D,  _boundaryTex[i], 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    _frontierShader.pushProgram();
+    _frontierShader.setVec2f("TargetSize", glm::vec2(_boundaryScratchSize));
+    _frontierShader.popProgram();
+}
+
+void GlFluidSolver::deleteBoundary()
+{
+    if(_nbBoundaryCells == 0)
+        return;
+
+    glDeleteFramebuffers(1, &_boundaryFbo);
+    glDeleteTextures(2, _boundaryTex);
+    glDeleteBuffers(1, &_boundaryVbo);
+    glDeleteVertexArrays(1, &_boundaryVao);
+    _nbBoundaryCells = 0;
+}
+
+void GlFluidSolver::initTiles()
+{
+    if(_tileSize == 0)
+        return;
+
+    _tileCount = glm::ivec2((WIDTH  + _tileSize - 1) / _tileSize,
+                            (HEIGHT + _tileSize - 1) / _tileSize);
+
+    GlInputsOutputs tileLocations;
+    tileLocations.setInput(0, "position");
+    tileLocations.setOutput(0, "Activity");
+    _tileActivityShader.setInAndOutLocations(tileLocations);
+    _tileActivityShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _tileActivityShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/tileActivity.frag");
+    _tileActivityShader.link();
+    _tileActivityShader.pushProgram();
+    _tileActivityShader.setInt("VelocityTex", 0);
+    _tileActivityShader.setInt("HeatTex", 1);
+    _tileActivityShader.setInt("FrontierTex", 2);
+    _tileActivityShader.setVec2f("Size", glm::vec2(WIDTH, HEIGHT));
+    _tileActivityShader.setInt("TileSize", _tileSize);
+    _tileActivityShader.setFloat("Threshold", _tileThreshold);
+    _tileActivityShader.popProgram();
+
+    GlInputsOutputs dilateLocations;
+    dilateLocations.setInput(0, "position");
+    dilateLocations.setOutput(0, "Active");
+    _tileDilateShader.setInAndOutLocations(dilateLocations);
+    _tileDilateShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _tileDilateShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/tileDilate.frag");
+    _tileDilateShader.link();
+    _tileDilateShader.pushProgram();
+    _tileDilateShader.setInt("ActivityTex", 0);
+    _tileDilateShader.setVec2f("TileCount", glm::vec2(_tileCount));
+    _tileDilateShader.setInt("TileSize", _tileSize);
+    _tileDilateShader.popProgram();
+
+    GlInputsOutputs copyLocations;
+    copyLocations.setInput(0, "position");
+    copyLocations.setOutput(0, "Dye");
+    copyLocations.setOutput(1, "Velocity");
+    copyLocations.setOutput(2, "Pressure");
+    copyLocations.setOutput(3, "Heat");
+    _tileCopyShader.setInAndOutLocations(copyLocations);
+    _tileCopyShader.addShader(GL_VERTEX_SHADER, ":/shaders/update.vert");
+    _tileCopyShader.addShader(GL_FRAGMENT_SHADER, ":/shaders/tileCopy.frag");
+    _tileCopyShader.link();
+    _tileCopyShader.pushProgram();
+    _tileCopyShader.setInt("DyeTex", 0);
+    _tileCopyShader.setInt("VelocityTex", 1);
+    _tileCopyShader.setInt("PressureTex", 2);
+    _tileCopyShader.setInt("HeatTex", 3);
+    _tileCopyShader.popProgram();
+
+    // Every program drawn by drawGrid() finds the flags on the last unit
+    GlProgram* tiledPrograms[] = {
+        &_advectShader, &_macCormackShader, &_heatShader, &_jacobiShader,
+        &_sorShader, &_divergenceShader, &_gradSubShader,
+        &_residualNormShader, &_tileCopyShader
+    };
+    for(GlProgram* program : tiledPrograms)
+    {
+        program->pushProgram();
+        program->setInt("TileFlagsTex", 7);
+        program->setVec2f("TileCount", glm::vec2(_tileCount));
+        program->setVec2f("TileScale", glm::vec2(_tileSize) /
+                                       glm::vec2(WIDTH, HEIGHT));
+        program->popProgram();
+    }
+
+    glGenTextures(2, _tileTex);
+    const GLenum formats[] = {GL_RG8, GL_R8};
+    for(int i=0; i < 2; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, _tileTex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], _tileCount.x, _tileCount.y,
+                     0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &_tileFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _tileFbo);
+    for(int i=0; i < 2; ++i)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                               GL_TEXTURE_2D,  _tileTex[i], 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GlFluidSolver::deleteTiles()
+{
+    if(_tileSize == 0)
+        return;
+
+    glDeleteFramebuffers(1, &_tileFbo);
+    glDeleteTextures(2, _tileTex);
+}
+
+void GlFluidSolver::updateTiles()
+{
+    const GLenum copyBuffers [] = {
+        _dyeAtt[DRAW_TEX],
+        _velocityAtt[DRAW_TEX],
+        _pressureAtt[DRAW_TEX],
+        _heatAtt[DRAW_TEX],
+    };
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _tileFbo);
+    glViewport(0, 0, _tileCount.x, _tileCount.y);
+
+    _tileActivityShader.pushProgram();
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, _frontierTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    _tileActivityShader.popProgram();
+
+    _tileDilateShader.pushProgram();
+    _tileDilateShader.setVec2f("MousePos", _candlePosition);
+    glBindTexture(GL_TEXTURE_2D, _tileTex[0]);
+    glDrawBuffer(GL_COLOR_ATTACHMENT1);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    _tileDilateShader.popProgram();
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, _tileTex[1]);
+
+    _tileCopyShader.pushProgram();
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _dyeTex[FETCH_TEX]);
+    glDrawBuffers(4, copyBuffers);
+    _tileCopyShader.setInt("Tiles", -1);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, _tileCount.x * _tileCount.y);
+    _tileCopyShader.setInt("Tiles", 0);
+    _tileCopyShader.popProgram();
+}
+
+void GlFluidSolver::drawGrid(cellar::GlProgram& program)
+{
+    if(_tileSize == 0 || _fullGrid)
+    {
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        return;
+    }
+
+    program.setInt("Tiles", 1);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, _tileCount.x * _tileCount.y);
+    program.setInt("Tiles", 0);
+}
+
+float GlFluidSolver::activeTileRatio()
+{
+    if(_tileSize == 0)
+        return 1.0f;
+
+    vector<float> flags(_tileCount.x * _tileCount.y);
+    glBindTexture(GL_TEXTURE_2D, _tileTex[1]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, flags.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    int nbActive = 0;
+    for(float flag : flags)
+        nbActive += flag > 0.5f ? 1 : 0;
+
+    return nbActive / float(flags.size());
+}
+
+void GlFluidSolver::beginStages()
+{
+    _vao.bind();
+
+    if(_tileSize != 0)
+        updateTiles();
+
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+}
+
+void GlFluidSolver::endStages()
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    _vao.unbind();
+}
+
+void GlFluidSolver::advect()
+{
+    const GLenum drawBuffers [] = {
+        _dyeAtt[DRAW_TEX],
+        _heatAtt[DRAW_TEX],
+        _velocityAtt[DRAW_TEX],
+    };
+    const GLenum predictedBuffers [] = {
+        GL_COLOR_ATTACHMENT0,
+        GL_COLOR_ATTACHMENT1,
+        GL_COLOR_ATTACHMENT2,
+    };
+
+    _advectShader.pushProgram();
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, _frontierTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _dyeTex[FETCH_TEX]);
+
+    if(_advection == EAdvection::MACCORMACK)
+    {
+        // The semi-Lagrangian result is only a prediction
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _advectFbo);
+        glDrawBuffers(3, predictedBuffers);
+    }
+    else
+    {
+        glDrawBuffers(3, drawBuffers);
+    }
+    drawGrid(_advectShader);
+
+    _advectShader.popProgram();
+
+
+    if(_advection == EAdvection::MACCORMACK)
+    {
+        _macCormackShader.pushProgram();
+
+        // Current fields stay bound on the first units
+        for(int i=0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE4 + i);
+            glBindTexture(GL_TEXTURE_2D, _predictedTex[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+        glDrawBuffers(3, drawBuffers);
+        drawGrid(_macCormackShader);
+
+        _macCormackShader.popProgram();
+    }
+
+    swap(_dyeTex[FETCH_TEX],      _dyeTex[DRAW_TEX]);
+    swap(_dyeAtt[FETCH_TEX],      _dyeAtt[DRAW_TEX]);
+    swap(_heatTex[FETCH_TEX],     _heatTex[DRAW_TEX]);
+    swap(_heatAtt[FETCH_TEX],     _heatAtt[DRAW_TEX]);
+    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
+    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
+}
+
+void GlFluidSolver::diffuse()
+{
+    float velocityResidual;
+    float heatResidual;
+
+    _solveStats.diffuseIterations =
+        diffuseField(_velocityTex, _velocityAtt,
+                     DX*DX / (VISCOSITY*DT),
+                     1.0f / (4.0f + DX*DX/(VISCOSITY*DT)),
+                     velocityResidual) +
+        diffuseField(_heatTex, _heatAtt,
+                     DX*DX / (HEATDIFF*DT),
+                     1.0f / (4.0f + DX*DX/(HEATDIFF*DT)),
+                     heatResidual);
+
+    _solveStats.diffuseResidual = glm::max(velocityResidual, heatResidual);
+}
+
+int GlFluidSolver::diffuseField(unsigned int* tex, GLenum* att,
+                                float alpha, float rBeta, float& residual)
+{
+    // SOR solves against the field entering the stage, _tempDivTex is free
+    // until computePressure(). The plain Jacobi loop takes each iteration
+    // as the right-hand side of the next, with or without a tolerance.
+    unsigned int bTex = 0;
+    if(_relaxation == ERelaxation::RED_BLACK_SOR)
+    {
+        copyToTempDiv(att[FETCH_TEX]);
+        bTex = _tempDivTex;
+    }
+
+    // The Jacobi loop has no fixed right-hand side to measure against, it
+    // stops on its relative update |x' - x| / |x|. Taking x itself as b
+    // turns the residual into that update scaled by 1 / (alpha*rBeta).
+    auto norm = [&]() {
+        if(bTex == 0)
+            return residualNorm(tex[FETCH_TEX], tex[FETCH_TEX],
+                                alpha, rBeta) * alpha * rBeta;
+        return residualNorm(tex[FETCH_TEX], bTex, alpha, rBeta);
+    };
+
+    if(_relaxation == ERelaxation::RED_BLACK_SOR)
+    {
+        return iterate(NB_SOR_DIFFUSE_ITERATIONS, SOR_CHECK_INTERVAL,
+            [&](int nbIterations) {
+                sorRelax(tex, att, bTex, alpha, rBeta, 1.0f, nbIterations);
+            }, norm, residual);
+    }
+    else
+    {
+        return iterate(NB_JACOBI_ITERATIONS, JACOBI_CHECK_INTERVAL,
+            [&](int nbIterations) {
+                jacobiRelax(tex, att, bTex, alpha, rBeta, nbIterations);
+            }, norm, residual);
+    }
+}
+
+void GlFluidSolver::heat()
+{
+    const GLenum drawBuffers [] = {
+        _velocityAtt[DRAW_TEX],
+        _heatAtt[DRAW_TEX],
+    };
+
+    _heatShader.pushProgram();
+    _heatShader.setFloat("Confinement", _vorticity * DX * DT);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _heatTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+
+    glDrawBuffers(2, drawBuffers);
+    drawGrid(_heatShader);
+
+    swap(_heatTex[FETCH_TEX],     _heatTex[DRAW_TEX]);
+    swap(_heatAtt[FETCH_TEX],     _heatAtt[DRAW_TEX]);
+    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
+    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
+
+    _heatShader.popProgram();
+}
+
+void GlFluidSolver::computePressure()
+{
+    // Multigrid restricts the divergence of the whole grid
+    _fullGrid = _pressureSolver == EPressureSolver::MULTIGRID;
+
+    _divergenceShader.pushProgram();
+
+    // The finest pressure level has _tempDivTex attached, _fbo has no
+    // attachment left for it and switching framebuffers is cheaper than
+    // revalidating one
+    const PressureLevel& finest = _pressureLevels.front();
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, finest.fbo);
+
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glDrawBuffer(finest.bAtt);
+
+    // Diffusion may have left a field in _tempDivTex, skipped tiles have
+    // no divergence
+    if(_tileSize != 0 && !_fullGrid)
+    {
+        const GLfloat ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, ZERO);
+    }
+    drawGrid(_divergenceShader);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+
+    _divergenceShader.popProgram();
+
+
+    switch(_pressureSolver)
+    {
+    case EPressureSolver::CONJUGATE_GRADIENT :
+    case EPressureSolver::JACOBI :
+        if(_relaxation == ERelaxation::RED_BLACK_SOR)
+            sorPressure();
+        else
+            jacobiPressure();
+        break;
+    case EPressureSolver::MULTIGRID :
+        multigridPressure();
+        break;
+    }
+
+    _fullGrid = false;
+}
+
+void GlFluidSolver::jacobiPressure()
+{
+    _solveStats.pressureIterations = iterate(
+        NB_JACOBI_ITERATIONS, JACOBI_CHECK_INTERVAL,
+        [&](int nbIterations) {
+            jacobiRelax(_pressureTex, _pressureAtt, _tempDivTex,
+                        -DX*DX, 1.0f / 4.0f, nbIterations);
+        },
+        [&]() {
+            return residualNorm(_pressureTex[FETCH_TEX], _tempDivTex,
+                                -DX*DX, 1.0f / 4.0f);
+        },
+        _solveStats.pressureResidual);
+}
+
+void GlFluidSolver::sorPressure()
+{
+    _solveStats.pressureIterations = iterate(
+        NB_SOR_PRESSURE_ITERATIONS, SOR_CHECK_INTERVAL,
+        [&](int nbIterations) {
+            sorRelax(_pressureTex, _pressureAtt, _tempDivTex,
+                     -DX*DX, 1.0f / 4.0f,
+                     SOR_PRESSURE_OMEGA, nbIterations);
+        },
+        [&]() {
+            return residualNorm(_pressureTex[FETCH_TEX], _tempDivTex,
+                                -DX*DX, 1.0f / 4.0f);
+        },
+        _solveStats.pressureResidual);
+}
+
+void GlFluidSolver::jacobiRelax(unsigned int* tex, GLenum* att,
+                                unsigned int bTex, float alpha, float rBeta,
+                                int nbIterations)
+{
+    if(_jacobiCompute)
+    {
+        computeJacobi(tex, att, bTex, alpha, rBeta, 0.0f, 1.0f, nbIterations);
+        return;
+    }
+
+    _jacobiShader.pushProgram();
+    _jacobiShader.setFloat("Alpha", alpha);
+    _jacobiShader.setFloat("rBeta", rBeta);
+    _jacobiShader.setFloat("Ghost", 0.0f);
+    _jacobiShader.setFloat("Omega", 1.0f);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bTex);
+
+    for(int i=0; i < nbIterations; ++i)
+    {
+        if(bTex == 0)
+        {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, tex[FETCH_TEX]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, tex[FETCH_TEX]);
+
+        glDrawBuffer(att[DRAW_TEX]);
+        drawGrid(_jacobiShader);
+
+        // Swap textures
+        swap(tex[FETCH_TEX], tex[DRAW_TEX]);
+        swap(att[FETCH_TEX], att[DRAW_TEX]);
+    }
+
+    _jacobiShader.popProgram();
+}
+
+void GlFluidSolver::sorRelax(unsigned int* tex, GLenum* att, unsigned int bTex,
+                             float alpha, float rBeta, float omega,
+                             int nbIterations)
+{
+    _sorShader.pushProgram();
+    _sorShader.setFloat("Alpha", alpha);
+    _sorShader.setFloat("rBeta", rBeta);
+    _sorShader.setFloat("Omega", omega);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Red then black, each half pass copies the other color through
+    for(int i=0; i < nbIterations * 2; ++i)
+    {
+        _sorShader.setInt("Parity", i % 2);
+        glBindTexture(GL_TEXTURE_2D, tex[FETCH_TEX]);
+
+        glDrawBuffer(att[DRAW_TEX]);
+        drawGrid(_sorShader);
+
+        // Swap textures
+        swap(tex[FETCH_TEX], tex[DRAW_TEX]);
+        swap(att[FETCH_TEX], att[DRAW_TEX]);
+    }
+
+    _sorShader.popProgram();
+}
+
+void GlFluidSolver::computeJacobi(unsigned int* tex, GLenum* att,
+                                  unsigned int bTex, float alpha, float rBeta,
+                                  float ghost, float omega, int nbIterations)
+{
+    // Same as in jacobi.comp
+    const int TILE = 16;
+    const int MAX_STEPS = 4;
+
+    GLint format = 0;
+    glm::ivec2 size;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex[FETCH_TEX]);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH,  &size.x);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &size.y);
+
+    _jacobiComputeShader.pushProgram();
+    _jacobiComputeShader.setFloat("Alpha", alpha);
+    _jacobiComputeShader.setFloat("rBeta", rBeta);
+    _jacobiComputeShader.setFloat("Ghost", ghost);
+    _jacobiComputeShader.setFloat("Omega", omega);
+    _jacobiComputeShader.setInt("BIsX", bTex == 0 ? 1 : 0);
+    // Like drawGrid(), the tile flags are already on the last unit
+    _jacobiComputeShader.setInt("Tiled", _tileSize != 0 && !_fullGrid);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    for(int done=0; done < nbIterations;)
+    {
+        int steps = glm::min(MAX_STEPS, nbIterations - done);
+        _jacobiComputeShader.setInt("Steps", steps);
+
+        glBindTexture(GL_TEXTURE_2D, tex[FETCH_TEX]);
+        glBindImageTexture(0, tex[DRAW_TEX], 0, GL_FALSE, 0,
+                           GL_WRITE_ONLY, format);
+        glDispatchCompute((size.x + TILE-1) / TILE, (size.y + TILE-1) / TILE, 1);
+
+        // The next dispatch fetches what this one stored
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        // Swap textures
+        swap(tex[FETCH_TEX], tex[DRAW_TEX]);
+        swap(att[FETCH_TEX], att[DRAW_TEX]);
+        done += steps;
+    }
+
+    // Later stages draw in, blit and read back the results too
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT |
+                    GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_PIXEL_BUFFER_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    _jacobiComputeShader.popProgram();
+}
+
+bool GlFluidSolver::hasComputeShaders()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    return (major > 4 || (major == 4 && minor >= 3)) &&
+           glDispatchCompute != nullptr;
+}
+
+void GlFluidSolver::copyToTempDiv(GLenum attachment)
+{
+    // The finest pressure level has _tempDivTex attached
+    const PressureLevel& finest = _pressureLevels.front();
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+    glReadBuffer(attachment);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, finest.fbo);
+    glDrawBuffer(finest.bAtt);
+    glBlitFramebuffer(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+}
+
+float GlFluidSolver::residualNorm(unsigned int xTex, unsigned int bTex,
+                                  float alpha, float rBeta)
+{
+    _residualNormShader.pushProgram();
+    _residualNormShader.setFloat("Alpha", alpha);
+    _residualNormShader.setFloat("rBeta", rBeta);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _normFbo);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bTex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, xTex);
+
+    // Skipped tiles add nothing to either sum
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    if(_tileSize != 0 && !_fullGrid)
+    {
+        const GLfloat ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, ZERO);
+    }
+    drawGrid(_residualNormShader);
+
+    _residualNormShader.popProgram();
+
+    // Only the 1x1 level comes back to the CPU
+    glm::vec4 mean;
+    glBindTexture(GL_TEXTURE_2D, _normTex);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glGetTexImage(GL_TEXTURE_2D, _normTopLevel, GL_RGBA, GL_FLOAT, &mean[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+
+    if(mean.y <= 0.0f)
+        return 0.0f;
+    return sqrt(mean.x / mean.y);
+}
+
+void GlFluidSolver::multigridPressure()
+{
+    // Other stages swap the pressure textures on their own,
+    // so the finest level must be realigned before cycling
+    PressureLevel& finest = _pressureLevels.front();
+    if(finest.xTex[FETCH_TEX] != _pressureTex[FETCH_TEX])
+    {
+        swap(finest.xTex[FETCH_TEX], finest.xTex[DRAW_TEX]);
+        swap(finest.xAtt[FETCH_TEX], finest.xAtt[DRAW_TEX]);
+    }
+
+    // With a tolerance, the residual is checked after every V-cycle
+    _solveStats.pressureIterations = iterate(
+        NB_MULTIGRID_CYCLES, MULTIGRID_CHECK_INTERVAL,
+        [&](int nbCycles) {
+            for(int c=0; c < nbCycles; ++c)
+                vCycle(0);
+        },
+        [&]() {
+            return residualNorm(finest.xTex[FETCH_TEX], finest.bTex,
+                                -DX*DX, 1.0f / 4.0f);
+        },
+        _solveStats.pressureResidual);
+
+    if(_pressureTex[FETCH_TEX] != finest.xTex[FETCH_TEX])
+    {
+        swap(_pressureTex[FETCH_TEX], _pressureTex[DRAW_TEX]);
+        swap(_pressureAtt[FETCH_TEX], _pressureAtt[DRAW_TEX]);
+    }
+
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+}
+
+void GlFluidSolver::vCycle(int level)
+{
+    const int NB_PRE_SMOOTHING  = 2;
+    const int NB_POST_SMOOTHING = 2;
+    const int NB_COARSEST_ITERATIONS = 16;
+
+    if(level+1 == (int) _pressureLevels.size())
+    {
+        relaxLevel(level, NB_COARSEST_ITERATIONS);
+        return;
+    }
+
+    PressureLevel& fine = _pressureLevels[level];
+    PressureLevel& coarse = _pressureLevels[level+1];
+
+    relaxLevel(level, NB_PRE_SMOOTHING);
+
+
+    // Residual
+    _residualShader.pushProgram();
+    _residualShader.setFloat("Alpha", -fine.dx*fine.dx);
+    _residualShader.setFloat("rBeta", 1.0f / 4.0f);
+    _residualShader.setFloat("Ghost", fine.ghost);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fine.fbo);
+    glViewport(0, 0, fine.size.x, fine.size.y);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, fine.bTex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fine.xTex[FETCH_TEX]);
+
+    glDrawBuffer(fine.rAtt);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    _residualShader.popProgram();
+
+
+    // Restricted residual is the right-hand side of the coarse level
+    _restrictShader.pushProgram();
+    _restrictShader.setVec2f("FineSize", glm::vec2(fine.size));
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, coarse.fbo);
+    glViewport(0, 0, coarse.size.x, coarse.size.y);
+    glBindTexture(GL_TEXTURE_2D, fine.rTex);
+
+    glDrawBuffer(coarse.bAtt);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    _restrictShader.popProgram();
+
+    // Coarse correction starts from zero
+    const GLfloat ZERO[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glDrawBuffer(coarse.xAtt[FETCH_TEX]);
+    glClearBufferfv(GL_COLOR, 0, ZERO);
+
+    vCycle(level+1);
+
+
+    // Prolongation of the coarse correction
+    _prolongateShader.pushProgram();
+    _prolongateShader.setVec2f("CoarseSize", glm::vec2(coarse.size));
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fine.fbo);
+    glViewport(0, 0, fine.size.x, fine.size.y);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, coarse.xTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fine.xTex[FETCH_TEX]);
+
+    glDrawBuffer(fine.xAtt[DRAW_TEX]);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    swap(fine.xTex[FETCH_TEX], fine.xTex[DRAW_TEX]);
+    swap(fine.xAtt[FETCH_TEX], fine.xAtt[DRAW_TEX]);
+
+    _prolongateShader.popProgram();
+
+
+    relaxLevel(level, NB_POST_SMOOTHING);
+}
+
+void GlFluidSolver::relaxLevel(int level, int nbIterations)
+{
+    // Damped Jacobi, plain Jacobi doesn't smooth the checkerboard mode
+    const float OMEGA = 0.8f;
+
+    PressureLevel& lvl = _pressureLevels[level];
+
+    if(_jacobiCompute)
+    {
+        computeJacobi(lvl.xTex, lvl.xAtt, lvl.bTex, -lvl.dx*lvl.dx,
+                      1.0f / 4.0f, lvl.ghost, OMEGA, nbIterations);
+        return;
+    }
+
+    _jacobiShader.pushProgram();
+    _jacobiShader.setFloat("Alpha", -lvl.dx*lvl.dx);
+    _jacobiShader.setFloat("rBeta", 1.0f / 4.0f);
+    _jacobiShader.setFloat("Ghost", lvl.ghost);
+    _jacobiShader.setFloat("Omega", OMEGA);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lvl.fbo);
+    glViewport(0, 0, lvl.size.x, lvl.size.y);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, lvl.bTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    for(int i=0; i < nbIterations; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, lvl.xTex[FETCH_TEX]);
+
+        glDrawBuffer(lvl.xAtt[DRAW_TEX]);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+        // Swap textures
+        swap(lvl.xTex[FETCH_TEX], lvl.xTex[DRAW_TEX]);
+        swap(lvl.xAtt[FETCH_TEX], lvl.xAtt[DRAW_TEX]);
+    }
+
+    _jacobiShader.popProgram();
+}
+
+void GlFluidSolver::substractPressureGradient()
+{
+    _gradSubShader.pushProgram();
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
+
+    glDrawBuffer(_velocityAtt[DRAW_TEX]);
+    drawGrid(_gradSubShader);
+
+    swap(_velocityTex[FETCH_TEX], _velocityTex[DRAW_TEX]);
+    swap(_velocityAtt[FETCH_TEX], _velocityAtt[DRAW_TEX]);
+
+    _gradSubShader.popProgram();
+}
+
+void GlFluidSolver::frontier()
+{
+    const GLenum gatherBuffers [] = {
+        GL_COLOR_ATTACHMENT0,
+        GL_COLOR_ATTACHMENT1,
+    };
+    const GLenum scatterBuffers [] = {
+        _velocityAtt[FETCH_TEX],
+        _pressureAtt[FETCH_TEX],
+    };
+
+    if(_nbBoundaryCells == 0)
+        return;
+
+    glBindVertexArray(_boundaryVao);
+
+    // Mirror the fluid around each boundary cell in the scratch textures
+    _frontierShader.pushProgram();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _pressureTex[FETCH_TEX]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _velocityTex[FETCH_TEX]);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _boundaryFbo);
+    glViewport(0, 0, _boundaryScratchSize.x, _boundaryScratchSize.y);
+    glDrawBuffers(2, gatherBuffers);
+    glDrawArrays(GL_POINTS, 0, _nbBoundaryCells);
+    _frontierShader.popProgram();
+
+    // Fluid cells are left untouched, no need to swap
+    _frontierScatterShader.pushProgram();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _boundaryTex[1]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _boundaryTex[0]);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glDrawBuffers(2, scatterBuffers);
+    glDrawArrays(GL_POINTS, 0, _nbBoundaryCells);
+    _frontierScatterShader.popProgram();
+
+    _vao.bind();
+}
+
+void GlFluidSolver::finish()
+{
+    glFinish();
+}
+
+void GlFluidSolver::setCandlePosition(const glm::vec2& position)
+{
+    _candlePosition = position;
+    _heatShader.pushProgram();
+    _heatShader.setVec2f("MousePos", position);
+    _heatShader.popProgram();
+}
+
+glm::vec2 GlFluidSolver::candlePosition() const
+{
+    return _candlePosition;
+}
+
+void GlFluidSolver::requestCheckpoint()
+{
+    for(int f=0; f < FluidCheckpoint::NB_FIELDS; ++f)
+    {
+        GlAsyncReadback& readback = _checkpointReadbacks[f];
+        if(readback.channelCount() == 0)
+        {
+            readback.initialize(gridSize(),
+                FluidCheckpoint::channelCount(FluidCheckpoint::FIELDS[f]));
+        }
+
+        readback.start(fieldTexture(FluidCheckpoint::FIELDS[f]));
+    }
+
+    _checkpointCandlePosition = _candlePosition;
+}
+
+bool GlFluidSolver::takeCheckpoint(FluidCheckpoint& checkpoint)
+{
+    // Fences signal in order, the last field is the last one copied
+    GlAsyncReadback& last = _checkpointReadbacks[FluidCheckpoint::NB_FIELDS-1];
+    if(!last.isPending() || !last.isDone())
+        return false;
+
+    checkpoint.reset(gridSize());
+    checkpoint.candlePosition = _checkpointCandlePosition;
+    for(int f=0; f < FluidCheckpoint::NB_FIELDS; ++f)
+    {
+        _checkpointReadbacks[f].read(
+            checkpoint.field(FluidCheckpoint::FIELDS[f]));
+    }
+
+    return true;
+}
+
+bool GlFluidSolver::restoreCheckpoint(const FluidCheckpoint& checkpoint)
+{
+    const GLenum FORMATS[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+    if(checkpoint.gridSize != gridSize())
+        return false;
+
+    for(int f=0; f < FluidCheckpoint::NB_FIELDS; ++f)
+    {
+        EFluidField field = FluidCheckpoint::FIELDS[f];
+        int nbChannels = FluidCheckpoint::channelCount(field);
+
+        // Draw textures are overwritten before being fetched
+        glBindTexture(GL_TEXTURE_2D, fieldTexture(field));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT,
+                        FORMATS[nbChannels-1], GL_FLOAT,
+                        checkpoint.field(field).data());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    setCandlePosition(checkpoint.candlePosition);
+
+    // The frontier may differ from the initial one
+    deleteBoundary();
+    initBoundary();
+
+    return true;
+}
+
+std::vector<glm::vec4> GlFluidSolver::fieldData(EFluidField field)
+{
+    vector<glm::vec4> data(AREA);
+    glBindTexture(GL_TEXTURE_2D, fieldTexture(field));
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Same layout whatever the storage, channels not in use read as zero
+    int nbChannels = field == EFluidField::DYE ? 4 :
+                     field == EFluidField::VELOCITY ? 2 : 1;
+    for(glm::vec4& texel : data)
+    {
+        for(int c=nbChannels; c < 4; ++c)
+            texel[c] = 0.0f;
+    }
+
+    return data;
+}
+
+ETextureStorage GlFluidSolver::textureStorage() const
+{
+    return _storage;
+}
+
+unsigned int GlFluidSolver::fieldTexture(EFluidField field) const
+{
+    switch(field)
+    {
+    case EFluidField::DYE :        return dyeTexture();
+    case EFluidField::VELOCITY :   return velocityTexture();
+    case EFluidField::PRESSURE :   return pressureTexture();
+    case EFluidField::HEAT :       return heatTexture();
+    case EFluidField::DIVERGENCE : return _tempDivTex;
+    case EFluidField::FRONTIER :   return _frontierTex;
+    }
+    return 0;
+}
+
+unsigned int GlFluidSolver::dyeTexture() const
+{
+    return _dyeTex[FETCH_TEX];
+}
+
+unsigned int GlFluidSolver::velocityTexture() const
+{
+    return _velocityTex[FETCH_TEX];
+}
+
+unsigned int GlFluidSolver::pressureTexture() const
+{
+    return _pressureTex[FETCH_TEX];
+}
+
+unsigned int GlFluidSolver::heatTexture() const
+{
+    return _heatTex[FETCH_TEX];
+}
@@ -0,0 +1,194 @@
+#ifndef GL_FLUID_SOLVER_H
+#define GL_FLUID_SOLVER_H
+
+#include <vector>
+
+#include <CellarWorkbench/GL/GlProgram.h>
+#include <CellarWorkbench/GL/GlVao.h>
+
+#include "FluidCheckpoint.h"
+#include "GlAsyncReadback.h"
+#include "IFluidSolver.h"
+
+
+class GlFluidSolver : public IFluidSolver
+{
+public:
+    GlFluidSolver(const FluidSettings& settings);
+    virtual ~GlFluidSolver();
+
+    // Both need a current GL context
+    virtual void initialize() override;
+    virtual void terminate() override;
+
+    virtual void beginStages() override;
+    virtual void advect() override;
+    virtual void diffuse() override;
+    virtual void heat() override;
+    virtual void computePressure() override;
+    virtual void substractPressureGradient() override;
+    virtual void frontier() override;
+    virtual void endStages() override;
+
+    virtual void finish() override;
+
+    virtual void setCandlePosition(const glm::vec2& position) override;
+    virtual glm::vec2 candlePosition() const override;
+
+    // Fields are copied to pixel buffers, mapped once the GPU is done
+    virtual void requestCheckpoint() override;
+    virtual bool takeCheckpoint(FluidCheckpoint& checkpoint) override;
+    virtual bool restoreCheckpoint(const FluidCheckpoint& checkpoint) override;
+
+    virtual std::vector<glm::vec4> fieldData(EFluidField field) override;
+
+    ETextureStorage textureStorage() const;
+
+    // Part of the tiles updated by the last step, 1 without tiles
+    float activeTileRatio();
+
+    // Current texture of a field, valid until the next stage
+    unsigned int fieldTexture(EFluidField field) const;
+
+    unsigned int dyeTexture() const;
+    unsigned int velocityTexture() const;
+    unsigned int pressureTexture() const;
+    unsigned int heatTexture() const;
+
+
+protected:
+    // img holds nbChannels floats per cell
+    void initTexture(unsigned int texId, GLenum format,
+                     int nbChannels, const std::vector<float>& img);
+    void initTexture(unsigned int texId, GLenum format, const glm::ivec2& size);
+    // Internal format of a field using that many channels
+    GLenum textureFormat(int nbChannels) const;
+    void initPressureLevels();
+    void deletePressureLevels();
+    // Boundary cell points and the scratch textures they are gathered in
+    void initBoundary();
+    void deleteBoundary();
+    void initTiles();
+    void deleteTiles();
+    // Flags the tiles to update during this step and copies the others
+    // to the draw textures, so that skipping them keeps both textures equal
+    void updateTiles();
+    // Full screen quad, or only the active tiles when the grid is tiled
+    void drawGrid(cellar::GlProgram& program);
+
+    // Returns the number of iterations done
+    int diffuseField(unsigned int* tex, GLenum* att,
+                     float alpha, float rBeta, float& residual);
+    void jacobiPressure();
+    void sorPressure();
+    // A null bTex makes each iteration the right-hand side of the next
+    void jacobiRelax(unsigned int* tex, GLenum* att, unsigned int bTex,
+                     float alpha, float rBeta, int nbIterations);
+    void sorRelax(unsigned int* tex, GLenum* att, unsigned int bTex,
+                  float alpha, float rBeta, float omega, int nbIterations);
+    // jacobi.frag iterations by jacobi.comp, over the whole texture
+    void computeJacobi(unsigned int* tex, GLenum* att, unsigned int bTex,
+                       float alpha, float rBeta, float ghost, float omega,
+                       int nbIterations);
+    static bool hasComputeShaders();
+    // Relative residual of the jacobi.frag system, reduced on the GPU
+    float residualNorm(unsigned int xTex, unsigned int bTex,
+                       float alpha, float rBeta);
+    void copyToTempDiv(GLenum attachment);
+    void multigridPressure();
+    void vCycle(int level);
+    void relaxLevel(int level, int nbIterations);
+
+
+private:
+    // Fluid simulation GL specific attributes
+    cellar::GlProgram _advectShader;
+    cellar::GlProgram _macCormackShader;
+    cellar::GlProgram _heatShader;
+    cellar::GlProgram _jacobiShader;
+    cellar::GlProgram _jacobiComputeShader;
+    cellar::GlProgram _sorShader;
+    cellar::GlProgram _divergenceShader;
+    cellar::GlProgram _gradSubShader;
+    cellar::GlProgram _frontierShader;
+    cellar::GlProgram _frontierScatterShader;
+    cellar::GlProgram _residualShader;
+    cellar::GlProgram _restrictShader;
+    cellar::GlProgram _prolongateShader;
+    cellar::GlProgram _residualNormShader;
+    cellar::GlProgram _tileActivityShader;
+    cellar::GlProgram _tileDilateShader;
+    cellar::GlProgram _tileCopyShader;
+    cellar::GlVao _vao;
+
+    const int DRAW_TEX;
+    const int FETCH_TEX;
+    const ETextureStorage _storage;
+
+    unsigned int _dyeTex[2];
+    unsigned int _velocityTex[2];
+    unsigned int _pressureTex[2];
+    unsigned int _heatTex[2];
+    unsigned int _frontierTex;
+    unsigned int _tempDivTex;
+
+    GLenum _dyeAtt[2];
+    GLenum _velocityAtt[2];
+    GLenum _pressureAtt[2];
+    GLenum _heatAtt[2];
+
+    unsigned int _fbo;
+    glm::vec2 _candlePosition;
+
+    // One readback per checkpoint field, allocated by the first request
+    GlAsyncReadback _checkpointReadbacks[FluidCheckpoint::NB_FIELDS];
+    glm::vec2 _checkpointCandlePosition;
+
+    // First order dye, heat and velocity corrected by the MacCormack pass
+    unsigned int _predictedTex[3];
+    unsigned int _advectFbo;
+
+    // frontier() gathers the boundary cells one per scratch texel, then
+    // scatters them back in place: a texture can't be read and drawn at once
+    unsigned int _boundaryVao;
+    unsigned int _boundaryVbo;
+    int _nbBoundaryCells;
+    glm::ivec2 _boundaryScratchSize;
+    unsigned int _boundaryTex[2];
+    unsigned int _boundaryFbo;
+
+    // Per tile activity and solidity, then the dilated update flags
+    const int _tileSize;
+    const float _tileThreshold;
+    glm::ivec2 _tileCount;
+    unsigned int _tileTex[2];
+    unsigned int _tileFbo;
+    // Multigrid solves the pressure over the whole grid
+    bool _fullGrid;
+
+    // Cleared by initialize() when compute shaders are missing
+    bool _jacobiCompute;
+
+    // Squared residuals, the top of the mipmap chain holds their mean
+    unsigned int _normTex;
+    unsigned int _normFbo;
+    int _normTopLevel;
+
+    // Multigrid pyramid, level 0 aliases the pressure textures
+    struct PressureLevel
+    {
+        glm::ivec2 size;
+        float dx;
+        float ghost;
+        unsigned int fbo;
+        unsigned int xTex[2];
+        GLenum xAtt[2];
+        unsigned int bTex;
+        GLenum bAtt;
+        unsigned int rTex;
+        GLenum rAtt;
+    };
+    std::vector<PressureLevel> _pressureLevels;
+};
+
+#endif // GL_FLUID_SOLVER_H
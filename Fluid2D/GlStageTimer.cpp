@@ -0,0 +1,221 @@
+#include "GlStageTimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <GL3/gl3w.h>
+
+using namespace std;
+
+
+GlStageTimer::GlStageTimer() :
+    _stageNames(),
+    _queries(),
+    _pending(),
+    _setFrames(),
+    _frame(0),
+    _currentSet(0),
+    _windowSize(0),
+    _nbSamples(0),
+    _nextSample(0),
+    _stageSamples(),
+    _frameSamples(),
+    _csv()
+{
+}
+
+GlStageTimer::~GlStageTimer()
+{
+}
+
+void GlStageTimer::initialize(const std::vector<std::string>& stageNames,
+                              int windowSize, int nbQuerySets)
+{
+    int nbStages = (int) stageNames.size();
+    int nbSets = max(2, nbQuerySets);
+    _stageNames = stageNames;
+
+    _queries.assign(nbSets, vector<unsigned int>(nbStages));
+    for(vector<unsigned int>& queries : _queries)
+        glGenQueries(nbStages, queries.data());
+    _pending.assign(nbSets, false);
+    _setFrames.assign(nbSets, 0);
+
+    _frame = 0;
+    _currentSet = 0;
+    _windowSize = max(1, windowSize);
+    _nbSamples = 0;
+    _nextSample = 0;
+    _stageSamples.assign(nbStages, vector<double>(_windowSize, 0.0));
+    _frameSamples.assign(_windowSize, 0.0);
+}
+
+void GlStageTimer::terminate()
+{
+    for(vector<unsigned int>& queries : _queries)
+        glDeleteQueries((int) queries.size(), queries.data());
+    _queries.clear();
+    _pending.clear();
+    _setFrames.clear();
+
+    closeCsv();
+}
+
+bool GlStageTimer::openCsv(const std::string& fileName)
+{
+    closeCsv();
+
+    _csv.open(fileName, ios::trunc);
+    if(!_csv)
+    {
+        cerr << "Could not open stage times file for writing: "
+             << fileName << endl;
+        return false;
+    }
+
+    _csv << "frame";
+    for(const string& name : _stageNames)
+        _csv << "," << name;
+    _csv << ",total" << endl;
+
+    return true;
+}
+
+void GlStageTimer::closeCsv()
+{
+    if(_csv.is_open())
+        _csv.close();
+}
+
+void GlStageTimer::beginFrame()
+{
+    int nbSets = (int) _queries.size();
+    _currentSet = _frame % nbSets;
+
+    // Results of a full ring ago, given one last chance before the reuse
+    if(_pending[_currentSet])
+        collect(_currentSet);
+    _pending[_currentSet] = false;
+    _setFrames[_currentSet] = _frame;
+}
+
+void GlStageTimer::beginStage(int stage)
+{
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_currentSet][stage]);
+}
+
+void GlStageTimer::endStage()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GlStageTimer::endFrame()
+{
+    _pending[_currentSet] = true;
+    ++_frame;
+
+    // Results of the previous frames, oldest first. Queries end in order,
+    // once one set isn't there the later ones aren't either.
+    int nbSets = (int) _queries.size();
+    for(int i=0; i < nbSets - 1; ++i)
+    {
+        int set = (_frame + i) % nbSets;
+        if(!_pending[set])
+            continue;
+        if(!collect(set))
+            break;
+        _pending[set] = false;
+    }
+}
+
+int GlStageTimer::stageCount() const
+{
+    return (int) _stageNames.size();
+}
+
+const std::string& GlStageTimer::stageName(int stage) const
+{
+    return _stageNames[stage];
+}
+
+int GlStageTimer::sampleCount() const
+{
+    return _nbSamples;
+}
+
+GlStageTimer::StageStats GlStageTimer::stageStats(int stage) const
+{
+    return computeStats(_stageSamples[stage]);
+}
+
+GlStageTimer::StageStats GlStageTimer::frameStats() const
+{
+    return computeStats(_frameSamples);
+}
+
+bool GlStageTimer::collect(int set)
+{
+    // Queries end in order, the last stage is the last one available
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(_queries[set].back(),
+                        GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        return false;
+
+    int frame = _setFrames[set];
+
+    // The first frame pays for the driver's lazy work, compiles and
+    // allocations, and some drivers report garbage for it
+    if(frame == 0)
+        return true;
+
+    double frameMs = 0.0;
+    if(_csv.is_open())
+        _csv << frame;
+
+    for(int s=0; s < stageCount(); ++s)
+    {
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(_queries[set][s], GL_QUERY_RESULT, &elapsedNs);
+
+        double ms = elapsedNs / 1.0e6;
+        _stageSamples[s][_nextSample] = ms;
+        frameMs += ms;
+
+        if(_csv.is_open())
+            _csv << "," << ms;
+    }
+
+    _frameSamples[_nextSample] = frameMs;
+    _nextSample = (_nextSample + 1) % _windowSize;
+    _nbSamples = min(_nbSamples + 1, _windowSize);
+
+    if(_csv.is_open())
+        _csv << "," << frameMs << "\n";
+
+    return true;
+}
+
+GlStageTimer::StageStats GlStageTimer::computeStats(
+        const std::vector<double>& samples) const
+{
+    StageStats stats = {0.0, 0.0, 0.0};
+    if(_nbSamples == 0)
+        return stats;
+
+    // Before the window is full, the samples are at its beginning
+    vector<double> sorted(samples.begin(), samples.begin() + _nbSamples);
+    sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for(double ms : sorted)
+        sum += ms;
+
+    int p99 = max(0, (int) ceil(0.99 * _nbSamples) - 1);
+    stats.minMs = sorted.front();
+    stats.avgMs = sum / _nbSamples;
+    stats.p99Ms = sorted[p99];
+
+    return stats;
+}
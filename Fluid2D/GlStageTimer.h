@@ -0,0 +1,78 @@
+#ifndef GL_STAGE_TIMER_H
+#define GL_STAGE_TIMER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// GPU time of each stage of a frame, measured with GL_TIME_ELAPSED queries.
+// A ring of query sets is cycled through: results are read once they are
+// there, and a frame is left out when its set comes around again before
+// they are, so nothing ever waits. Frames run back to back need as many
+// sets as there are frames between two chances of the GPU to catch up.
+class GlStageTimer
+{
+public:
+    struct StageStats
+    {
+        double minMs;
+        double avgMs;
+        double p99Ms;
+    };
+
+    GlStageTimer();
+    virtual ~GlStageTimer();
+
+    // Both need a current GL context. Statistics cover the last
+    // windowSize measured frames.
+    void initialize(const std::vector<std::string>& stageNames,
+                    int windowSize, int nbQuerySets = 2);
+    void terminate();
+
+    // Appends one line of stage times per measured frame, in ms
+    bool openCsv(const std::string& fileName);
+    void closeCsv();
+
+    // Every stage must be timed once between beginFrame() and endFrame()
+    void beginFrame();
+    void beginStage(int stage);
+    void endStage();
+    void endFrame();
+
+    int stageCount() const;
+    const std::string& stageName(int stage) const;
+    int sampleCount() const;
+
+    StageStats stageStats(int stage) const;
+    // Sum of the stages
+    StageStats frameStats() const;
+
+
+protected:
+    // Returns false when the results of that set are not available yet
+    bool collect(int set);
+    StageStats computeStats(const std::vector<double>& samples) const;
+
+
+private:
+    std::vector<std::string> _stageNames;
+    // Sets of queries, whether each one waits for its results and the
+    // frame it measured
+    std::vector<std::vector<unsigned int>> _queries;
+    std::vector<bool> _pending;
+    std::vector<int> _setFrames;
+    int _frame;
+    int _currentSet;
+
+    // Rolling windows, _nextSample is the oldest once they are full
+    int _windowSize;
+    int _nbSamples;
+    int _nextSample;
+    std::vector<std::vector<double>> _stageSamples;
+    std::vector<double> _frameSamples;
+
+    std::ofstream _csv;
+};
+
+#endif // GL_STAGE_TIMER_H
@@ -0,0 +1,406 @@
+#include "IFluidSolver.h"
+
+#include <cmath>
+#include <iostream>
+
+#include <CellarWorkbench/Image/Image.h>
+#include <CellarWorkbench/Image/ImageBank.h>
+#include <CellarWorkbench/Misc/SimplexNoise.h>
+
+#include "FluidCheckpoint.h"
+
+using namespace std;
+using namespace cellar;
+
+
+namespace
+{
+    // Over-relaxation factor minimizing the residual after a fixed
+    // number of sweeps on the pressure Poisson equation
+    float pressureOmega(const FluidSettings& settings)
+    {
+        if(settings.sorOmega > 0.0f)
+            return settings.sorOmega;
+
+        // The textbook optimum 2/(1+sin(pi/n)) only pays off after
+        // about n sweeps, warm started short solves do best around 1.85
+        return 1.85f;
+    }
+}
+
+
+const int IFluidSolver::NB_STAGES;
+
+const IFluidSolver::Stage IFluidSolver::STAGES[IFluidSolver::NB_STAGES] = {
+    &IFluidSolver::advect,
+    &IFluidSolver::diffuse,
+    &IFluidSolver::heat,
+    &IFluidSolver::computePressure,
+    &IFluidSolver::substractPressureGradient,
+    &IFluidSolver::frontier
+};
+
+const char* const IFluidSolver::STAGE_NAMES[IFluidSolver::NB_STAGES] = {
+    "advect", "diffuse", "heat", "pressure", "gradient", "frontier"
+};
+
+
+FluidSolveStats::FluidSolveStats() :
+    diffuseIterations(0),
+    diffuseResidual(-1.0f),
+    pressureIterations(0),
+    pressureResidual(-1.0f)
+{
+}
+
+
+IFluidSolver::IFluidSolver(const FluidSettings& settings) :
+    WIDTH(settings.gridSize.x),
+    HEIGHT(settings.gridSize.y),
+    AREA(WIDTH * HEIGHT),
+    DX(1.0f),
+    DT(1.0f),
+    VISCOSITY(0.01f),
+    HEATDIFF(0.01f),
+    NB_JACOBI_ITERATIONS(60),
+    NB_SOR_DIFFUSE_ITERATIONS(4),
+    NB_SOR_PRESSURE_ITERATIONS(30),
+    NB_MULTIGRID_CYCLES(2),
+    SOR_PRESSURE_OMEGA(pressureOmega(settings)),
+    JACOBI_CHECK_INTERVAL(10),
+    SOR_CHECK_INTERVAL(5),
+    MULTIGRID_CHECK_INTERVAL(1),
+    _pressureSolver(settings.pressureSolver),
+    _relaxation(settings.relaxation),
+    _advection(settings.advection),
+    _tolerance(settings.tolerance),
+    _vorticity(settings.vorticity),
+    _solveStats(),
+    _checkpointRequested(false),
+    _obstacleFile(settings.obstacleFile),
+    _obstacleMask(),
+    _obstacleMaskSize(0, 0)
+{
+}
+
+IFluidSolver::~IFluidSolver()
+{
+
+}
+
+void IFluidSolver::step()
+{
+    beginStages();
+    for(Stage stage : STAGES)
+        (this->*stage)();
+    endStages();
+}
+
+void IFluidSolver::beginStages()
+{
+}
+
+void IFluidSolver::endStages()
+{
+}
+
+void IFluidSolver::finish()
+{
+}
+
+EPressureSolver IFluidSolver::pressureSolver() const
+{
+    return _pressureSolver;
+}
+
+void IFluidSolver::setPressureSolver(EPressureSolver solver)
+{
+    _pressureSolver = solver;
+}
+
+ERelaxation IFluidSolver::relaxation() const
+{
+    return _relaxation;
+}
+
+void IFluidSolver::setRelaxation(ERelaxation relaxation)
+{
+    _relaxation = relaxation;
+}
+
+EAdvection IFluidSolver::advection() const
+{
+    return _advection;
+}
+
+void IFluidSolver::setAdvection(EAdvection advection)
+{
+    _advection = advection;
+}
+
+float IFluidSolver::tolerance() const
+{
+    return _tolerance;
+}
+
+void IFluidSolver::setTolerance(float tolerance)
+{
+    _tolerance = tolerance;
+}
+
+float IFluidSolver::vorticity() const
+{
+    return _vorticity;
+}
+
+void IFluidSolver::setVorticity(float vorticity)
+{
+    _vorticity = vorticity;
+}
+
+const FluidSolveStats& IFluidSolver::solveStats() const
+{
+    return _solveStats;
+}
+
+double IFluidSolver::pressureResidual()
+{
+    vector<glm::vec4> x = fieldData(EFluidField::PRESSURE);
+    vector<glm::vec4> b = fieldData(EFluidField::DIVERGENCE);
+
+    // Laplacian(x) = b, with zero pressure outside the grid
+    auto at = [&](int i, int j) {
+        if(i < 0 || j < 0 || i >= WIDTH || j >= HEIGHT)
+            return 0.0f;
+        return x[j*WIDTH + i].x;
+    };
+
+    double sumSqResidual = 0.0;
+    double sumSqB = 0.0;
+    for(int j=0; j < HEIGHT; ++j)
+    {
+        for(int i=0; i < WIDTH; ++i)
+        {
+            float lap = (at(i-1, j) + at(i+1, j) + at(i, j-1) + at(i, j+1)
+                         - 4.0f * at(i, j)) / (DX*DX);
+            double r = b[j*WIDTH + i].x - lap;
+            sumSqResidual += r * r;
+            sumSqB += double(b[j*WIDTH + i].x) * b[j*WIDTH + i].x;
+        }
+    }
+
+    if(sumSqB == 0.0)
+        return 0.0;
+    return sqrt(sumSqResidual / sumSqB);
+}
+
+void IFluidSolver::requestCheckpoint()
+{
+    _checkpointRequested = true;
+}
+
+bool IFluidSolver::takeCheckpoint(FluidCheckpoint& checkpoint)
+{
+    if(!_checkpointRequested)
+        return false;
+
+    // Solvers without asynchronous readbacks copy their fields right away
+    checkpoint.reset(gridSize());
+    checkpoint.candlePosition = candlePosition();
+    for(EFluidField field : FluidCheckpoint::FIELDS)
+        checkpoint.setFieldTexels(field, fieldData(field));
+
+    _checkpointRequested = false;
+    return true;
+}
+
+glm::ivec2 IFluidSolver::gridSize() const
+{
+    return glm::ivec2(WIDTH, HEIGHT);
+}
+
+glm::vec4 IFluidSolver::initDye(float s, float t)
+{
+    float zoom = 4.0f;
+    float dye = SimplexNoise::noise2d(s*zoom, t*zoom);
+    return glm::vec4(dye, dye, dye, 1.0);
+}
+
+glm::vec4 IFluidSolver::initVelocity(float s, float t)
+{
+    /* Swirl
+    const float cx = 0.5f, cy = 0.5f;
+    const float ed = 0.35f;
+    float dist = glm::vec2(s, t).distanceTo(cx, cy);
+    if(dist < ed)
+        return glm::vec4(t-cx, -(s-cy), 0, 0) * 3.0 + glm::vec4(1.0, 1.0, 0, 0) * 1.0;
+    return glm::vec4();
+    //*/
+
+    /* Plank
+    if(cellar::inRange(s, 0.3f, 0.5f) &&
+       cellar::inRange(t, 0.2f, 0.40f))
+    {
+        return glm::vec4(0.0, 1.0, 0.0, 0.0) * (0.1-glm::abs(t-0.3f))*10.0;
+    }
+    if(cellar::inRange(s, 0.5f, 0.7f) &&
+       cellar::inRange(t, 0.6f, 0.8f))
+    {
+        return glm::vec4(0.0, -1.0, 0.0, 0.0) * (0.1-glm::abs(t-0.7f))*10.0;
+    }
+    return glm::vec4();
+    //*/
+
+    return glm::vec4();
+}
+
+glm::vec4 IFluidSolver::initPressure(float s, float t)
+{
+    return glm::vec4();
+}
+
+glm::vec4 IFluidSolver::initHeat(float s, float t)
+{
+    if(glm::length(glm::vec2(s, t) - glm::vec2(0.2, 0.8))< 0.08)
+        return glm::vec4(-5, 0, 0, 0);
+    if(glm::length(glm::vec2(s, t) - glm::vec2(0.5, 0.2)) < 0.08)
+        return glm::vec4(5, 0, 0, 0);
+    return glm::vec4();
+}
+
+glm::vec4 IFluidSolver::initFrontier(float s, float t)
+{
+    const glm::vec4 block(1.0, 1.0, 1.0, 1.0);
+    const glm::vec4 fluid(0.0, 0.0, 0.0, 0.0);
+
+    if(!_obstacleMask.empty())
+    {
+        // Nearest pixel, the image is stretched over the grid
+        int x = glm::min(int(s * _obstacleMaskSize.x), _obstacleMaskSize.x-1);
+        int y = glm::min(int((1.0f - t) * _obstacleMaskSize.y),
+                         _obstacleMaskSize.y-1);
+        return _obstacleMask[y * _obstacleMaskSize.x + x] ? block : fluid;
+    }
+
+    const float W = 0.03;
+    if(s < W || s > 1-W || t < W || t > 1-W)
+        return block;
+
+    if((t > 0.45 && t < 0.52) && (
+        (s < 0.22f || s > 0.24f) &&
+        (s < 0.50f || s > 0.53f) &&
+        (s < 0.78f || s > 0.80f)))
+        return block;
+/*
+    if(glm::vec2(s, t).distanceTo(0.75, 0.66) < 0.2)
+        return block;
+
+    if(glm::vec2(s, t).distanceTo(0.3, 0.2) < 0.03)
+        return block;
+*/
+    return fluid;
+}
+
+void IFluidSolver::loadObstacles()
+{
+    _obstacleMask.clear();
+    _obstacleMaskSize = glm::ivec2(0, 0);
+    if(_obstacleFile.empty())
+        return;
+
+    Image& image = getImageBank().getImage(_obstacleFile);
+    if(image.width() <= 0 || image.height() <= 0)
+    {
+        cerr << "Could not load obstacle image, "
+             << "using the default obstacles: " << _obstacleFile << endl;
+        return;
+    }
+
+    // RGBA bytes, obstacles are drawn dark on a light background
+    _obstacleMaskSize = glm::ivec2(image.width(), image.height());
+    _obstacleMask.resize(image.width() * image.height());
+    const unsigned char* pixels = image.pixels();
+    for(size_t i=0; i < _obstacleMask.size(); ++i)
+    {
+        const unsigned char* p = pixels + 4 * i;
+        int luminance = (p[0] * 2 + p[1] * 5 + p[2]) / 8;
+        _obstacleMask[i] = luminance < 128;
+    }
+}
+
+std::vector<FluidBoundaryCell> IFluidSolver::findBoundaryCells()
+{
+    const glm::ivec2 OFFSETS[] = {
+        glm::ivec2(-1, 0), glm::ivec2(1, 0),
+        glm::ivec2(0, -1), glm::ivec2(0, 1)
+    };
+
+    vector<glm::vec4> frontier = fieldData(EFluidField::FRONTIER);
+
+    // Outside the grid counts as fluid with null values, like texelFetch
+    auto blocked = [&](int x, int y) {
+        if(x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT)
+            return 0.0f;
+        return frontier[y * WIDTH + x].x;
+    };
+
+    vector<FluidBoundaryCell> cells;
+    for(int y=0; y < HEIGHT; ++y)
+    {
+        for(int x=0; x < WIDTH; ++x)
+        {
+            if(blocked(x, y) != 1.0f)
+                continue;
+
+            float accum = 0.0f;
+            glm::vec4 curr;
+            for(int n=0; n < 4; ++n)
+            {
+                curr[n] = 1.0f - blocked(x + OFFSETS[n].x, y + OFFSETS[n].y);
+                accum += curr[n];
+            }
+
+            FluidBoundaryCell cell;
+            cell.cell = glm::vec2(x, y);
+            cell.weights = glm::vec4(0.0f);
+            cell.keep = accum == 0.0f ? 1.0f : 0.0f;
+            for(int n=0; n < 4; ++n)
+            {
+                glm::ivec2 pos = glm::ivec2(x, y) + OFFSETS[n];
+                bool inside = pos.x >= 0 && pos.y >= 0 &&
+                              pos.x < WIDTH && pos.y < HEIGHT;
+                if(inside && accum != 0.0f)
+                    cell.weights[n] = curr[n] / accum;
+            }
+            cells.push_back(cell);
+        }
+    }
+
+    return cells;
+}
+
+int IFluidSolver::iterate(int maxIterations, int checkInterval,
+                          const function<void(int)>& relax,
+                          const function<float()>& residual,
+                          float& achievedResidual)
+{
+    if(_tolerance <= 0.0f)
+    {
+        relax(maxIterations);
+        achievedResidual = -1.0f;
+        return maxIterations;
+    }
+
+    // A calm field may already be converged when the stage begins
+    int done = 0;
+    while(true)
+    {
+        achievedResidual = residual();
+        if(achievedResidual <= _tolerance || done == maxIterations)
+            return done;
+
+        int chunk = glm::min(checkInterval, maxIterations - done);
+        relax(chunk);
+        done += chunk;
+    }
+}
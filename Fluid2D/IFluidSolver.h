@@ -0,0 +1,168 @@
+#ifndef I_FLUID_SOLVER_H
+#define I_FLUID_SOLVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include "FluidSettings.h"
+
+
+// Obstacle cell updated by frontier(). Weights of the left, right, bottom
+// and top neighbours average the fluid ones, zero outside the grid. Cells
+// without fluid neighbours keep their pressure and lose their velocity.
+struct FluidBoundaryCell
+{
+    glm::vec2 cell;
+    glm::vec4 weights;
+    float keep;
+};
+
+class FluidCheckpoint;
+
+// Work done by the last diffuse() and computePressure(). Residuals are
+// relative and only measured with a tolerance, they are negative otherwise.
+// The Jacobi diffusion reports its relative update instead.
+struct FluidSolveStats
+{
+    FluidSolveStats();
+
+    int diffuseIterations;
+    float diffuseResidual;
+    int pressureIterations;
+    float pressureResidual;
+};
+
+class IFluidSolver
+{
+public:
+    IFluidSolver(const FluidSettings& settings);
+    virtual ~IFluidSolver();
+
+    virtual void initialize() = 0;
+    virtual void terminate() = 0;
+
+    // One full simulation step
+    virtual void step();
+
+    // Stages of step(), in order
+    typedef void (IFluidSolver::*Stage)();
+    static const int NB_STAGES = 6;
+    static const Stage STAGES[NB_STAGES];
+    static const char* const STAGE_NAMES[NB_STAGES];
+
+    // Stages must be issued between beginStages() and endStages()
+    virtual void beginStages();
+    virtual void advect() = 0;
+    virtual void diffuse() = 0;
+    virtual void heat() = 0;
+    virtual void computePressure() = 0;
+    virtual void substractPressureGradient() = 0;
+    virtual void frontier() = 0;
+    virtual void endStages();
+
+    // Blocks until every issued stage is done
+    virtual void finish();
+
+    virtual void setCandlePosition(const glm::vec2& position) = 0;
+
+    // Row major copy of a field, with the texture layout of the GPU solver
+    virtual std::vector<glm::vec4> fieldData(EFluidField field) = 0;
+
+    // RMS of the pressure equation residual over the RMS of the divergence,
+    // meaningful right after computePressure()
+    virtual double pressureResidual();
+
+    // Starts saving the current state, takeCheckpoint() hands it over once
+    // it is back from the solver. Returns false until then, never waits.
+    virtual void requestCheckpoint();
+    virtual bool takeCheckpoint(FluidCheckpoint& checkpoint);
+
+    // Replaces the current state, false if the grid sizes don't match
+    virtual bool restoreCheckpoint(const FluidCheckpoint& checkpoint) = 0;
+
+    virtual glm::vec2 candlePosition() const = 0;
+
+    EPressureSolver pressureSolver() const;
+    void setPressureSolver(EPressureSolver solver);
+
+    ERelaxation relaxation() const;
+    void setRelaxation(ERelaxation relaxation);
+
+    EAdvection advection() const;
+    void setAdvection(EAdvection advection);
+
+    float tolerance() const;
+    void setTolerance(float tolerance);
+
+    float vorticity() const;
+    void setVorticity(float vorticity);
+
+    const FluidSolveStats& solveStats() const;
+
+    glm::ivec2 gridSize() const;
+
+
+protected:
+    // Initial state, shared by every solver
+    virtual glm::vec4 initDye(float s, float t);
+    virtual glm::vec4 initVelocity(float s, float t);
+    virtual glm::vec4 initPressure(float s, float t);
+    virtual glm::vec4 initHeat(float s, float t);
+    virtual glm::vec4 initFrontier(float s, float t);
+
+    // Obstacle mask sampled by initFrontier(), if there is one
+    void loadObstacles();
+
+    // Obstacle cells of the current frontier field
+    std::vector<FluidBoundaryCell> findBoundaryCells();
+
+    // Calls relax(n) by chunks of checkInterval iterations until residual()
+    // is under the tolerance, without exceeding maxIterations. Without a
+    // tolerance, relax() runs once and the residual is never measured.
+    // Returns the number of iterations done.
+    int iterate(int maxIterations, int checkInterval,
+                const std::function<void(int)>& relax,
+                const std::function<float()>& residual,
+                float& achievedResidual);
+
+    // Size
+    const int WIDTH;
+    const int HEIGHT;
+    const int AREA;
+    const float DX;
+    const float DT;
+    const float VISCOSITY;
+    const float HEATDIFF;
+
+    // Iteration budgets, red-black sweeps relax both colors. With a
+    // tolerance they are caps, every solve stops as soon as it is under
+    // the tolerance, the multigrid V-cycles included.
+    const int NB_JACOBI_ITERATIONS;
+    const int NB_SOR_DIFFUSE_ITERATIONS;
+    const int NB_SOR_PRESSURE_ITERATIONS;
+    const int NB_MULTIGRID_CYCLES;
+    const float SOR_PRESSURE_OMEGA;
+
+    // Iterations between two residual checks when there is a tolerance
+    const int JACOBI_CHECK_INTERVAL;
+    const int SOR_CHECK_INTERVAL;
+    const int MULTIGRID_CHECK_INTERVAL;
+
+    EPressureSolver _pressureSolver;
+    ERelaxation _relaxation;
+    EAdvection _advection;
+    float _tolerance;
+    float _vorticity;
+    FluidSolveStats _solveStats;
+    bool _checkpointRequested;
+
+    // Dark pixels of the obstacle image, rows top to bottom
+    std::string _obstacleFile;
+    std::vector<bool> _obstacleMask;
+    glm::ivec2 _obstacleMaskSize;
+};
+
+#endif // I_FLUID_SOLVER_H
@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(int nbThreads) :
+    _workers(),
+    _terminating(false),
+    _task(nullptr),
+    _count(0),
+    _grainSize(1),
+    _generation(0),
+    _nbBusyWorkers(0),
+    _nextIndex(0)
+{
+    if(nbThreads <= 0)
+        nbThreads = max(1, (int) thread::hardware_concurrency());
+
+    // The calling thread takes its share of the work
+    for(int i=1; i < nbThreads; ++i)
+        _workers.push_back(thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _terminating = true;
+    }
+    _jobReady.notify_all();
+
+    for(thread& worker : _workers)
+        worker.join();
+}
+
+int ThreadPool::threadCount() const
+{
+    return (int) _workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int count, int grainSize,
+                             const function<void(int, int)>& task)
+{
+    grainSize = max(1, grainSize);
+    if(_workers.empty() || count <= grainSize)
+    {
+        if(count > 0)
+            task(0, count);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _task = &task;
+        _count = count;
+        _grainSize = grainSize;
+        _nextIndex = 0;
+        _nbBusyWorkers = (int) _workers.size();
+        ++_generation;
+    }
+    _jobReady.notify_all();
+
+    runChunks();
+
+    unique_lock<mutex> lock(_mutex);
+    _jobDone.wait(lock, [this]{ return _nbBusyWorkers == 0; });
+    _task = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned int seenGeneration = 0;
+
+    while(true)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _jobReady.wait(lock, [&]{
+                return _terminating || _generation != seenGeneration; });
+
+            if(_terminating)
+                return;
+
+            seenGeneration = _generation;
+        }
+
+        runChunks();
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            if(--_nbBusyWorkers == 0)
+                _jobDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runChunks()
+{
+    int begin;
+    while((begin = _nextIndex.fetch_add(_grainSize)) < _count)
+    {
+        (*_task)(begin, min(begin + _grainSize, _count));
+    }
+}
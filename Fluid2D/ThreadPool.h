@@ -0,0 +1,49 @@
+#ifndef FLUID2D_THREAD_POOL_H
+#define FLUID2D_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of workers sharing loops with the calling thread
+class ThreadPool
+{
+public:
+    // One worker per hardware thread when nbThreads is 0
+    ThreadPool(int nbThreads = 0);
+    virtual ~ThreadPool();
+
+    int threadCount() const;
+
+    // Calls task(begin, end) on chunks of at most grainSize indices
+    // covering [0, count), returns once every chunk is done
+    void parallelFor(int count, int grainSize,
+                     const std::function<void(int, int)>& task);
+
+
+protected:
+    void workerLoop();
+    void runChunks();
+
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _jobReady;
+    std::condition_variable _jobDone;
+    bool _terminating;
+
+    // Current job
+    const std::function<void(int, int)>* _task;
+    int _count;
+    int _grainSize;
+    unsigned int _generation;
+    int _nbBusyWorkers;
+    std::atomic<int> _nextIndex;
+};
+
+#endif // FLUID2D_THREAD_POOL_H
@@ -1,13 +1,16 @@
 #version 130
 
-uniform sampler2D FragInTex;
+uniform sampler2D DyeTex;
+uniform sampler2D HeatTex;
 uniform sampler2D VelocityTex;
 uniform sampler2D FrontierTex;
 uniform vec2 Size;
 uniform float rDx;
 uniform float Dt;
 
-out vec4 FragOut;
+out vec4 Dye;
+out vec4 Heat;
+out vec4 Velocity;
 
 void main(void)
 {
@@ -18,5 +21,9 @@ void main(void)
                gl_FragCoord.xy,
                texelFetch(FrontierTex, ivec2(nPos), 0).x);
 
-    FragOut = texture(FragInTex, nPos / Size);
+    // Every field follows the same trajectory
+    vec2 coord = nPos / Size;
+    Dye      = texture(DyeTex,      coord);
+    Heat     = texture(HeatTex,     coord);
+    Velocity = texture(VelocityTex, coord);
 }
@@ -2,61 +2,35 @@
 
 uniform sampler2D VelocityTex;
 uniform sampler2D PressureTex;
-uniform sampler2D FrontierTex;
 uniform vec2 Size;
 
+flat in ivec2 Cell;
+flat in vec4 Weights;
+flat in float Keep;
+
 out vec4 Velocity;
 out vec4 Pressure;
 
 
+// Neighbours outside the grid weigh nothing, the clamp keeps them defined
+vec4 neighbour(sampler2D tex, ivec2 offset)
+{
+    return texelFetch(tex, clamp(Cell + offset, ivec2(0), ivec2(Size) - 1), 0);
+}
+
 void main(void)
 {
-    ivec2 pos = ivec2(gl_FragCoord.xy);
-
-    float alpha = texelFetch(FrontierTex, pos, 0).x;
-
-
-    if(alpha == 1.0)
-    {
-        float curr;
-        float accum = 0.0;
-        vec4 moyVelocity = vec4(0.0);
-        vec4 moyPressure = vec4(0.0);        
-
-        curr   = 1.0 - texelFetchOffset(FrontierTex, pos, 0, ivec2(-1,  0)).x;
-        moyVelocity += texelFetchOffset(VelocityTex, pos, 0, ivec2(-1,  0)) * curr;
-        moyPressure += texelFetchOffset(PressureTex, pos, 0, ivec2(-1,  0)) * curr;
-        accum += curr;
-
-        curr   = 1.0 - texelFetchOffset(FrontierTex, pos, 0, ivec2( 1,  0)).x;
-        moyVelocity += texelFetchOffset(VelocityTex, pos, 0, ivec2( 1,  0)) * curr;
-        moyPressure += texelFetchOffset(PressureTex, pos, 0, ivec2( 1,  0)) * curr;
-        accum += curr;
-
-        curr   = 1.0 - texelFetchOffset(FrontierTex, pos, 0, ivec2( 0, -1)).x;
-        moyVelocity += texelFetchOffset(VelocityTex, pos, 0, ivec2( 0, -1)) * curr;
-        moyPressure += texelFetchOffset(PressureTex, pos, 0, ivec2( 0, -1)) * curr;
-        accum += curr;
-
-        curr   = 1.0 - texelFetchOffset(FrontierTex, pos, 0, ivec2( 0,  1)).x;
-        moyVelocity += texelFetchOffset(VelocityTex, pos, 0, ivec2( 0,  1)) * curr;
-        moyPressure += texelFetchOffset(PressureTex, pos, 0, ivec2( 0,  1)) * curr;
-        accum += curr;
-
-        if(accum != 0.0)
-        {
-            Velocity = -moyVelocity / accum;
-            Pressure = moyPressure / accum;
-        }
-        else
-        {
-            Velocity = vec4(0.0);
-            Pressure = texelFetch(PressureTex, pos, 0);
-        }
-    }
-    else
-    {
-        Velocity = texelFetch(VelocityTex, pos, 0);
-        Pressure = texelFetch(PressureTex, pos, 0);
-    }
+    // Mirror the average of the fluid neighbours
+    vec4 moyVelocity = Weights.x * neighbour(VelocityTex, ivec2(-1,  0)) +
+                       Weights.y * neighbour(VelocityTex, ivec2( 1,  0)) +
+                       Weights.z * neighbour(VelocityTex, ivec2( 0, -1)) +
+                       Weights.w * neighbour(VelocityTex, ivec2( 0,  1));
+
+    vec4 moyPressure = Weights.x * neighbour(PressureTex, ivec2(-1,  0)) +
+                       Weights.y * neighbour(PressureTex, ivec2( 1,  0)) +
+                       Weights.z * neighbour(PressureTex, ivec2( 0, -1)) +
+                       Weights.w * neighbour(PressureTex, ivec2( 0,  1));
+
+    Velocity = -moyVelocity;
+    Pressure = moyPressure + Keep * texelFetch(PressureTex, Cell, 0);
 }
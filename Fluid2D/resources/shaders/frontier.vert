@@ -0,0 +1,28 @@
+#version 130
+
+in vec2 cell;
+in vec4 weights;
+in float keep;
+
+// Boundary cells are gathered one after the other in the scratch textures,
+// then scattered back at their place in the grid
+uniform bool Scatter;
+uniform vec2 TargetSize;
+uniform int ScratchWidth;
+
+flat out ivec2 Cell;
+flat out ivec2 Slot;
+flat out vec4 Weights;
+flat out float Keep;
+
+
+void main(void)
+{
+    Cell = ivec2(cell);
+    Slot = ivec2(gl_VertexID % ScratchWidth, gl_VertexID / ScratchWidth);
+    Weights = weights;
+    Keep = keep;
+
+    vec2 texel = Scatter ? cell : vec2(Slot);
+    gl_Position = vec4((texel + 0.5) / TargetSize * 2.0 - 1.0, 0, 1);
+}
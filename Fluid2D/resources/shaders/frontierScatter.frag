@@ -0,0 +1,16 @@
+#version 130
+
+uniform sampler2D VelocityTex;
+uniform sampler2D PressureTex;
+
+flat in ivec2 Slot;
+
+out vec4 Velocity;
+out vec4 Pressure;
+
+
+void main(void)
+{
+    Velocity = texelFetch(VelocityTex, Slot, 0);
+    Pressure = texelFetch(PressureTex, Slot, 0);
+}
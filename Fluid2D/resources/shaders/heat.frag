@@ -5,10 +5,26 @@ uniform sampler2D HeatTex;
 uniform vec2 Size;
 uniform float HalfrDx;
 uniform vec2 MousePos;
+uniform float Confinement;
 
 out vec4 Velocity;
 out vec4 Heat;
 
+
+// Zero outside the grid
+float curl(ivec2 pos)
+{
+    if(any(lessThan(pos, ivec2(0))) || any(greaterThanEqual(pos, ivec2(Size))))
+        return 0.0;
+
+    float vL = texelFetch(VelocityTex, pos - ivec2(1, 0), 0).y;
+    float vR = texelFetch(VelocityTex, pos + ivec2(1, 0), 0).y;
+    float uB = texelFetch(VelocityTex, pos - ivec2(0, 1), 0).x;
+    float uT = texelFetch(VelocityTex, pos + ivec2(0, 1), 0).x;
+
+    return HalfrDx * ((vR - vL) - (uT - uB));
+}
+
 void main(void)
 {
     ivec2 pos = ivec2(gl_FragCoord.xy);
@@ -22,6 +38,20 @@ void main(void)
     vec4 v = texelFetch(VelocityTex, pos, 0);
     v.y += HalfrDx * ((hL + hR + hB + hT) - hC.x) * 0.05;
 
+    // Vorticity confinement: push along the curl's magnitude gradient
+    // to give back the small eddies numerical dissipation smoothed out
+    if(Confinement != 0.0)
+    {
+        float cC = curl(pos);
+        vec2 grad = HalfrDx * vec2(abs(curl(pos + ivec2(1, 0))) -
+                                   abs(curl(pos - ivec2(1, 0))),
+                                   abs(curl(pos + ivec2(0, 1))) -
+                                   abs(curl(pos - ivec2(0, 1))));
+        float len = length(grad);
+        if(len > 1.0e-5)
+            v.xy += Confinement * cC * vec2(grad.y, -grad.x) / len;
+    }
+
     Velocity = v;
 
 
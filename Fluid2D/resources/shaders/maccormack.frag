@@ -0,0 +1,62 @@
+#version 130
+
+uniform sampler2D DyeTex;
+uniform sampler2D HeatTex;
+uniform sampler2D VelocityTex;
+uniform sampler2D PredictedDyeTex;
+uniform sampler2D PredictedHeatTex;
+uniform sampler2D PredictedVelocityTex;
+uniform sampler2D FrontierTex;
+uniform vec2 Size;
+uniform float rDx;
+uniform float Dt;
+
+out vec4 Dye;
+out vec4 Heat;
+out vec4 Velocity;
+
+
+// Same trajectory as advect.frag, blocked ends stay on the cell
+vec2 trace(float direction)
+{
+    vec2 nPos = gl_FragCoord.xy + direction * Dt * rDx *
+            texelFetch(VelocityTex, ivec2(gl_FragCoord.xy), 0).xy;
+
+    return mix(nPos,
+               gl_FragCoord.xy,
+               texelFetch(FrontierTex, ivec2(nPos), 0).x);
+}
+
+vec4 correct(sampler2D tex, sampler2D predicted, vec2 back, vec2 forth)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    vec4 phi = texelFetch(tex, pos, 0);
+    vec4 phiHat = texelFetch(predicted, pos, 0);
+
+    // The prediction advected back to the previous step
+    vec4 phiBack = texture(predicted, forth / Size);
+    vec4 phiCorrected = phiHat + 0.5 * (phi - phiBack);
+
+    // Stay within the texels the prediction was interpolated from
+    ivec2 last = ivec2(Size) - ivec2(1);
+    ivec2 p0 = clamp(ivec2(floor(back - 0.5)), ivec2(0), last);
+    ivec2 p1 = clamp(ivec2(floor(back - 0.5)) + ivec2(1), ivec2(0), last);
+    vec4 t00 = texelFetch(tex, ivec2(p0.x, p0.y), 0);
+    vec4 t10 = texelFetch(tex, ivec2(p1.x, p0.y), 0);
+    vec4 t01 = texelFetch(tex, ivec2(p0.x, p1.y), 0);
+    vec4 t11 = texelFetch(tex, ivec2(p1.x, p1.y), 0);
+
+    return clamp(phiCorrected,
+                 min(min(t00, t10), min(t01, t11)),
+                 max(max(t00, t10), max(t01, t11)));
+}
+
+void main(void)
+{
+    vec2 back = trace(-1.0);
+    vec2 forth = trace(1.0);
+
+    Dye      = correct(DyeTex,      PredictedDyeTex,      back, forth);
+    Heat     = correct(HeatTex,     PredictedHeatTex,     back, forth);
+    Velocity = correct(VelocityTex, PredictedVelocityTex, back, forth);
+}
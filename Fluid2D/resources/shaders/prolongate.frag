@@ -0,0 +1,17 @@
+#version 130
+
+uniform sampler2D XTex;
+uniform sampler2D CoarseTex;
+uniform vec2 CoarseSize;
+
+out vec4 FragOut;
+
+void main(void)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+
+    vec4 xC = texelFetch(XTex, pos, 0);
+    vec4 eC = texture(CoarseTex, 0.5 * gl_FragCoord.xy / CoarseSize);
+
+    FragOut = xC + eC;
+}
@@ -0,0 +1,28 @@
+#version 130
+
+uniform sampler2D XTex;
+uniform sampler2D BTex;
+uniform vec2 Size;
+uniform float Alpha;
+uniform float rBeta;
+uniform float Ghost;
+
+out vec4 FragOut;
+
+void main(void)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(XTex, 0) - ivec2(1);
+    vec4 xC = texelFetch(XTex, pos, 0);
+
+    // Cells outside the grid hold a fraction of the edge cell
+    vec4 xL = pos.x > 0      ? texelFetch(XTex, pos - ivec2(1, 0), 0) : Ghost*xC;
+    vec4 xR = pos.x < last.x ? texelFetch(XTex, pos + ivec2(1, 0), 0) : Ghost*xC;
+    vec4 xB = pos.y > 0      ? texelFetch(XTex, pos - ivec2(0, 1), 0) : Ghost*xC;
+    vec4 xT = pos.y < last.y ? texelFetch(XTex, pos + ivec2(0, 1), 0) : Ghost*xC;
+
+    vec4 bC = texelFetch(BTex, pos, 0);
+
+    // Same system as jacobi.frag, residual expressed in the units of B
+    FragOut = (xL + xR + xB + xT + bC*Alpha - xC/rBeta) / Alpha;
+}
@@ -0,0 +1,27 @@
+#version 130
+
+uniform sampler2D XTex;
+uniform sampler2D BTex;
+uniform float Alpha;
+uniform float rBeta;
+
+out vec4 FragOut;
+
+void main(void)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(XTex, 0) - ivec2(1);
+    vec4 xC = texelFetch(XTex, pos, 0);
+
+    vec4 xL = pos.x > 0      ? texelFetch(XTex, pos - ivec2(1, 0), 0) : vec4(0);
+    vec4 xR = pos.x < last.x ? texelFetch(XTex, pos + ivec2(1, 0), 0) : vec4(0);
+    vec4 xB = pos.y > 0      ? texelFetch(XTex, pos - ivec2(0, 1), 0) : vec4(0);
+    vec4 xT = pos.y < last.y ? texelFetch(XTex, pos + ivec2(0, 1), 0) : vec4(0);
+
+    vec4 bC = texelFetch(BTex, pos, 0);
+    vec4 r = (xL + xR + xB + xT + bC*Alpha - xC/rBeta) / Alpha;
+
+    // Squared norms, summed by the mipmap chain. Solved fields use at most
+    // two channels, packed textures read 1 in the alpha channel.
+    FragOut = vec4(dot(r.xy, r.xy), dot(bC.xy, bC.xy), 0, 0);
+}
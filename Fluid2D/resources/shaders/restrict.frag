@@ -0,0 +1,13 @@
+#version 130
+
+uniform sampler2D FineTex;
+uniform vec2 FineSize;
+
+out vec4 FragOut;
+
+void main(void)
+{
+    // The linear fetch at the shared corner of the four
+    // fine children is the average of the children
+    FragOut = texture(FineTex, 2.0 * gl_FragCoord.xy / FineSize);
+}
@@ -0,0 +1,35 @@
+#version 130
+
+uniform sampler2D XTex;
+uniform sampler2D BTex;
+uniform vec2 Size;
+uniform float Alpha;
+uniform float rBeta;
+uniform float Omega;
+uniform int Parity;
+
+out vec4 FragOut;
+
+void main(void)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(XTex, 0) - ivec2(1);
+    vec4 xC = texelFetch(XTex, pos, 0);
+
+    // Only one color is relaxed per pass, its neighbours all have
+    // the other color and hold the values of the previous pass
+    if(((pos.x + pos.y) & 1) != Parity)
+    {
+        FragOut = xC;
+        return;
+    }
+
+    vec4 xL = pos.x > 0      ? texelFetch(XTex, pos - ivec2(1, 0), 0) : vec4(0);
+    vec4 xR = pos.x < last.x ? texelFetch(XTex, pos + ivec2(1, 0), 0) : vec4(0);
+    vec4 xB = pos.y > 0      ? texelFetch(XTex, pos - ivec2(0, 1), 0) : vec4(0);
+    vec4 xT = pos.y < last.y ? texelFetch(XTex, pos + ivec2(0, 1), 0) : vec4(0);
+
+    vec4 bC = texelFetch(BTex, pos, 0);
+
+    FragOut = mix(xC, (xL + xR + xB + xT + bC*Alpha) * rBeta, Omega);
+}
@@ -0,0 +1,35 @@
+#version 130
+
+uniform sampler2D VelocityTex;
+uniform sampler2D HeatTex;
+uniform sampler2D FrontierTex;
+uniform vec2 Size;
+uniform int TileSize;
+uniform float Threshold;
+
+out vec4 Activity;
+
+
+// One fragment per tile: whether something moves or burns in it, and
+// whether it is fully solid
+void main(void)
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy) * TileSize;
+    ivec2 end = min(origin + TileSize, ivec2(Size));
+
+    float motion = 0.0;
+    bool solid = true;
+    for(int y=origin.y; y < end.y; ++y)
+    {
+        for(int x=origin.x; x < end.x; ++x)
+        {
+            ivec2 pos = ivec2(x, y);
+            float speed = length(texelFetch(VelocityTex, pos, 0).xy);
+            float heat = abs(texelFetch(HeatTex, pos, 0).x);
+            motion = max(motion, max(speed, heat));
+            solid = solid && texelFetch(FrontierTex, pos, 0).x == 1.0;
+        }
+    }
+
+    Activity = vec4(motion > Threshold ? 1.0 : 0.0, solid ? 1.0 : 0.0, 0, 0);
+}
@@ -0,0 +1,22 @@
+#version 130
+
+uniform sampler2D DyeTex;
+uniform sampler2D VelocityTex;
+uniform sampler2D PressureTex;
+uniform sampler2D HeatTex;
+
+out vec4 Dye;
+out vec4 Velocity;
+out vec4 Pressure;
+out vec4 Heat;
+
+
+void main(void)
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+
+    Dye      = texelFetch(DyeTex,      pos, 0);
+    Velocity = texelFetch(VelocityTex, pos, 0);
+    Pressure = texelFetch(PressureTex, pos, 0);
+    Heat     = texelFetch(HeatTex,     pos, 0);
+}
@@ -0,0 +1,39 @@
+#version 130
+
+uniform sampler2D ActivityTex;
+uniform vec2 TileCount;
+uniform int TileSize;
+uniform vec2 MousePos;
+
+out vec4 Active;
+
+
+// The flow reaches at most one tile further during a step. The candle's
+// tiles are active for heat.frag to light them.
+void main(void)
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy);
+
+    bool moving = false;
+    for(int j=-1; j <= 1; ++j)
+    {
+        for(int i=-1; i <= 1; ++i)
+        {
+            ivec2 neighbour = tile + ivec2(i, j);
+            if(all(greaterThanEqual(neighbour, ivec2(0))) &&
+               all(lessThan(neighbour, ivec2(TileCount))))
+            {
+                moving = moving ||
+                         texelFetch(ActivityTex, neighbour, 0).x > 0.5;
+            }
+        }
+    }
+
+    bool solid = texelFetch(ActivityTex, tile, 0).y > 0.5;
+
+    vec2 lo = vec2(tile * TileSize);
+    vec2 hi = lo + vec2(TileSize);
+    bool candle = distance(clamp(MousePos, lo, hi), MousePos) < 10.0;
+
+    Active = vec4((moving && !solid) || candle ? 1.0 : 0.0, 0, 0, 0);
+}
@@ -1,8 +1,31 @@
-#version 130
+#version 140
 
 in vec2 position;
 
+// Drawn once per tile when Tiles isn't 0: 1 keeps the active tiles and -1
+// the inactive ones, the other instances collapse to a point.
+uniform int Tiles;
+uniform sampler2D TileFlagsTex;
+uniform vec2 TileCount;
+uniform vec2 TileScale;
+
 void main(void)
 {
-    gl_Position = vec4(position, 0, 1);
+    if(Tiles == 0)
+    {
+        gl_Position = vec4(position, 0, 1);
+        return;
+    }
+
+    int nbColumns = int(TileCount.x);
+    ivec2 tile = ivec2(gl_InstanceID % nbColumns, gl_InstanceID / nbColumns);
+    bool isActive = texelFetch(TileFlagsTex, tile, 0).x > 0.5;
+    if(isActive != (Tiles > 0))
+    {
+        gl_Position = vec4(-2, -2, 0, 1);
+        return;
+    }
+
+    vec2 corner = (vec2(tile) + position * 0.5 + 0.5) * TileScale;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0, 1);
 }
@@ -3,6 +3,9 @@ FIND_PACKAGE(Qt5OpenGL REQUIRED)
 SET(CMAKE_AUTOMOC ON)
 SET(CMAKE_INCLUDE_CURRENT_DIR ON)
 
+# Threads
+FIND_PACKAGE(Threads REQUIRED)
+
 # ExTh
 SET(CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH}
     "${EXTH-DEMOS_SRC_DIR}/../ExperimentalTheatre/")
@@ -10,7 +13,8 @@ FIND_PACKAGE(ExperimentalTheatre REQUIRED)
 
 #Globals
 SET(EXTH-DEMOS_LIBRARIES
-    ${ExTh_LIBRARIES})
+    ${ExTh_LIBRARIES}
+    ${CMAKE_THREAD_LIBS_INIT})
 SET(EXTH-DEMOS_INCLUDE_DIRS
     ${EXTH-DEMOS_INCLUDE_DIRS}
     ${EXTH-DEMOS_SRC_DIR}
@@ -18,3 +22,15 @@ SET(EXTH-DEMOS_INCLUDE_DIRS
 SET(EXTH-DEMOS_QT_MODULES
     OpenGL)
 
+
+# Offscreen context for the headless Fluid2D batch mode
+IF(UNIX AND NOT APPLE)
+    FIND_LIBRARY(EGL_LIBRARY EGL)
+    IF(EGL_LIBRARY)
+        MESSAGE(STATUS "EGL found, Fluid2D batch mode enabled")
+        ADD_DEFINITIONS(-DEXTH_DEMOS_HEADLESS_EGL)
+        SET(EXTH-DEMOS_LIBRARIES
+            ${EXTH-DEMOS_LIBRARIES}
+            ${EGL_LIBRARY})
+    ENDIF()
+ENDIF()
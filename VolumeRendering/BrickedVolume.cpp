@@ -0,0 +1,314 @@
+#include "BrickedVolume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <GL3/gl3w.h>
+
+#include "ParallelSlabs.h"
+
+using namespace std;
+
+
+const int BrickedVolume::MAX_UPLOADS_PER_UPDATE = 32;
+
+BrickedVolume::BrickedVolume(RawVolumeFile& file, int brickSize, int cacheMb,
+                             int nbThreads) :
+    _file(file),
+    _brickSize(brickSize),
+    _slotSize(brickSize + 2),
+    _cacheMb(cacheMb),
+    _nbThreads(slabThreadCount(nbThreads)),
+    _gridSize(0, 0, 0),
+    _slotsPerAxis(0, 0, 0),
+    _atlasSize(0, 0, 0),
+    _pageTableTex(0),
+    _atlasTex(0),
+    _visibleBricks(),
+    _sortedFor(),
+    _pages(),
+    _brickSlots(),
+    _slotBricks(),
+    _slotLastUses(),
+    _nbResident(0),
+    _update(0),
+    _brickValues()
+{
+}
+
+BrickedVolume::~BrickedVolume()
+{
+}
+
+bool BrickedVolume::initialize(float transparentBelow)
+{
+    glm::ivec3 size = _file.size();
+    _gridSize = (size + glm::ivec3(_brickSize - 1)) / _brickSize;
+    int nbBricks = _gridSize.x * _gridSize.y * _gridSize.z;
+
+    // Raw extremes of each brick, one layer of bricks at a time per thread
+    vector<float> brickMins(nbBricks);
+    vector<float> brickMaxs(nbBricks);
+    forEachSlab(_nbThreads, _gridSize.z, [&](int begin, int end) {
+        glm::ivec3 brick;
+        for(brick.z=begin; brick.z < end; ++brick.z)
+        for(brick.y=0; brick.y < _gridSize.y; ++brick.y)
+        for(brick.x=0; brick.x < _gridSize.x; ++brick.x)
+        {
+            glm::ivec3 from = brick * _brickSize;
+            glm::ivec3 to = glm::min(from + glm::ivec3(_brickSize), size);
+            int b = brickIndex(brick);
+            _file.rawRange(from, to, brickMins[b], brickMaxs[b]);
+        }
+    });
+
+    // Float volumes are normalized on the range they actually span
+    if(_file.format() == ERawFormat::FLOAT32)
+    {
+        float minValue = *min_element(brickMins.begin(), brickMins.end());
+        float maxValue = *max_element(brickMaxs.begin(), brickMaxs.end());
+        _file.setRange(minValue, maxValue);
+    }
+
+    // Slots also hold a voxel of the neighbours, so are their ranges
+    _pages.assign(nbBricks, glm::vec4(0.0f));
+    glm::ivec3 brick;
+    for(brick.z=0; brick.z < _gridSize.z; ++brick.z)
+    for(brick.y=0; brick.y < _gridSize.y; ++brick.y)
+    for(brick.x=0; brick.x < _gridSize.x; ++brick.x)
+    {
+        glm::ivec3 from = glm::max(brick - glm::ivec3(1), glm::ivec3(0));
+        glm::ivec3 to = glm::min(brick + glm::ivec3(1), _gridSize - glm::ivec3(1));
+
+        float neighbourhoodMax = brickMaxs[brickIndex(brick)];
+        glm::ivec3 n;
+        for(n.z=from.z; n.z <= to.z; ++n.z)
+            for(n.y=from.y; n.y <= to.y; ++n.y)
+                for(n.x=from.x; n.x <= to.x; ++n.x)
+                    neighbourhoodMax = glm::max(neighbourhoodMax,
+                                                brickMaxs[brickIndex(n)]);
+
+        if(_file.normalize(neighbourhoodMax) > transparentBelow)
+        {
+            _pages[brickIndex(brick)].w = -1.0f;
+            _visibleBricks.push_back(brickIndex(brick));
+        }
+    }
+
+    // No more slots than bricks to show, as many as the cache holds
+    GLint max3DSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max3DSize);
+    int maxSlotsPerAxis = glm::max(1, max3DSize / _slotSize);
+    double slotBytes = double(_slotSize) * _slotSize * _slotSize * 2;
+    int maxSlots = glm::max((int) (_cacheMb * 1048576.0 / slotBytes), 1);
+    int nbSlots = glm::max(glm::min((int) _visibleBricks.size(), maxSlots), 1);
+
+    // Rows of slots first, the last row or layer is rounded up as long
+    // as the cache holds it
+    _slotsPerAxis.x = glm::min(nbSlots, maxSlotsPerAxis);
+    _slotsPerAxis.y = glm::min(
+        (nbSlots + _slotsPerAxis.x - 1) / _slotsPerAxis.x,
+        maxSlotsPerAxis);
+    int layerSlots = _slotsPerAxis.x * _slotsPerAxis.y;
+    _slotsPerAxis.z = glm::min(
+        (nbSlots + layerSlots - 1) / layerSlots,
+        maxSlotsPerAxis);
+    while(_slotsPerAxis.x * _slotsPerAxis.y * _slotsPerAxis.z > maxSlots)
+    {
+        if(_slotsPerAxis.z > 1)
+            --_slotsPerAxis.z;
+        else
+            --_slotsPerAxis.y;
+    }
+    _atlasSize = _slotsPerAxis * _slotSize;
+    nbSlots = _slotsPerAxis.x * _slotsPerAxis.y * _slotsPerAxis.z;
+
+    _brickSlots.assign(nbBricks, -1);
+    _slotBricks.assign(nbSlots, -1);
+    _slotLastUses.assign(nbSlots, -1);
+    _nbResident = 0;
+    _update = 0;
+    _brickValues.resize(_slotSize * _slotSize * _slotSize);
+    _sortedFor = glm::vec3(NAN);
+
+    glGenTextures(1, &_atlasTex);
+    glBindTexture(GL_TEXTURE_3D, _atlasTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F,
+                 _atlasSize.x, _atlasSize.y, _atlasSize.z,
+                 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &_pageTableTex);
+    glBindTexture(GL_TEXTURE_3D, _pageTableTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F,
+                 _gridSize.x, _gridSize.y, _gridSize.z,
+                 0, GL_RGBA, GL_FLOAT, _pages.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    if(glGetError() != GL_NO_ERROR)
+    {
+        cerr << "Could not allocate a brick atlas of "
+             << _atlasSize.x << "x" << _atlasSize.y << "x"
+             << _atlasSize.z << " voxels" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void BrickedVolume::terminate()
+{
+    glDeleteTextures(1, &_atlasTex);
+    glDeleteTextures(1, &_pageTableTex);
+    _atlasTex = 0;
+    _pageTableTex = 0;
+}
+
+bool BrickedVolume::update(const glm::vec3& eye)
+{
+    ++_update;
+    if(eye != _sortedFor)
+        sortBricks(eye);
+
+    // The closest bricks that fit in the cache are wanted
+    int nbSlots = slotCount();
+    int nbWanted = glm::min((int) _visibleBricks.size(), nbSlots);
+    for(int i=0; i < nbWanted; ++i)
+    {
+        int slot = _brickSlots[_visibleBricks[i]];
+        if(slot >= 0)
+            _slotLastUses[slot] = _update;
+    }
+
+    int nbUploads = 0;
+    for(int i=0; i < nbWanted && nbUploads < MAX_UPLOADS_PER_UPDATE; ++i)
+    {
+        int brick = _visibleBricks[i];
+        if(_brickSlots[brick] >= 0)
+            continue;
+
+        // Free slots have never been used, they come first
+        int slot = 0;
+        for(int s=1; s < nbSlots; ++s)
+            if(_slotLastUses[s] < _slotLastUses[slot])
+                slot = s;
+
+        loadBrick(brick, slot);
+        ++nbUploads;
+    }
+
+    if(nbUploads == 0)
+        return false;
+
+    glBindTexture(GL_TEXTURE_3D, _pageTableTex);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0,
+                    _gridSize.x, _gridSize.y, _gridSize.z,
+                    GL_RGBA, GL_FLOAT, _pages.data());
+
+    return true;
+}
+
+unsigned int BrickedVolume::pageTableTex() const
+{
+    return _pageTableTex;
+}
+
+unsigned int BrickedVolume::atlasTex() const
+{
+    return _atlasTex;
+}
+
+const glm::ivec3& BrickedVolume::atlasSize() const
+{
+    return _atlasSize;
+}
+
+int BrickedVolume::brickSize() const
+{
+    return _brickSize;
+}
+
+int BrickedVolume::visibleBrickCount() const
+{
+    return (int) _visibleBricks.size();
+}
+
+int BrickedVolume::residentBrickCount() const
+{
+    return _nbResident;
+}
+
+int BrickedVolume::slotCount() const
+{
+    return (int) _slotBricks.size();
+}
+
+int BrickedVolume::brickIndex(const glm::ivec3& brick) const
+{
+    return (brick.z * _gridSize.y + brick.y) * _gridSize.x + brick.x;
+}
+
+void BrickedVolume::sortBricks(const glm::vec3& eye)
+{
+    glm::vec3 brickExtent = glm::vec3(float(_brickSize)) /
+                            glm::vec3(_file.size());
+
+    vector<float> distances(_pages.size());
+    for(int b : _visibleBricks)
+    {
+        glm::ivec3 brick(b % _gridSize.x,
+                         (b / _gridSize.x) % _gridSize.y,
+                         b / (_gridSize.x * _gridSize.y));
+        glm::vec3 center = (glm::vec3(brick) + glm::vec3(0.5f)) * brickExtent;
+        distances[b] = glm::length(center - eye);
+    }
+
+    sort(_visibleBricks.begin(), _visibleBricks.end(), [&](int a, int b) {
+        return distances[a] < distances[b];
+    });
+
+    _sortedFor = eye;
+}
+
+void BrickedVolume::loadBrick(int brick, int slot)
+{
+    int evicted = _slotBricks[slot];
+    if(evicted >= 0)
+    {
+        _brickSlots[evicted] = -1;
+        _pages[evicted] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+        --_nbResident;
+    }
+
+    glm::ivec3 brickPos(brick % _gridSize.x,
+                        (brick / _gridSize.x) % _gridSize.y,
+                        brick / (_gridSize.x * _gridSize.y));
+    glm::ivec3 slotPos(slot % _slotsPerAxis.x,
+                       (slot / _slotsPerAxis.x) % _slotsPerAxis.y,
+                       slot / (_slotsPerAxis.x * _slotsPerAxis.y));
+    glm::ivec3 slotOrigin = slotPos * _slotSize;
+
+    _file.readBlock(brickPos * _brickSize - glm::ivec3(1), _slotSize,
+                    _brickValues.data());
+
+    glBindTexture(GL_TEXTURE_3D, _atlasTex);
+    glTexSubImage3D(GL_TEXTURE_3D, 0,
+                    slotOrigin.x, slotOrigin.y, slotOrigin.z,
+                    _slotSize, _slotSize, _slotSize,
+                    GL_RED, GL_FLOAT, _brickValues.data());
+
+    _slotBricks[slot] = brick;
+    _slotLastUses[slot] = _update;
+    _brickSlots[brick] = slot;
+    _pages[brick] = glm::vec4(glm::vec3(slotOrigin), 1.0f);
+    ++_nbResident;
+}
@@ -0,0 +1,80 @@
+#ifndef VOLUME_RENDERING_BRICKED_VOLUME_H
+#define VOLUME_RENDERING_BRICKED_VOLUME_H
+
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include "RawVolumeFile.h"
+
+
+// A raw volume split in bricks of brickSize^3 voxels, only the ones
+// around the eye are resident in a 3D texture atlas. Atlas slots hold a
+// brick and one voxel of its neighbours for the linear filtering. The
+// page table has one texel per brick: the atlas texel its slot starts
+// at, and 1 when resident, 0 when the brick is transparent or -1 when it
+// isn't loaded yet.
+class BrickedVolume
+{
+public:
+    BrickedVolume(RawVolumeFile& file, int brickSize, int cacheMb,
+                  int nbThreads = 0);
+    virtual ~BrickedVolume();
+
+    // Finds the range of every brick, the ones entirely under
+    // transparentBelow are never loaded. Needs a current GL context.
+    bool initialize(float transparentBelow);
+    void terminate();
+
+    // Loads a few more of the bricks closest to the eye, in the texture
+    // coordinates of the volume. Bricks least recently wanted make room
+    // for them. Returns true when the page table changed.
+    bool update(const glm::vec3& eye);
+
+    unsigned int pageTableTex() const;
+    unsigned int atlasTex() const;
+    const glm::ivec3& atlasSize() const;
+    int brickSize() const;
+
+    int visibleBrickCount() const;
+    int residentBrickCount() const;
+    int slotCount() const;
+
+    // Bricks uploaded per update at most
+    static const int MAX_UPLOADS_PER_UPDATE;
+
+
+protected:
+    int brickIndex(const glm::ivec3& brick) const;
+    void sortBricks(const glm::vec3& eye);
+    void loadBrick(int brick, int slot);
+
+
+private:
+    RawVolumeFile& _file;
+    int _brickSize;
+    int _slotSize;
+    int _cacheMb;
+    int _nbThreads;
+
+    glm::ivec3 _gridSize;
+    glm::ivec3 _slotsPerAxis;
+    glm::ivec3 _atlasSize;
+    unsigned int _pageTableTex;
+    unsigned int _atlasTex;
+
+    // Bricks that aren't transparent, closest to the eye first
+    std::vector<int> _visibleBricks;
+    glm::vec3 _sortedFor;
+
+    std::vector<glm::vec4> _pages;
+    std::vector<int> _brickSlots;
+    std::vector<int> _slotBricks;
+    std::vector<int> _slotLastUses;
+    int _nbResident;
+    int _update;
+
+    std::vector<float> _brickValues;
+};
+
+#endif //VOLUME_RENDERING_BRICKED_VOLUME_H
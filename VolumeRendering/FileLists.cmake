@@ -2,18 +2,33 @@ SET(VOLUME_RENDERING_SRC_DIR
     ${CMAKE_CURRENT_SOURCE_DIR}/VolumeRendering)
 
 SET(VOLUME_RENDERING_HEADERS
+    ${VOLUME_RENDERING_SRC_DIR}/BrickedVolume.h
     ${VOLUME_RENDERING_SRC_DIR}/Lights.h
+    ${VOLUME_RENDERING_SRC_DIR}/MacroCellGrid.h
+    ${VOLUME_RENDERING_SRC_DIR}/ParallelSlabs.h
+    ${VOLUME_RENDERING_SRC_DIR}/RawVolumeFile.h
+    ${VOLUME_RENDERING_SRC_DIR}/TransmittanceVolume.h
     ${VOLUME_RENDERING_SRC_DIR}/Volumes.h
-    ${VOLUME_RENDERING_SRC_DIR}/Visualizer.h)
+    ${VOLUME_RENDERING_SRC_DIR}/VolumeSettings.h
+    ${VOLUME_RENDERING_SRC_DIR}/Visualizer.h
+    ${VOLUME_RENDERING_SRC_DIR}/Voxelizer.h)
     
 SET(VOLUME_RENDERING_SOURCES
+    ${VOLUME_RENDERING_SRC_DIR}/BrickedVolume.cpp
     ${VOLUME_RENDERING_SRC_DIR}/Lights.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/MacroCellGrid.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/ParallelSlabs.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/RawVolumeFile.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/TransmittanceVolume.cpp
     ${VOLUME_RENDERING_SRC_DIR}/Volumes.cpp
-    ${VOLUME_RENDERING_SRC_DIR}/Visualizer.cpp)
+    ${VOLUME_RENDERING_SRC_DIR}/VolumeSettings.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/Visualizer.cpp
+    ${VOLUME_RENDERING_SRC_DIR}/Voxelizer.cpp)
 
 SET(FRACTAL_SHADERS_SRC
     ${VOLUME_RENDERING_SRC_DIR}/resources/shaders/render.vert
     ${VOLUME_RENDERING_SRC_DIR}/resources/shaders/render.frag
+    ${VOLUME_RENDERING_SRC_DIR}/resources/shaders/render_bricked.frag
     ${VOLUME_RENDERING_SRC_DIR}/resources/shaders/env.vert
     ${VOLUME_RENDERING_SRC_DIR}/resources/shaders/env.frag)
 
@@ -0,0 +1,84 @@
+#include "MacroCellGrid.h"
+
+
+MacroCellGrid::MacroCellGrid(const glm::ivec3& dataSize, int cellSize) :
+    _dataSize(dataSize),
+    _cellSize(cellSize),
+    _size((dataSize + glm::ivec3(cellSize - 1)) / cellSize),
+    _maxAlpha(_size.x * _size.y * _size.z, 0.0f)
+{
+}
+
+MacroCellGrid::~MacroCellGrid()
+{
+
+}
+
+void MacroCellGrid::addSlices(int firstSlice, int nbSlices,
+                              const glm::vec4* optical)
+{
+    glm::ivec3 last = _dataSize - glm::ivec3(1);
+
+    for(int k=0; k < nbSlices; ++k)
+    {
+        // Cells whose margin holds the voxel, one or two along each axis
+        int z = firstSlice + k;
+        int cz0 = glm::max(z - 1, 0) / _cellSize;
+        int cz1 = glm::min(z + 1, last.z) / _cellSize;
+
+        for(int j=0; j < _dataSize.y; ++j)
+        {
+            int cy0 = glm::max(j - 1, 0) / _cellSize;
+            int cy1 = glm::min(j + 1, last.y) / _cellSize;
+            const glm::vec4* row = optical + (k * _dataSize.y + j) * _dataSize.x;
+
+            for(int i=0; i < _dataSize.x; ++i)
+            {
+                float alpha = row[i].w;
+                if(alpha <= 0.0f)
+                    continue;
+
+                int cx0 = glm::max(i - 1, 0) / _cellSize;
+                int cx1 = glm::min(i + 1, last.x) / _cellSize;
+
+                for(int cz=cz0; cz <= cz1; ++cz)
+                {
+                    for(int cy=cy0; cy <= cy1; ++cy)
+                    {
+                        for(int cx=cx0; cx <= cx1; ++cx)
+                        {
+                            float& cell = _maxAlpha[
+                                (cz * _size.y + cy) * _size.x + cx];
+                            cell = glm::max(cell, alpha);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int MacroCellGrid::cellSize() const
+{
+    return _cellSize;
+}
+
+const glm::ivec3& MacroCellGrid::size() const
+{
+    return _size;
+}
+
+const std::vector<float>& MacroCellGrid::maxAlpha() const
+{
+    return _maxAlpha;
+}
+
+float MacroCellGrid::emptyRatio() const
+{
+    int nbEmpty = 0;
+    for(float alpha : _maxAlpha)
+        if(alpha == 0.0f)
+            ++nbEmpty;
+
+    return nbEmpty / (float) _maxAlpha.size();
+}
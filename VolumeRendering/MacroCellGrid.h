@@ -0,0 +1,37 @@
+#ifndef VOLUME_RENDERING_MACRO_CELL_GRID_H
+#define VOLUME_RENDERING_MACRO_CELL_GRID_H
+
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+
+// Highest opacity each macro cell of cellSize^3 voxels can sample. Voxels
+// one past the sides of a cell count too, linear filtering reaches them.
+// Rays jump over the cells where it is zero.
+class MacroCellGrid
+{
+public:
+    MacroCellGrid(const glm::ivec3& dataSize, int cellSize);
+    virtual ~MacroCellGrid();
+
+    // Slices [firstSlice, firstSlice + nbSlices) of the optical values,
+    // dataSize.x * dataSize.y * nbSlices of them
+    void addSlices(int firstSlice, int nbSlices, const glm::vec4* optical);
+
+    int cellSize() const;
+    const glm::ivec3& size() const;
+    const std::vector<float>& maxAlpha() const;
+
+    // Ratio of the cells rays can skip
+    float emptyRatio() const;
+
+
+private:
+    glm::ivec3 _dataSize;
+    int _cellSize;
+    glm::ivec3 _size;
+    std::vector<float> _maxAlpha;
+};
+
+#endif //VOLUME_RENDERING_MACRO_CELL_GRID_H
@@ -0,0 +1,139 @@
+#include "ParallelSlabs.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+using namespace std;
+
+
+int slabThreadCount(int nbThreads)
+{
+    if(nbThreads > 0)
+        return nbThreads;
+
+    return glm::max(1, (int) thread::hardware_concurrency());
+}
+
+void forEachSlab(int nbThreads, int count,
+                 const std::function<void(int, int)>& task)
+{
+    // A few slabs per thread, some parts of a volume cost more than others
+    nbThreads = glm::max(1, glm::min(nbThreads, count));
+    int slabSize = glm::max(1, count / (nbThreads * 4));
+    atomic<int> nextIndex(0);
+
+    auto runSlabs = [&]() {
+        int begin;
+        while((begin = nextIndex.fetch_add(slabSize)) < count)
+            task(begin, glm::min(begin + slabSize, count));
+    };
+
+    vector<thread> workers;
+    for(int t=1; t < nbThreads; ++t)
+        workers.push_back(thread(runSlabs));
+
+    runSlabs();
+
+    for(thread& worker : workers)
+        worker.join();
+}
+
+
+SlabPool::SlabPool(int nbThreads) :
+    _workers(),
+    _terminating(false),
+    _task(nullptr),
+    _count(0),
+    _slabSize(1),
+    _generation(0),
+    _nbBusyWorkers(0),
+    _nextIndex(0)
+{
+    // The calling thread takes its share of the slabs
+    nbThreads = slabThreadCount(nbThreads);
+    for(int t=1; t < nbThreads; ++t)
+        _workers.push_back(thread(&SlabPool::workerLoop, this));
+}
+
+SlabPool::~SlabPool()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _terminating = true;
+    }
+    _jobReady.notify_all();
+
+    for(thread& worker : _workers)
+        worker.join();
+}
+
+int SlabPool::threadCount() const
+{
+    return (int) _workers.size() + 1;
+}
+
+void SlabPool::forEachSlab(int count,
+                           const std::function<void(int, int)>& task)
+{
+    if(_workers.empty() || count <= 1)
+    {
+        if(count > 0)
+            task(0, count);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _task = &task;
+        _count = count;
+        _slabSize = glm::max(1, count / (threadCount() * 4));
+        _nextIndex = 0;
+        _nbBusyWorkers = (int) _workers.size();
+        ++_generation;
+    }
+    _jobReady.notify_all();
+
+    runSlabs();
+
+    // Every worker is done with the task before the next call replaces it
+    unique_lock<mutex> lock(_mutex);
+    _jobDone.wait(lock, [this]{ return _nbBusyWorkers == 0; });
+    _task = nullptr;
+}
+
+void SlabPool::workerLoop()
+{
+    unsigned int seenGeneration = 0;
+
+    while(true)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _jobReady.wait(lock, [&]{
+                return _terminating || _generation != seenGeneration; });
+
+            if(_terminating)
+                return;
+
+            seenGeneration = _generation;
+        }
+
+        runSlabs();
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            if(--_nbBusyWorkers == 0)
+                _jobDone.notify_one();
+        }
+    }
+}
+
+void SlabPool::runSlabs()
+{
+    int begin;
+    while((begin = _nextIndex.fetch_add(_slabSize)) < _count)
+        (*_task)(begin, glm::min(begin + _slabSize, _count));
+}
@@ -0,0 +1,57 @@
+#ifndef VOLUME_RENDERING_PARALLEL_SLABS_H
+#define VOLUME_RENDERING_PARALLEL_SLABS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// One thread per hardware thread when nbThreads is 0
+int slabThreadCount(int nbThreads);
+
+// Calls task(begin, end) on slabs covering [0, count) from nbThreads
+// threads, the calling one included, returns once every slab is done
+void forEachSlab(int nbThreads, int count,
+                 const std::function<void(int, int)>& task);
+
+
+// Same split as forEachSlab(), with workers kept alive between calls for
+// the loops run many times in a row, like one per slice of a sweep
+class SlabPool
+{
+public:
+    // One thread per hardware thread when nbThreads is 0
+    SlabPool(int nbThreads = 0);
+    virtual ~SlabPool();
+
+    int threadCount() const;
+
+    // Returns once every slab is done
+    void forEachSlab(int count, const std::function<void(int, int)>& task);
+
+
+protected:
+    void workerLoop();
+    void runSlabs();
+
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _jobReady;
+    std::condition_variable _jobDone;
+    bool _terminating;
+
+    // Current job
+    const std::function<void(int, int)>* _task;
+    int _count;
+    int _slabSize;
+    unsigned int _generation;
+    int _nbBusyWorkers;
+    std::atomic<int> _nextIndex;
+};
+
+#endif //VOLUME_RENDERING_PARALLEL_SLABS_H
@@ -0,0 +1,183 @@
+#include "RawVolumeFile.h"
+
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+
+RawVolumeFile::RawVolumeFile() :
+    _file(),
+    _data(nullptr),
+    _size(0, 0, 0),
+    _format(ERawFormat::UINT8),
+    _offset(0.0f),
+    _scale(1.0f)
+{
+}
+
+RawVolumeFile::~RawVolumeFile()
+{
+    close();
+}
+
+bool RawVolumeFile::open(const std::string& fileName,
+                         const glm::ivec3& size,
+                         ERawFormat format)
+{
+    close();
+
+    int voxelBytes = 1;
+    switch(format)
+    {
+    case ERawFormat::UINT8 :   voxelBytes = 1; setRange(0.0f, 255.0f);   break;
+    case ERawFormat::UINT16 :  voxelBytes = 2; setRange(0.0f, 65535.0f); break;
+    case ERawFormat::FLOAT32 : voxelBytes = 4; setRange(0.0f, 1.0f);     break;
+    }
+
+    qint64 nbBytes = qint64(size.x) * size.y * size.z * voxelBytes;
+    if(size.x <= 0 || size.y <= 0 || size.z <= 0)
+    {
+        cerr << "Raw volume size is missing: " << fileName << endl;
+        return false;
+    }
+
+    _file.setFileName(QString::fromStdString(fileName));
+    if(!_file.open(QIODevice::ReadOnly))
+    {
+        cerr << "Could not open raw volume file: " << fileName << endl;
+        return false;
+    }
+
+    if(_file.size() < nbBytes)
+    {
+        cerr << "Raw volume file is smaller than "
+             << size.x << "x" << size.y << "x" << size.z
+             << " voxels: " << fileName << endl;
+        _file.close();
+        return false;
+    }
+
+    _data = _file.map(0, nbBytes);
+    if(_data == nullptr)
+    {
+        cerr << "Could not map raw volume file: " << fileName << endl;
+        _file.close();
+        return false;
+    }
+
+    _size = size;
+    _format = format;
+    return true;
+}
+
+void RawVolumeFile::close()
+{
+    if(_data != nullptr)
+    {
+        _file.unmap(const_cast<unsigned char*>(_data));
+        _data = nullptr;
+    }
+
+    if(_file.isOpen())
+        _file.close();
+}
+
+const glm::ivec3& RawVolumeFile::size() const
+{
+    return _size;
+}
+
+ERawFormat RawVolumeFile::format() const
+{
+    return _format;
+}
+
+void RawVolumeFile::setRange(float minValue, float maxValue)
+{
+    _offset = minValue;
+    _scale = maxValue > minValue ? 1.0f / (maxValue - minValue) : 1.0f;
+}
+
+float RawVolumeFile::normalize(float rawValue) const
+{
+    return glm::clamp((rawValue - _offset) * _scale, 0.0f, 1.0f);
+}
+
+void RawVolumeFile::rawRange(const glm::ivec3& from, const glm::ivec3& to,
+                             float& minValue, float& maxValue) const
+{
+    switch(_format)
+    {
+    case ERawFormat::UINT8 :
+        rawRangeOf<uint8_t>(from, to, minValue, maxValue); break;
+    case ERawFormat::UINT16 :
+        rawRangeOf<uint16_t>(from, to, minValue, maxValue); break;
+    case ERawFormat::FLOAT32 :
+        rawRangeOf<float>(from, to, minValue, maxValue); break;
+    }
+}
+
+void RawVolumeFile::readBlock(const glm::ivec3& origin, int extent,
+                              float* values) const
+{
+    switch(_format)
+    {
+    case ERawFormat::UINT8 :
+        readBlockOf<uint8_t>(origin, extent, values); break;
+    case ERawFormat::UINT16 :
+        readBlockOf<uint16_t>(origin, extent, values); break;
+    case ERawFormat::FLOAT32 :
+        readBlockOf<float>(origin, extent, values); break;
+    }
+}
+
+template<typename T>
+void RawVolumeFile::rawRangeOf(const glm::ivec3& from, const glm::ivec3& to,
+                               float& minValue, float& maxValue) const
+{
+    const T* voxels = reinterpret_cast<const T*>(_data);
+    T lowest = voxels[(size_t(from.z) * _size.y + from.y) * _size.x + from.x];
+    T highest = lowest;
+
+    for(int z=from.z; z < to.z; ++z)
+    {
+        for(int y=from.y; y < to.y; ++y)
+        {
+            const T* row = voxels + (size_t(z) * _size.y + y) * _size.x;
+            for(int x=from.x; x < to.x; ++x)
+            {
+                lowest = glm::min(lowest, row[x]);
+                highest = glm::max(highest, row[x]);
+            }
+        }
+    }
+
+    minValue = (float) lowest;
+    maxValue = (float) highest;
+}
+
+template<typename T>
+void RawVolumeFile::readBlockOf(const glm::ivec3& origin, int extent,
+                                float* values) const
+{
+    const T* voxels = reinterpret_cast<const T*>(_data);
+    glm::ivec3 last = _size - glm::ivec3(1);
+
+    for(int k=0; k < extent; ++k)
+    {
+        int z = glm::clamp(origin.z + k, 0, last.z);
+        for(int j=0; j < extent; ++j)
+        {
+            int y = glm::clamp(origin.y + j, 0, last.y);
+            const T* row = voxels + (size_t(z) * _size.y + y) * _size.x;
+            float* out = values + (k * extent + j) * extent;
+
+            for(int i=0; i < extent; ++i)
+            {
+                int x = glm::clamp(origin.x + i, 0, last.x);
+                out[i] = normalize((float) row[x]);
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef VOLUME_RENDERING_RAW_VOLUME_FILE_H
+#define VOLUME_RENDERING_RAW_VOLUME_FILE_H
+
+#include <string>
+
+#include <GLM/glm.hpp>
+
+#include <QFile>
+
+#include "VolumeSettings.h"
+
+
+// Voxels of a raw volume file mapped in memory, x fastest. The system
+// pages them in and out as they are read, the file can be larger than
+// the memory. Values read are normalized to [0, 1].
+class RawVolumeFile
+{
+public:
+    RawVolumeFile();
+    virtual ~RawVolumeFile();
+
+    bool open(const std::string& fileName,
+              const glm::ivec3& size,
+              ERawFormat format);
+    void close();
+
+    const glm::ivec3& size() const;
+    ERawFormat format() const;
+
+    // Values of integer volumes span their whole type, float ones
+    // have to be given the range they span
+    void setRange(float minValue, float maxValue);
+    float normalize(float rawValue) const;
+
+    // Extremes of the values of the voxels in [from, to), not normalized
+    void rawRange(const glm::ivec3& from, const glm::ivec3& to,
+                  float& minValue, float& maxValue) const;
+
+    // extent^3 normalized values from origin, x fastest. Voxels outside
+    // the volume take the value of the closest one inside.
+    void readBlock(const glm::ivec3& origin, int extent,
+                   float* values) const;
+
+
+protected:
+    template<typename T>
+    void rawRangeOf(const glm::ivec3& from, const glm::ivec3& to,
+                    float& minValue, float& maxValue) const;
+
+    template<typename T>
+    void readBlockOf(const glm::ivec3& origin, int extent,
+                     float* values) const;
+
+
+private:
+    QFile _file;
+    const unsigned char* _data;
+    glm::ivec3 _size;
+    ERawFormat _format;
+    float _offset;
+    float _scale;
+};
+
+#endif //VOLUME_RENDERING_RAW_VOLUME_FILE_H
@@ -0,0 +1,206 @@
+#include "TransmittanceVolume.h"
+
+#include <cmath>
+
+
+const int TransmittanceVolume::COARSE_DIVISOR = 4;
+
+
+TransmittanceVolume::TransmittanceVolume(const glm::ivec3& size,
+                                         int nbThreads) :
+    _pool(nbThreads),
+    _fine(),
+    _coarse(),
+    _lastCoarse(false)
+{
+    _fine.size = size;
+    _fine.depth.assign(size.x * size.y * size.z, 0.0f);
+    _fine.transmittance.assign(size.x * size.y * size.z, 1.0f);
+}
+
+TransmittanceVolume::~TransmittanceVolume()
+{
+
+}
+
+void TransmittanceVolume::addSlices(int firstSlice, int nbSlices,
+                                    const glm::vec4* optical)
+{
+    // Optical depth of one sample, opaque voxels still let a trace through
+    const float MAX_OPACITY = 0.999999f;
+
+    int first = firstSlice * _fine.size.x * _fine.size.y;
+    int count = nbSlices * _fine.size.x * _fine.size.y;
+    for(int i=0; i < count; ++i)
+    {
+        float opacity = glm::clamp(optical[i].w, 0.0f, MAX_OPACITY);
+        _fine.depth[first + i] = -std::log(1.0f - opacity);
+    }
+
+    _coarse = Grid();
+}
+
+void TransmittanceVolume::compute(const glm::vec3& lightPos, bool coarse)
+{
+    if(coarse && _coarse.depth.empty())
+        buildCoarseGrid();
+
+    _lastCoarse = coarse;
+    sweep(coarse ? _coarse : _fine, lightPos);
+}
+
+bool TransmittanceVolume::isCoarse() const
+{
+    return _lastCoarse;
+}
+
+const glm::ivec3& TransmittanceVolume::size() const
+{
+    return _lastCoarse ? _coarse.size : _fine.size;
+}
+
+const std::vector<float>& TransmittanceVolume::transmittance() const
+{
+    return _lastCoarse ? _coarse.transmittance : _fine.transmittance;
+}
+
+void TransmittanceVolume::buildCoarseGrid()
+{
+    // The sweep interpolates between two voxels at least per axis
+    const int D = COARSE_DIVISOR;
+    const glm::ivec3 fineSize = _fine.size;
+    const glm::ivec3 size = glm::max((fineSize + glm::ivec3(D - 1)) / D,
+                                     glm::ivec3(2));
+
+    _coarse.size = size;
+    _coarse.depth.assign(size.x * size.y * size.z, 0.0f);
+    _coarse.transmittance.assign(size.x * size.y * size.z, 1.0f);
+
+    // A coarse voxel stands for D samples of the ray marcher, each with the
+    // mean depth of the fine voxels it covers
+    _pool.forEachSlab(size.z, [&](int begin, int end) {
+        for(int z=begin; z < end; ++z)
+        {
+            for(int y=0; y < size.y; ++y)
+            {
+                for(int x=0; x < size.x; ++x)
+                {
+                    glm::ivec3 lo = glm::min(glm::ivec3(x, y, z) * D,
+                                             fineSize - glm::ivec3(1));
+                    glm::ivec3 hi = glm::min(lo + glm::ivec3(D), fineSize);
+
+                    double sum = 0.0;
+                    for(int fz=lo.z; fz < hi.z; ++fz)
+                        for(int fy=lo.y; fy < hi.y; ++fy)
+                            for(int fx=lo.x; fx < hi.x; ++fx)
+                                sum += _fine.depth[
+                                    (fz * fineSize.y + fy) * fineSize.x + fx];
+
+                    glm::ivec3 extent = hi - lo;
+                    int nbFine = extent.x * extent.y * extent.z;
+                    _coarse.depth[(z * size.y + y) * size.x + x] =
+                        float(sum / nbFine) * D;
+                }
+            }
+        }
+    });
+}
+
+void TransmittanceVolume::sweep(Grid& grid, const glm::vec3& lightPos)
+{
+    const glm::ivec3& size = grid.size;
+
+    // Voxel units, voxel centers on integers
+    glm::vec3 light = lightPos * glm::vec3(size) - glm::vec3(0.5f);
+    glm::vec3 toLight = light - (glm::vec3(size) - glm::vec3(1.0f)) * 0.5f;
+
+    // Sweep axis a, slices span axes b and c, c the closest in memory
+    int a = 0;
+    if(glm::abs(toLight.y) > glm::abs(toLight[a])) a = 1;
+    if(glm::abs(toLight.z) > glm::abs(toLight[a])) a = 2;
+    int b = a == 2 ? 1 : 2;
+    int c = a == 0 ? 1 : 0;
+
+    int strides[3] = {1, size.x, size.x * size.y};
+    int strideA = strides[a];
+    int strideB = strides[b];
+    int strideC = strides[c];
+    int nbB = size[b];
+    int nbC = size[c];
+    float lightB = light[b];
+    float lightC = light[c];
+
+    int towardLight = toLight[a] > 0.0f ? 1 : -1;
+    int firstSlice = towardLight > 0 ? size[a] - 1 : 0;
+
+    float* firstT = &grid.transmittance[firstSlice * strideA];
+    for(int vb=0; vb < nbB; ++vb)
+        for(int vc=0; vc < nbC; ++vc)
+            firstT[vb * strideB + vc * strideC] = 1.0f;
+
+    // Each slice waits for the previous one, the pool's workers stay
+    // up between them
+    for(int s=1; s < size[a]; ++s)
+    {
+        int slice = firstSlice - s * towardLight;
+        const float* prevT =
+            &grid.transmittance[(slice + towardLight) * strideA];
+        const float* prevD = &grid.depth[(slice + towardLight) * strideA];
+        float* sliceT = &grid.transmittance[slice * strideA];
+
+        // Offsets to the previous slice per unit along b and c
+        float scale = towardLight / (light[a] - slice);
+
+        _pool.forEachSlab(nbB, [&](int begin, int end) {
+            for(int vb=begin; vb < end; ++vb)
+            {
+                for(int vc=0; vc < nbC; ++vc)
+                {
+                    // Where the ray to the light crosses the previous slice
+                    float sb = (lightB - vb) * scale;
+                    float sc = (lightC - vc) * scale;
+                    float pb = vb + sb;
+                    float pc = vc + sc;
+
+                    float& transmittance = sliceT[vb * strideB + vc * strideC];
+                    if(pb < -0.5f || pb > nbB - 0.5f ||
+                       pc < -0.5f || pc > nbC - 0.5f)
+                    {
+                        // The ray leaves the volume on the way
+                        transmittance = 1.0f;
+                        continue;
+                    }
+
+                    pb = glm::clamp(pb, 0.0f, nbB - 1.0f);
+                    pc = glm::clamp(pc, 0.0f, nbC - 1.0f);
+                    int b0 = glm::min((int) pb, nbB - 2);
+                    int c0 = glm::min((int) pc, nbC - 2);
+                    float fb = pb - b0;
+                    float fc = pc - c0;
+
+                    int i00 = b0 * strideB + c0 * strideC;
+                    int i10 = i00 + strideB;
+                    int i01 = i00 + strideC;
+                    int i11 = i10 + strideC;
+
+                    float w00 = (1.0f - fb) * (1.0f - fc);
+                    float w10 = fb * (1.0f - fc);
+                    float w01 = (1.0f - fb) * fc;
+                    float w11 = fb * fc;
+
+                    float prevTransmittance =
+                            w00 * prevT[i00] + w10 * prevT[i10] +
+                            w01 * prevT[i01] + w11 * prevT[i11];
+                    float prevDepth =
+                            w00 * prevD[i00] + w10 * prevD[i10] +
+                            w01 * prevD[i01] + w11 * prevD[i11];
+
+                    // The ray marcher samples once per voxel length
+                    float nbSamples = std::sqrt(1.0f + sb*sb + sc*sc);
+                    transmittance = prevTransmittance *
+                            std::exp(-prevDepth * nbSamples);
+                }
+            }
+        });
+    }
+}
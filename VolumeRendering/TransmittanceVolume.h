@@ -0,0 +1,59 @@
+#ifndef VOLUME_RENDERING_TRANSMITTANCE_VOLUME_H
+#define VOLUME_RENDERING_TRANSMITTANCE_VOLUME_H
+
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include "ParallelSlabs.h"
+
+
+// Fraction of a point light reaching each voxel of a volume. Slices are
+// swept along the axis facing the light, from the closest one. Each voxel
+// continues the ray toward the light from where it crosses the previous
+// slice, the rows of a slice are shared between the threads of a pool
+// that lives as long as the volume.
+class TransmittanceVolume
+{
+public:
+    // One thread per hardware thread when nbThreads is 0
+    TransmittanceVolume(const glm::ivec3& size, int nbThreads = 0);
+    virtual ~TransmittanceVolume();
+
+    // Slices [firstSlice, firstSlice + nbSlices) of the optical values,
+    // size.x * size.y * nbSlices of them
+    void addSlices(int firstSlice, int nbSlices, const glm::vec4* optical);
+
+    // The light stands outside the volume, in its texture coordinates.
+    // A coarse sweep runs on a grid COARSE_DIVISOR times smaller per axis,
+    // for a quick estimate while the light moves.
+    void compute(const glm::vec3& lightPos, bool coarse = false);
+
+    // Of the last compute(), size() is that of its grid
+    bool isCoarse() const;
+    const glm::ivec3& size() const;
+    const std::vector<float>& transmittance() const;
+
+    static const int COARSE_DIVISOR;
+
+
+private:
+    struct Grid
+    {
+        glm::ivec3 size;
+        // Optical depth of a sample in each voxel, -log(1 - opacity)
+        std::vector<float> depth;
+        std::vector<float> transmittance;
+    };
+
+    void buildCoarseGrid();
+    void sweep(Grid& grid, const glm::vec3& lightPos);
+
+    SlabPool _pool;
+    Grid _fine;
+    // Built from the fine one on the first coarse sweep
+    Grid _coarse;
+    bool _lastCoarse;
+};
+
+#endif //VOLUME_RENDERING_TRANSMITTANCE_VOLUME_H
@@ -1,6 +1,8 @@
 #include "Visualizer.h"
 
+#include <chrono>
 #include <cmath>
+#include <iostream>
 
 #include <GLM/gtc/matrix_transform.hpp>
 
@@ -19,21 +21,63 @@
 #include <Scaena/StageManagement/Event/MouseEvent.h>
 #include <Scaena/StageManagement/Event/SynchronousMouse.h>
 
+#include "MacroCellGrid.h"
+#include "Voxelizer.h"
+
+using namespace std;
 using namespace cellar;
 using namespace scaena;
 
 
-Visualizer::Visualizer() :
+namespace
+{
+    // Progressive rendering levels, from the one used while the mouse
+    // moves the camera or the light up to the full quality
+    struct RenderQuality
+    {
+        int resolutionDivisor;
+        float stepScale;
+    };
+
+    const RenderQuality QUALITY_LEVELS[] = {
+        {4, 2.0f},
+        {2, 1.0f},
+        {1, 1.0f}
+    };
+    const int NB_QUALITY_LEVELS = 3;
+
+    // Transfer function of raw volumes, from the bottom of the window
+    // to its top
+    const glm::vec3 RAW_LOW_COLOR(0.9f, 0.55f, 0.3f);
+    const glm::vec3 RAW_HIGH_COLOR(1.0f, 0.95f, 0.85f);
+    const float RAW_OPACITY = 0.25f;
+
+    // Steps of one voxel along the longest side of the volume
+    float voxelLength(const glm::ivec3& size)
+    {
+        return 1.0f / glm::max(glm::max(size.x, size.y), size.z);
+    }
+}
+
+
+Visualizer::Visualizer(const VolumeSettings& settings) :
     Character("Visualizer"),
+    _settings(settings),
     _skyBoxRenderer(),
     _dataRenderer(),
     _dataBox(),
     _skyBox(),
     _backgroundColor(0.0, 0.0, 0.0),
-    _dataSize(128, 128, 128),
+    _dataSize(settings.dataSize),
+    _imageFbo(0),
+    _imageTex(0),
+    _imageSize(0, 0),
+    _imageRegion(0, 0),
+    _imageLevel(-1),
     _projection(),
     _view(),
     _eye(0.0, 0.5, 3.0),
+    _eyePos(),
     _shell(),
     _boil(),
     _sinNoise(),
@@ -43,7 +87,12 @@ Visualizer::Visualizer() :
            glm::vec3(1.0, 1.0, 0.0),       // Light Color
            100.0f,                     // Shininess
            0.1f,                       // Ambient Contribution
-           false),                     // Compute shadows
+           true),                      // Compute shadows
+    _transmittance(),
+    _transmittanceDirty(false),
+    _transmittanceSize(0, 0, 0),
+    _rawFile(),
+    _bricks(),
     _moveLight(false),
     _moveCamera(false)
 {
@@ -64,7 +113,8 @@ void Visualizer::enterStage()
                  _backgroundColor.z,
                  0.0);
 
-    initVolumes();
+    if(_settings.rawFile.empty() || !initBricks())
+        initVolumes();
     initCubeMap();
 
     GlVbo3Df dataBoxVertices = getBoxVertices(glm::vec3(0, 0, 0), glm::vec3(1, 1, 1));
@@ -81,18 +131,43 @@ void Visualizer::enterStage()
     dataRendererInOut.setOutput(0, "Fragment");
     _dataRenderer.setInAndOutLocations(dataRendererInOut);
     _dataRenderer.addShader(GL_VERTEX_SHADER,   ":/VolumeRendering/shaders/render.vert");
-    _dataRenderer.addShader(GL_FRAGMENT_SHADER, ":/VolumeRendering/shaders/render.frag");
+    if(_bricks)
+        _dataRenderer.addShader(GL_FRAGMENT_SHADER, ":/VolumeRendering/shaders/render_bricked.frag");
+    else
+        _dataRenderer.addShader(GL_FRAGMENT_SHADER, ":/VolumeRendering/shaders/render.frag");
     _dataRenderer.link();
     _dataRenderer.pushProgram();
-    _dataRenderer.setInt("OpticalSampler",   0);
-    _dataRenderer.setInt("MaterialSampler",  1);
     _dataRenderer.setInt("EnvironmentSampler", 2);
-    _dataRenderer.setVec3f("BackgroundColor", _backgroundColor);
     _dataRenderer.setVec3f("LightColor",   _light.color);
     _dataRenderer.setFloat("LightShine",   _light.shininess);
     _dataRenderer.setFloat("LightAmbient", _light.ambientContribution);
-    _dataRenderer.setInt("ComputeShadow",  _light.isCastingShadows);
-    _dataRenderer.setFloat("ds", 1.0f / _dataSize.x);
+    _dataRenderer.setFloat("ds", voxelLength(_dataSize));
+    _dataRenderer.setFloat("StepScale", 1.0f);
+    _dataRenderer.setInt("CountSamples", false);
+    if(_bricks)
+    {
+        _dataRenderer.setInt("BrickAtlas", 0);
+        _dataRenderer.setInt("PageTable",  3);
+        _dataRenderer.setVec3f("VolumeSize", glm::vec3(_dataSize));
+        _dataRenderer.setFloat("BrickSize", (float) _bricks->brickSize());
+        _dataRenderer.setVec3f("AtlasSize", glm::vec3(_bricks->atlasSize()));
+        _dataRenderer.setVec2f("TransferWindow", _settings.transferWindow);
+        _dataRenderer.setFloat("TransferOpacity", RAW_OPACITY);
+        _dataRenderer.setVec3f("LowColor",  RAW_LOW_COLOR);
+        _dataRenderer.setVec3f("HighColor", RAW_HIGH_COLOR);
+    }
+    else
+    {
+        _dataRenderer.setInt("OpticalSampler",   0);
+        _dataRenderer.setInt("MaterialSampler",  1);
+        _dataRenderer.setInt("MacroCellSampler", 3);
+        _dataRenderer.setInt("TransmittanceSampler", 4);
+        _dataRenderer.setVec3f("BackgroundColor", _backgroundColor);
+        _dataRenderer.setInt("ComputeShadow",  _light.isCastingShadows);
+        _dataRenderer.setVec3f("MacroCellScale",
+            glm::vec3(_dataSize) / (float) _settings.macroCellSize);
+        _dataRenderer.setInt("SkipEmptySpace", _settings.skipEmptySpace);
+    }
     _dataRenderer.popProgram();
 
     GlInputsOutputs envRendererInOut;
@@ -114,8 +189,37 @@ void Visualizer::enterStage()
         (float) viewport.y,
         0.1f, 10.0f);
 
+    if(_settings.progressive)
+        initImage();
+
     updateMatrices();
     updateLightPos();
+
+    if(_transmittance)
+    {
+        typedef chrono::high_resolution_clock clock;
+        clock::time_point sweepStart = clock::now();
+        updateTransmittance();
+        cout << "Light transmittance swept in "
+             << chrono::duration<double, milli>(clock::now() - sweepStart).count()
+             << " ms" << endl;
+    }
+
+    if(_bricks)
+    {
+        // The bricks closest to the eye are all there for the first frame
+        typedef chrono::high_resolution_clock clock;
+        clock::time_point loadStart = clock::now();
+        while(_bricks->update(_eyePos));
+        cout << _bricks->residentBrickCount() << " of "
+             << _bricks->visibleBrickCount() << " visible bricks loaded in "
+             << chrono::duration<double, milli>(clock::now() - loadStart).count()
+             << " ms" << endl;
+    }
+
+    // Raw volumes always skip their transparent bricks
+    if(_settings.reportSamples && !_bricks)
+        reportSamplesPerRay();
 }
 
 cellar::GlVbo3Df Visualizer::getBoxVertices(const glm::vec3& from, const glm::vec3& to)
@@ -170,30 +274,6 @@ cellar::GlVbo3Df Visualizer::getBoxVertices(const glm::vec3& from, const glm::ve
 
 void Visualizer::initVolumes()
 {
-    int nbVoxels = _dataSize.x * _dataSize.y * _dataSize.z;
-    float ds = 1.0f / _dataSize.x;
-
-    std::vector<glm::vec4> optValues(nbVoxels);
-    std::vector<glm::vec4> matValues(nbVoxels);
-    int idx = 0;
-    for(int k=0; k<_dataSize.z; ++k)
-    {
-        for(int j=0; j<_dataSize.y; ++j)
-        {
-            for(int i=0; i<_dataSize.x; ++i)
-            {
-                float x = i / (float) _dataSize.x;
-                float y = j / (float) _dataSize.y;
-                float z = k / (float) _dataSize.z;
-
-                optValues[idx] = _volume.opticalAt(x, y, z, ds);
-                matValues[idx] = _volume.materialAt(x, y, z, ds);
-                ++idx;
-            }
-        }
-    }
-
-
     glGenTextures(1, &_optTex);
     glBindTexture(GL_TEXTURE_3D, _optTex);
     glTexImage3D(
@@ -206,7 +286,7 @@ void Visualizer::initVolumes()
         0,
         GL_RGBA,
         GL_FLOAT,
-        optValues.data());
+        nullptr);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -226,12 +306,147 @@ void Visualizer::initVolumes()
         0,
         GL_RGBA,
         GL_FLOAT,
-        matValues.data());
+        nullptr);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+
+    // Blocks of slices are voxelized then uploaded, the whole volume
+    // is never held in memory
+    const int BLOCK_SLICES = 32;
+    int blockSlices = glm::min(BLOCK_SLICES, _dataSize.z);
+    int nbBlockVoxels = _dataSize.x * _dataSize.y * blockSlices;
+    std::vector<glm::vec4> optValues(nbBlockVoxels);
+    std::vector<glm::vec4> matValues(nbBlockVoxels);
+
+    typedef chrono::high_resolution_clock clock;
+    clock::duration voxelizeTime(0);
+    clock::duration uploadTime(0);
+    Voxelizer voxelizer(_volume, _dataSize, _settings.nbThreads);
+    MacroCellGrid macroCells(_dataSize, _settings.macroCellSize);
+    if(_light.isCastingShadows)
+    {
+        _transmittance.reset(
+            new TransmittanceVolume(_dataSize, _settings.nbThreads));
+    }
+
+    for(int first=0; first < _dataSize.z; first += blockSlices)
+    {
+        int nbSlices = glm::min(blockSlices, _dataSize.z - first);
+
+        clock::time_point voxelizeStart = clock::now();
+        voxelizer.voxelize(first, nbSlices, optValues.data(), matValues.data());
+        macroCells.addSlices(first, nbSlices, optValues.data());
+        if(_transmittance)
+            _transmittance->addSlices(first, nbSlices, optValues.data());
+        clock::time_point uploadStart = clock::now();
+
+        glBindTexture(GL_TEXTURE_3D, _optTex);
+        glTexSubImage3D(GL_TEXTURE_3D, 0,
+                        0, 0, first,
+                        _dataSize.x, _dataSize.y, nbSlices,
+                        GL_RGBA, GL_FLOAT, optValues.data());
+        glBindTexture(GL_TEXTURE_3D, _matTex);
+        glTexSubImage3D(GL_TEXTURE_3D, 0,
+                        0, 0, first,
+                        _dataSize.x, _dataSize.y, nbSlices,
+                        GL_RGBA, GL_FLOAT, matValues.data());
+        glFinish();
+
+        voxelizeTime += uploadStart - voxelizeStart;
+        uploadTime += clock::now() - uploadStart;
+    }
+
+    glm::ivec3 cellsSize = macroCells.size();
+    glGenTextures(1, &_macroCellTex);
+    glBindTexture(GL_TEXTURE_3D, _macroCellTex);
+    glTexImage3D(
+        GL_TEXTURE_3D,
+        0,
+        GL_R32F,
+        cellsSize.x,
+        cellsSize.y,
+        cellsSize.z,
+        0,
+        GL_RED,
+        GL_FLOAT,
+        macroCells.maxAlpha().data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // Filled by updateTransmittance() once the light is placed
+    glGenTextures(1, &_transmittanceTex);
+    glBindTexture(GL_TEXTURE_3D, _transmittanceTex);
+    glTexImage3D(
+        GL_TEXTURE_3D,
+        0,
+        GL_R32F,
+        _dataSize.x,
+        _dataSize.y,
+        _dataSize.z,
+        0,
+        GL_RED,
+        GL_FLOAT,
+        nullptr);
+    _transmittanceSize = _dataSize;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    typedef chrono::duration<double, milli> ms;
+    cout << "Volume of " << _dataSize.x << "x" << _dataSize.y << "x"
+         << _dataSize.z << " voxelized in "
+         << chrono::duration_cast<ms>(voxelizeTime).count() << " ms on "
+         << voxelizer.threadCount() << " threads, uploaded in "
+         << chrono::duration_cast<ms>(uploadTime).count() << " ms, "
+         << (int) (macroCells.emptyRatio() * 100.0f)
+         << "% of the macro cells are empty" << endl;
+}
+
+bool Visualizer::initBricks()
+{
+    if(!_rawFile.open(_settings.rawFile, _settings.rawSize, _settings.rawFormat))
+    {
+        cerr << "Rendering the procedural volume instead" << endl;
+        return false;
+    }
+
+    typedef chrono::high_resolution_clock clock;
+    clock::time_point scanStart = clock::now();
+
+    _bricks.reset(new BrickedVolume(_rawFile,
+                                    _settings.brickSize,
+                                    _settings.brickCacheMb,
+                                    _settings.nbThreads));
+    if(!_bricks->initialize(_settings.transferWindow.x))
+    {
+        cerr << "Rendering the procedural volume instead" << endl;
+        _bricks->terminate();
+        _bricks.reset();
+        _rawFile.close();
+        return false;
+    }
+
+    _dataSize = _rawFile.size();
+
+    const glm::ivec3& atlasSize = _bricks->atlasSize();
+    cout << "Raw volume of " << _dataSize.x << "x" << _dataSize.y << "x"
+         << _dataSize.z << " scanned in "
+         << chrono::duration<double, milli>(clock::now() - scanStart).count()
+         << " ms, " << _bricks->visibleBrickCount() << " visible bricks, "
+         << _bricks->slotCount() << " fit in an atlas of "
+         << atlasSize.x << "x" << atlasSize.y << "x" << atlasSize.z
+         << " voxels" << endl;
+
+    return true;
 }
 
 void Visualizer::initCubeMap()
@@ -280,6 +495,24 @@ void Visualizer::initCubeMap()
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+void Visualizer::initImage()
+{
+    _imageSize = play().view()->viewport();
+
+    glGenTextures(1, &_imageTex);
+    glBindTexture(GL_TEXTURE_2D, _imageTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _imageSize.x, _imageSize.y,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenFramebuffers(1, &_imageFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _imageFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, _imageTex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void Visualizer::beginStep(const StageTime &time)
 {
 }
@@ -289,16 +522,40 @@ void Visualizer::draw(const std::shared_ptr<scaena::View> &,
 {
     _fps->setText("FPS: " + toString(floor(time.framesPerSecond())));
 
+    // Mouse moves can place the light several times between two frames
+    if(_transmittanceDirty)
+        updateTransmittance();
+
+    // Bricks still missing are skipped until they are loaded
+    bool bricksChanged = _bricks && _bricks->update(_eyePos);
 
+    if(!_settings.progressive)
+    {
+        drawScene();
+        return;
+    }
+
+    // Coarse frames while the mouse moves things, then one level finer
+    // per frame, the image is only shown again once it is complete
+    int level = _imageLevel;
+    if(level < 0)
+        level = 0;
+    else if(!_moveLight && !_moveCamera)
+        level = glm::min(level + 1, NB_QUALITY_LEVELS - 1);
+
+    if(level != _imageLevel || bricksChanged)
+        renderImage(level);
+
+    presentImage();
+}
+
+void Visualizer::drawScene()
+{
     glDisable(GL_MULTISAMPLE);
     glEnable(GL_TEXTURE_CUBE_MAP);
 
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_CUBE_MAP, _skyBoxTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, _matTex);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, _optTex);
 
     glEnable(GL_CULL_FACE);
 
@@ -315,6 +572,59 @@ void Visualizer::draw(const std::shared_ptr<scaena::View> &,
     _skyBox.unbind();
     _skyBoxRenderer.popProgram();
 
+    drawData();
+}
+
+void Visualizer::renderImage(int level)
+{
+    const RenderQuality& quality = QUALITY_LEVELS[level];
+    _imageRegion = glm::max(_imageSize / quality.resolutionDivisor,
+                            glm::ivec2(1));
+
+    _dataRenderer.pushProgram();
+    _dataRenderer.setFloat("ds", quality.stepScale * voxelLength(_dataSize));
+    _dataRenderer.setFloat("StepScale", quality.stepScale);
+    _dataRenderer.popProgram();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _imageFbo);
+    glViewport(0, 0, _imageRegion.x, _imageRegion.y);
+    drawScene();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, _imageSize.x, _imageSize.y);
+
+    _imageLevel = level;
+}
+
+void Visualizer::presentImage()
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _imageFbo);
+    glBlitFramebuffer(0, 0, _imageRegion.x, _imageRegion.y,
+                      0, 0, _imageSize.x, _imageSize.y,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Visualizer::drawData()
+{
+    if(_bricks)
+    {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, _bricks->pageTableTex());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, _bricks->atlasTex());
+    }
+    else
+    {
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_3D, _transmittanceTex);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, _macroCellTex);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, _matTex);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, _optTex);
+    }
+
     _dataRenderer.pushProgram();
     _dataBox.bind();
     glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -322,9 +632,74 @@ void Visualizer::draw(const std::shared_ptr<scaena::View> &,
     _dataRenderer.popProgram();
 }
 
-void Visualizer::exitStage()
+void Visualizer::reportSamplesPerRay()
 {
+    glm::ivec2 viewport = play().view()->viewport();
+
+    // Sample count and ray count of each pixel
+    GLuint countTex = 0;
+    glGenTextures(1, &countTex);
+    glBindTexture(GL_TEXTURE_2D, countTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, viewport.x, viewport.y,
+                 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLuint countFbo = 0;
+    glGenFramebuffers(1, &countFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, countFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, countTex, 0);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    _dataRenderer.pushProgram();
+    _dataRenderer.setInt("CountSamples", true);
+    _dataRenderer.popProgram();
 
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    std::vector<glm::vec2> counts(viewport.x * viewport.y);
+    double samplesPerRay[2] = {0.0, 0.0};
+    for(int skip=0; skip < 2; ++skip)
+    {
+        _dataRenderer.pushProgram();
+        _dataRenderer.setInt("SkipEmptySpace", skip);
+        _dataRenderer.popProgram();
+
+        glClearBufferfv(GL_COLOR, 0, zero);
+        drawData();
+        glReadPixels(0, 0, viewport.x, viewport.y,
+                     GL_RG, GL_FLOAT, counts.data());
+
+        double nbSamples = 0.0;
+        double nbRays = 0.0;
+        for(const glm::vec2& count : counts)
+        {
+            nbSamples += count.x;
+            nbRays += count.y;
+        }
+        samplesPerRay[skip] = nbSamples / glm::max(nbRays, 1.0);
+    }
+
+    _dataRenderer.pushProgram();
+    _dataRenderer.setInt("CountSamples", false);
+    _dataRenderer.setInt("SkipEmptySpace", _settings.skipEmptySpace);
+    _dataRenderer.popProgram();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &countFbo);
+    glDeleteTextures(1, &countTex);
+
+    cout << "Samples per ray: " << samplesPerRay[0]
+         << " without empty space skipping, "
+         << samplesPerRay[1] << " with it" << endl;
+}
+
+void Visualizer::exitStage()
+{
+    if(_bricks)
+        _bricks->terminate();
 }
 
 bool Visualizer::mousePressEvent(const MouseEvent& event)
@@ -348,6 +723,10 @@ bool Visualizer::mouseReleaseEvent(const MouseEvent& event)
     default: break;
     }
 
+    // The finer frames need the full resolution shadows
+    if(_transmittance && _transmittance->isCoarse())
+        _transmittanceDirty = true;
+
     return true;
 }
 
@@ -382,6 +761,7 @@ void Visualizer::updateMatrices()
     glm::vec3 from = glm::vec3(from4);
 
     _view = glm::lookAt(from, glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
+    _eyePos = from + glm::vec3(0.5f);
     glm::mat4 projectionView = _projection * _view;
 
     _dataRenderer.pushProgram();
@@ -393,6 +773,8 @@ void Visualizer::updateMatrices()
     _skyBoxRenderer.setMat4f("ProjectionMatrix", _projection);
     _skyBoxRenderer.setMat4f("ViewMatrix", _view);
     _skyBoxRenderer.popProgram();
+
+    _imageLevel = -1;
 }
 
 void Visualizer::updateLightPos()
@@ -400,8 +782,40 @@ void Visualizer::updateLightPos()
     glm::vec4 pos = glm::rotate(glm::mat4(), _light.position.x, glm::vec3(0.0f, 0.0f, 1.0f)) *
                     glm::rotate(glm::mat4(), _light.position.y, glm::vec3(1.0f, 0.0f, 0.0f)) *
                     glm::vec4(0.0f, _light.position.z, 0.0f, 0.0f);
+    _lgt = glm::vec3(pos);
 
     _dataRenderer.pushProgram();
-    _dataRenderer.setVec3f("LightPos", glm::vec3(pos));
+    _dataRenderer.setVec3f("LightPos", _lgt);
     _dataRenderer.popProgram();
+
+    _transmittanceDirty = (bool) _transmittance;
+    _imageLevel = -1;
+}
+
+void Visualizer::updateTransmittance()
+{
+    // Coarse sweeps while the light is dragged, like the coarse frames,
+    // the full one once it is released
+    bool coarse = _settings.progressive && _moveLight;
+    _transmittance->compute(_lgt, coarse);
+
+    // The texture is sampled in texture coordinates, it can shrink
+    const glm::ivec3& size = _transmittance->size();
+    const float* data = _transmittance->transmittance().data();
+    glBindTexture(GL_TEXTURE_3D, _transmittanceTex);
+    if(size != _transmittanceSize)
+    {
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, size.x, size.y, size.z,
+                     0, GL_RED, GL_FLOAT, data);
+        _transmittanceSize = size;
+    }
+    else
+    {
+        glTexSubImage3D(GL_TEXTURE_3D, 0,
+                        0, 0, 0,
+                        size.x, size.y, size.z,
+                        GL_RED, GL_FLOAT, data);
+    }
+
+    _transmittanceDirty = false;
 }
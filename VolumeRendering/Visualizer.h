@@ -1,6 +1,8 @@
 #ifndef VOLUME_RENDERING_VISUALIZER_H
 #define VOLUME_RENDERING_VISUALIZER_H
 
+#include <memory>
+
 #include <CellarWorkbench/GL/GlProgram.h>
 #include <CellarWorkbench/GL/GlVao.h>
 
@@ -10,13 +12,17 @@
 
 #include "Volumes.h"
 #include "Lights.h"
+#include "VolumeSettings.h"
+#include "TransmittanceVolume.h"
+#include "RawVolumeFile.h"
+#include "BrickedVolume.h"
 
 
 class Visualizer :
         public scaena::Character
 {
 public:
-    Visualizer();
+    Visualizer(const VolumeSettings& settings);
     virtual ~Visualizer();
 
     virtual void enterStage() override;
@@ -31,14 +37,27 @@ public:
 
     virtual void updateMatrices();
     virtual void updateLightPos();
+    // Sweeps the light through the volume again, once per light move
+    virtual void updateTransmittance();
 
 protected:
     virtual cellar::GlVbo3Df getBoxVertices(const glm::vec3& from,
                                            const glm::vec3& to);
     virtual void initVolumes();
+    // Maps the raw volume file of the settings, false when it can't
+    virtual bool initBricks();
     virtual void initCubeMap();
+    virtual void initImage();
+    virtual void drawScene();
+    virtual void drawData();
+    // Renders the scene into the cached image at a quality level
+    virtual void renderImage(int level);
+    virtual void presentImage();
+    // Average samples per ray with and without empty space skipping
+    virtual void reportSamplesPerRay();
 
 private:
+    VolumeSettings _settings;
     std::shared_ptr<prop2::TextHud> _fps;
     cellar::GlProgram _skyBoxRenderer;
     cellar::GlProgram _dataRenderer;
@@ -49,12 +68,24 @@ private:
     glm::ivec3 _dataSize;
     unsigned int _optTex;
     unsigned int _matTex;
+    unsigned int _macroCellTex;
+    unsigned int _transmittanceTex;
     unsigned int _skyBoxTex;
 
+    // Last rendered image, its used part and its quality level,
+    // -1 once the camera or the light moved
+    unsigned int _imageFbo;
+    unsigned int _imageTex;
+    glm::ivec2 _imageSize;
+    glm::ivec2 _imageRegion;
+    int _imageLevel;
+
     glm::mat4 _projection;
     glm::mat4 _view;
     glm::vec3 _eye;
     glm::vec3 _lgt;
+    // Camera position in the texture coordinates of the volume
+    glm::vec3 _eyePos;
 
     Shell _shell;
     Boil  _boil;
@@ -62,6 +93,12 @@ private:
     BallFloor _ballFloor;
     IVolume& _volume;
     Light _light;
+    std::unique_ptr<TransmittanceVolume> _transmittance;
+    bool _transmittanceDirty;
+    // Of the texture, smaller after a coarse sweep
+    glm::ivec3 _transmittanceSize;
+    RawVolumeFile _rawFile;
+    std::unique_ptr<BrickedVolume> _bricks;
 
     bool _moveLight;
     bool _moveCamera;
@@ -0,0 +1,118 @@
+#include "VolumeSettings.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+
+const int VolumeSettings::MIN_DATA_SIZE = 16;
+const int VolumeSettings::MAX_DATA_SIZE = 1024;
+const int VolumeSettings::MAX_MACRO_CELL_SIZE = 64;
+const int VolumeSettings::MAX_BRICK_SIZE = 126;
+
+
+VolumeSettings::VolumeSettings() :
+    dataSize(128, 128, 128),
+    nbThreads(0),
+    skipEmptySpace(true),
+    macroCellSize(8),
+    reportSamples(false),
+    progressive(true),
+    rawFile(),
+    rawSize(0, 0, 0),
+    rawFormat(ERawFormat::UINT8),
+    brickSize(32),
+    brickCacheMb(256),
+    transferWindow(0.1f, 1.0f)
+{
+}
+
+void VolumeSettings::parseArguments(int argc, char* argv[])
+{
+    for(int i=1; i < argc; ++i)
+    {
+        string arg = argv[i];
+
+        if(arg == "--volume-size" && i+1 < argc)
+        {
+            // Cubic, the render shader steps by the voxel size along x
+            int size = atoi(argv[++i]);
+            int clamped = glm::clamp(size, MIN_DATA_SIZE, MAX_DATA_SIZE);
+            dataSize = glm::ivec3(clamped);
+
+            if(clamped != size)
+                cerr << "Volume size clamped to " << clamped << endl;
+        }
+        else if(arg == "--volume-threads" && i+1 < argc)
+        {
+            nbThreads = glm::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--volume-no-skipping")
+        {
+            skipEmptySpace = false;
+        }
+        else if(arg == "--volume-macro-cell" && i+1 < argc)
+        {
+            macroCellSize = glm::clamp(atoi(argv[++i]), 2, MAX_MACRO_CELL_SIZE);
+        }
+        else if(arg == "--volume-ray-stats")
+        {
+            reportSamples = true;
+        }
+        else if(arg == "--volume-no-progressive")
+        {
+            progressive = false;
+        }
+        else if(arg == "--volume-raw" && i+1 < argc)
+        {
+            rawFile = argv[++i];
+        }
+        else if(arg == "--volume-raw-size" && i+1 < argc)
+        {
+            // "256x256x128"
+            string value = argv[++i];
+            size_t sep1 = value.find('x');
+            size_t sep2 = sep1 == string::npos ?
+                          string::npos : value.find('x', sep1+1);
+
+            if(sep2 == string::npos)
+            {
+                cerr << "Raw volume size must look like 256x256x128: "
+                     << value << endl;
+            }
+            else
+            {
+                rawSize.x = atoi(value.substr(0, sep1).c_str());
+                rawSize.y = atoi(value.substr(sep1+1, sep2-sep1-1).c_str());
+                rawSize.z = atoi(value.substr(sep2+1).c_str());
+            }
+        }
+        else if(arg == "--volume-raw-format" && i+1 < argc)
+        {
+            string value = argv[++i];
+            if(value == "u8")
+                rawFormat = ERawFormat::UINT8;
+            else if(value == "u16")
+                rawFormat = ERawFormat::UINT16;
+            else if(value == "f32")
+                rawFormat = ERawFormat::FLOAT32;
+            else
+                cerr << "Unknown raw volume format: " << value << endl;
+        }
+        else if(arg == "--volume-brick-size" && i+1 < argc)
+        {
+            brickSize = glm::clamp(atoi(argv[++i]), 8, MAX_BRICK_SIZE);
+        }
+        else if(arg == "--volume-brick-cache" && i+1 < argc)
+        {
+            brickCacheMb = glm::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--volume-transfer" && i+2 < argc)
+        {
+            transferWindow.x = (float) atof(argv[++i]);
+            transferWindow.y = (float) atof(argv[++i]);
+        }
+    }
+}
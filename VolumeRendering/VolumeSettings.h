@@ -0,0 +1,59 @@
+#ifndef VOLUME_RENDERING_VOLUME_SETTINGS_H
+#define VOLUME_RENDERING_VOLUME_SETTINGS_H
+
+#include <string>
+
+#include <GLM/glm.hpp>
+
+
+// Voxel type of raw volume files, native endianness
+enum class ERawFormat
+{
+    UINT8,
+    UINT16,
+    FLOAT32
+};
+
+class VolumeSettings
+{
+public:
+    VolumeSettings();
+
+    // Picks the --volume-* options, other arguments are left to Qt
+    void parseArguments(int argc, char* argv[]);
+
+    glm::ivec3 dataSize;
+
+    // Voxelization threads, 0 for one per hardware thread
+    int nbThreads;
+
+    // Rays jump over the macro cells of macroCellSize^3 voxels that are
+    // empty. The average number of samples per ray with and without
+    // skipping is printed at startup when asked.
+    bool skipEmptySpace;
+    int macroCellSize;
+    bool reportSamples;
+
+    // Frames are rendered coarser while the mouse moves the camera or the
+    // light, then refined one level per frame. Still frames are shown
+    // again from the last image.
+    bool progressive;
+
+    // Raw volume file rendered instead of the procedural volumes when
+    // set, x fastest. Bricks of brickSize^3 voxels are loaded as needed
+    // into a cache of brickCacheMb. Values under the window are
+    // transparent, the ones above are the most opaque.
+    std::string rawFile;
+    glm::ivec3 rawSize;
+    ERawFormat rawFormat;
+    int brickSize;
+    int brickCacheMb;
+    glm::vec2 transferWindow;
+
+    static const int MIN_DATA_SIZE;
+    static const int MAX_DATA_SIZE;
+    static const int MAX_MACRO_CELL_SIZE;
+    static const int MAX_BRICK_SIZE;
+};
+
+#endif //VOLUME_RENDERING_VOLUME_SETTINGS_H
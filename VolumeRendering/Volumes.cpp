@@ -5,6 +5,11 @@
 using namespace cellar;
 
 
+IVolume::~IVolume()
+{
+
+}
+
 void IVolume::clamp(float& x, float& y, float& z)
 {
     x = glm::clamp(x, 0.0f, 1.0f);
@@ -23,6 +28,59 @@ glm::vec4 IVolume::materialAt(float x, float y, float z, float ds)
             densityAt(x, y ,z, ds));
 }
 
+void IVolume::evaluateMaterial(const VoxelSpan& span,
+                               const DensityStencil& density,
+                               glm::vec4* material)
+{
+    const float* c = density.center;
+    for(int i=0; i < span.count; ++i)
+    {
+        material[i] = glm::vec4(
+                    glm::normalize(
+                        glm::vec3(
+                c[i+1] - c[i-1],
+                density.yNext[i] - density.yPrev[i],
+                density.zNext[i] - density.zPrev[i])),
+                c[i]);
+    }
+}
+
+
+// ProceduralVolume
+template<typename Volume>
+glm::vec4 ProceduralVolume<Volume>::opticalAt(float x, float y, float z, float ds)
+{
+    Volume& volume = static_cast<Volume&>(*this);
+    return glm::vec4(volume.Volume::colorAt(x, y, z),
+                     volume.Volume::densityAt(x, y, z, ds));
+}
+
+template<typename Volume>
+void ProceduralVolume<Volume>::evaluateDensity(const VoxelSpan& span,
+                                               float* density)
+{
+    Volume& volume = static_cast<Volume&>(*this);
+    for(int i=0; i < span.count; ++i)
+    {
+        float x = span.x + i * span.ds;
+        density[i] = volume.Volume::densityAt(x, span.y, span.z, span.ds);
+    }
+}
+
+template<typename Volume>
+void ProceduralVolume<Volume>::evaluateOptical(const VoxelSpan& span,
+                                               const float* density,
+                                               glm::vec4* optical)
+{
+    Volume& volume = static_cast<Volume&>(*this);
+    for(int i=0; i < span.count; ++i)
+    {
+        float x = span.x + i * span.ds;
+        optical[i] = glm::vec4(volume.Volume::colorAt(x, span.y, span.z),
+                               density[i]);
+    }
+}
+
 
 // Shell
 Shell::Shell() :
@@ -31,13 +89,12 @@ Shell::Shell() :
 
 }
 
-glm::vec4 Shell::opticalAt(float x, float y, float z, float ds)
+glm::vec3 Shell::colorAt(float x, float y, float z)
 {
     glm::clamp(x, y, z);
-    return glm::vec4(x,
+    return glm::vec3(x,
                  (y-0.5f)*(y-0.5),
-                 z*z,
-                 densityAt(x, y, z, ds));
+                 z*z);
 }
 
 glm::vec4 Shell::materialAt(float x, float y, float z, float ds)
@@ -48,6 +105,18 @@ glm::vec4 Shell::materialAt(float x, float y, float z, float ds)
                  densityAt(x, y, z, ds));
 }
 
+void Shell::evaluateMaterial(const VoxelSpan& span,
+                             const DensityStencil& density,
+                             glm::vec4* material)
+{
+    for(int i=0; i < span.count; ++i)
+    {
+        glm::vec3 pos(span.x + i * span.ds, span.y, span.z);
+        material[i] = glm::vec4(glm::normalize(_center - pos),
+                                density.center[i]);
+    }
+}
+
 float Shell::densityAt(float x, float y, float z, float ds)
 {
     glm::clamp(x, y, z);
@@ -66,7 +135,7 @@ float Shell::densityAt(float x, float y, float z, float ds)
 
 
 // Boil
-glm::vec4 Boil::opticalAt(float x, float y, float z, float ds)
+glm::vec3 Boil::colorAt(float x, float y, float z)
 {
     glm::clamp(x, y, z);
 
@@ -74,7 +143,7 @@ glm::vec4 Boil::opticalAt(float x, float y, float z, float ds)
     glm::vec3 center(0.5f, 0.5f, 0.5f);
     float d = glm::length(pos - center);
 
-    return glm::vec4(x, glm::max(0.0f, 1.0f-d*d), z*z, densityAt(x, y, z, ds));
+    return glm::vec3(x, glm::max(0.0f, 1.0f-d*d), z*z);
 }
 
 float Boil::densityAt(float x, float y, float z, float ds)
@@ -92,12 +161,12 @@ float Boil::densityAt(float x, float y, float z, float ds)
 
 
 // SinNoise
-glm::vec4 SinNoise::opticalAt(float x, float y, float z, float ds)
+glm::vec3 SinNoise::colorAt(float x, float y, float z)
 {
     glm::vec3 pos(x, y, z);
     glm::vec3 center(0.5f, 0.5f, 0.5f);
     float d = glm::length(pos - center);
-    return glm::vec4(x, glm::max(0.0f, 1.0f-d*d), z*z, densityAt(x, y, z, ds));
+    return glm::vec3(x, glm::max(0.0f, 1.0f-d*d), z*z);
 }
 
 float SinNoise::densityAt(float x, float y, float z, float ds)
@@ -115,9 +184,9 @@ float SinNoise::densityAt(float x, float y, float z, float ds)
 
 
 // BallFloor
-glm::vec4 BallFloor::opticalAt(float x, float y, float z, float ds)
+glm::vec3 BallFloor::colorAt(float x, float y, float z)
 {
-    return glm::vec4(1.0f-x*(x-1.0f), y, z, densityAt(x, y, z, ds));
+    return glm::vec3(1.0f-x*(x-1.0f), y, z);
 }
 
 float BallFloor::densityAt(float x, float y, float z, float ds)
@@ -141,3 +210,10 @@ float BallFloor::densityAt(float x, float y, float z, float ds)
 
     return a;
 }
+
+
+// The volumes call back their own colorAt() and densityAt()
+template class ProceduralVolume<Shell>;
+template class ProceduralVolume<Boil>;
+template class ProceduralVolume<SinNoise>;
+template class ProceduralVolume<BallFloor>;
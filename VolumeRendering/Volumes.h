@@ -6,55 +6,102 @@
 #include <GLM/glm.hpp>
 
 
+// A row of count voxels along x, the first one at (x, y, z), ds apart
+struct VoxelSpan
+{
+    float x;
+    float y;
+    float z;
+    float ds;
+    int count;
+};
+
+// Densities of a span and of its neighbours. The x neighbours of the
+// first and last voxels are center[-1] and center[count].
+struct DensityStencil
+{
+    const float* center;
+    const float* yPrev;
+    const float* yNext;
+    const float* zPrev;
+    const float* zNext;
+};
+
 class IVolume
 {
 public:
+    virtual ~IVolume();
+
     virtual glm::vec4 opticalAt(float x, float y, float z, float ds) = 0;
     virtual glm::vec4 materialAt(float x, float y, float z, float ds);
 
+    // A whole span at a time. Optical and material values reuse the
+    // densities of evaluateDensity() instead of sampling them again.
+    virtual void evaluateDensity(const VoxelSpan& span, float* density) = 0;
+    virtual void evaluateOptical(const VoxelSpan& span, const float* density,
+                                 glm::vec4* optical) = 0;
+    // Normal from the density gradient, like materialAt()
+    virtual void evaluateMaterial(const VoxelSpan& span,
+                                  const DensityStencil& density,
+                                  glm::vec4* material);
+
 protected:
     virtual void clamp(float& x, float& y, float& z);
     virtual float densityAt(float x, float y, float z, float ds) = 0;
 };
 
-class Shell : public IVolume
+// Span evaluation calling the colorAt() and densityAt() of Volume
+// directly, without a virtual call per voxel
+template<typename Volume>
+class ProceduralVolume : public IVolume
 {
 public:
-    Shell();
     virtual glm::vec4 opticalAt(float x, float y, float z, float ds) override;
+
+    virtual void evaluateDensity(const VoxelSpan& span, float* density) override;
+    virtual void evaluateOptical(const VoxelSpan& span, const float* density,
+                                 glm::vec4* optical) override;
+};
+
+class Shell : public ProceduralVolume<Shell>
+{
+public:
+    Shell();
     virtual glm::vec4 materialAt(float x, float y, float z, float ds) override;
+    virtual void evaluateMaterial(const VoxelSpan& span,
+                                  const DensityStencil& density,
+                                  glm::vec4* material) override;
 
 protected:
+    friend class ProceduralVolume<Shell>;
+    glm::vec3 colorAt(float x, float y, float z);
     virtual float densityAt(float x, float y, float z, float ds) override;
 
 private:
     glm::vec3 _center;
 };
 
-class Boil : public IVolume
+class Boil : public ProceduralVolume<Boil>
 {
-public:
-    virtual glm::vec4 opticalAt(float x, float y, float z, float ds) override;
-
 protected:
+    friend class ProceduralVolume<Boil>;
+    glm::vec3 colorAt(float x, float y, float z);
     virtual float densityAt(float x, float y, float z, float ds) override;
 };
 
-class SinNoise : public IVolume
+class SinNoise : public ProceduralVolume<SinNoise>
 {
-public:
-    virtual glm::vec4 opticalAt(float x, float y, float z, float ds) override;
-
 protected:
+    friend class ProceduralVolume<SinNoise>;
+    glm::vec3 colorAt(float x, float y, float z);
     virtual float densityAt(float x, float y, float z, float ds) override;
 };
 
-class BallFloor : public IVolume
+class BallFloor : public ProceduralVolume<BallFloor>
 {
-public:
-    virtual glm::vec4 opticalAt(float x, float y, float z, float ds) override;
-
 protected:
+    friend class ProceduralVolume<BallFloor>;
+    glm::vec3 colorAt(float x, float y, float z);
     virtual float densityAt(float x, float y, float z, float ds) override;
 };
 
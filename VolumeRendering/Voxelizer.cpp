@@ -0,0 +1,78 @@
+#include "Voxelizer.h"
+
+#include "ParallelSlabs.h"
+
+
+Voxelizer::Voxelizer(IVolume& volume, const glm::ivec3& size, int nbThreads) :
+    _volume(volume),
+    _size(size),
+    _nbThreads(slabThreadCount(nbThreads)),
+    _density()
+{
+}
+
+Voxelizer::~Voxelizer()
+{
+
+}
+
+int Voxelizer::threadCount() const
+{
+    return _nbThreads;
+}
+
+void Voxelizer::voxelize(int firstSlice, int nbSlices,
+                         glm::vec4* optical,
+                         glm::vec4* material)
+{
+    // Voxels are cubes, neighbours are ds away along every axis
+    float ds = 1.0f / _size.x;
+    int rowSize = _size.x + 2;
+    int sliceSize = rowSize * (_size.y + 2);
+    _density.resize(sliceSize * (nbSlices + 2));
+
+    forEachSlab(_nbThreads, nbSlices + 2, [&](int begin, int end) {
+        for(int k=begin; k < end; ++k)
+        {
+            for(int j=0; j < _size.y + 2; ++j)
+            {
+                VoxelSpan span;
+                span.x = -ds;
+                span.y = (j - 1) * ds;
+                span.z = (firstSlice + k - 1) * ds;
+                span.ds = ds;
+                span.count = rowSize;
+
+                _volume.evaluateDensity(span,
+                    &_density[k * sliceSize + j * rowSize]);
+            }
+        }
+    });
+
+    forEachSlab(_nbThreads, nbSlices, [&](int begin, int end) {
+        for(int k=begin; k < end; ++k)
+        {
+            for(int j=0; j < _size.y; ++j)
+            {
+                VoxelSpan span;
+                span.x = 0.0f;
+                span.y = j * ds;
+                span.z = (firstSlice + k) * ds;
+                span.ds = ds;
+                span.count = _size.x;
+
+                DensityStencil density;
+                density.center = &_density[
+                        (k + 1) * sliceSize + (j + 1) * rowSize + 1];
+                density.yPrev = density.center - rowSize;
+                density.yNext = density.center + rowSize;
+                density.zPrev = density.center - sliceSize;
+                density.zNext = density.center + sliceSize;
+
+                int idx = (k * _size.y + j) * _size.x;
+                _volume.evaluateOptical(span, density.center, optical + idx);
+                _volume.evaluateMaterial(span, density, material + idx);
+            }
+        }
+    });
+}
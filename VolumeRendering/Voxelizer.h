@@ -0,0 +1,41 @@
+#ifndef VOLUME_RENDERING_VOXELIZER_H
+#define VOLUME_RENDERING_VOXELIZER_H
+
+#include <vector>
+
+#include <GLM/glm.hpp>
+
+#include "Volumes.h"
+
+
+// Samples a volume over a cubic grid of voxels, x fastest, a block of
+// z slices at a time. Densities are evaluated once per block into a
+// scratch grid one voxel wider on every side, the gradients of the
+// material values come from there. Both passes split the block into
+// z slabs shared between threads.
+class Voxelizer
+{
+public:
+    // One thread per hardware thread when nbThreads is 0
+    Voxelizer(IVolume& volume, const glm::ivec3& size, int nbThreads = 0);
+    virtual ~Voxelizer();
+
+    int threadCount() const;
+
+    // Slices [firstSlice, firstSlice + nbSlices), optical and material
+    // hold size.x * size.y * nbSlices values each
+    void voxelize(int firstSlice, int nbSlices,
+                  glm::vec4* optical,
+                  glm::vec4* material);
+
+
+private:
+    IVolume& _volume;
+    glm::ivec3 _size;
+    int _nbThreads;
+
+    // Densities of the current block and of the slices around it
+    std::vector<float> _density;
+};
+
+#endif //VOLUME_RENDERING_VOXELIZER_H
@@ -3,6 +3,9 @@
 uniform sampler3D OpticalSampler;
 uniform sampler3D MaterialSampler;
 uniform samplerCube EnvironmentSampler;
+uniform sampler3D MacroCellSampler;
+// Fraction of the light reaching each voxel
+uniform sampler3D TransmittanceSampler;
 uniform vec3 LightPos;
 uniform vec3 LightColor;
 uniform float LightShine;
@@ -10,6 +13,14 @@ uniform float LightAmbient;
 uniform bool ComputeShadow;
 
 uniform float ds;
+// Voxel lengths per step, opacities are corrected for longer steps
+uniform float StepScale;
+
+// Macro cells per unit of distance, empty ones are skipped when asked
+uniform vec3 MacroCellScale;
+uniform bool SkipEmptySpace;
+// Outputs the number of samples of the ray instead of its color
+uniform bool CountSamples;
 
 in vec3 pos;
 in vec3 eye;
@@ -24,6 +35,13 @@ float cubeProjection(vec3 pos, vec3 dir)
     return min(min(T.x, T.y), T.z);
 }
 
+float cellExit(vec3 cell, vec3 pos, vec3 dir)
+{
+    vec3 P = (cell + step(0, dir)) / MacroCellScale;
+    vec3 T = (P - pos) / dir;
+    return min(min(T.x, T.y), T.z);
+}
+
 void main()
 {
     vec3 eyeDir = normalize(eye);
@@ -33,14 +51,34 @@ void main()
     vec3 dr = ds * rayDir;
     int nbSteps = int(rayLength / ds);
 
-    vec3 fragPos = pos;
+    ivec3 lastCell = textureSize(MacroCellSampler, 0) - ivec3(1);
+
     vec3 colorAccum = vec3(0.0);
     float alphaAccum = 1.0;
+    int nbSamples = 0;
 
     for(int i=0; i<nbSteps; ++i)
     {
+        vec3 fragPos = pos + float(i) * dr;
+
+        if(SkipEmptySpace)
+        {
+            ivec3 cell = clamp(ivec3(floor(fragPos * MacroCellScale)),
+                               ivec3(0), lastCell);
+            if(texelFetch(MacroCellSampler, cell, 0).r == 0.0)
+            {
+                // Whole steps, samples stay where they would have been
+                float tExit = cellExit(vec3(cell), fragPos, rayDir);
+                i += max(int(ceil(tExit / ds)), 1) - 1;
+                continue;
+            }
+        }
+
+        ++nbSamples;
         vec4 material = texture(OpticalSampler, fragPos);
         float alpha = material.a;
+        if(StepScale != 1.0)
+            alpha = 1.0 - pow(max(1.0 - alpha, 0.0), StepScale);
         if(alpha != 0.0)
         {
             vec3 normal = -texture(MaterialSampler, fragPos).xyz;
@@ -49,25 +87,10 @@ void main()
             vec3 lightReflection = reflect(lightToFrag, normal);
 
             vec3 fragToLight = -lightToFrag;
-            float lightAlphaAccum = 0.0;
 
+            float translucient = 1.0;
             if(ComputeShadow)
-            {
-                vec3 dl = ds * fragToLight;
-
-                vec3 lightFragPos = fragPos;
-                float lightLength = cubeProjection(lightFragPos, fragToLight);
-
-                int lightNbSteps = int(lightLength / ds);
-                for(int j=0; j<lightNbSteps; ++j)
-                {
-                    lightFragPos += dl;
-                    vec4 lightFragMat = texture(OpticalSampler, lightFragPos);
-                    lightAlphaAccum += (1.0-lightAlphaAccum) * lightFragMat.a;
-                }
-            }
-
-            float translucient = (1.0 - lightAlphaAccum);
+                translucient = texture(TransmittanceSampler, fragPos).r;
 
             float directness = dot(fragToLight, normal);
             float intensity = translucient * max(0.0, directness);
@@ -83,8 +106,12 @@ void main()
             if(alphaAccum == 0.0)
                 break;
         }
+    }
 
-        fragPos += dr;
+    if(CountSamples)
+    {
+        Fragment = vec4(float(nbSamples), 1.0, 0.0, 0.0);
+        return;
     }
 
     vec3 background = textureCube(EnvironmentSampler, rayDir).xyz;
@@ -0,0 +1,140 @@
+#version 130
+
+// Brick of each voxel: where its slot starts in the atlas, and whether
+// it is resident (1), transparent (0) or not loaded yet (-1)
+uniform sampler3D PageTable;
+uniform sampler3D BrickAtlas;
+uniform samplerCube EnvironmentSampler;
+uniform vec3 LightPos;
+uniform vec3 LightColor;
+uniform float LightShine;
+uniform float LightAmbient;
+
+uniform float ds;
+// Voxel lengths per step, opacities are corrected for longer steps
+uniform float StepScale;
+// Outputs the number of samples of the ray instead of its color
+uniform bool CountSamples;
+
+uniform vec3 VolumeSize;
+uniform float BrickSize;
+uniform vec3 AtlasSize;
+
+// Values under the window are transparent, the ones over it opaque
+uniform vec2 TransferWindow;
+uniform float TransferOpacity;
+uniform vec3 LowColor;
+uniform vec3 HighColor;
+
+in vec3 pos;
+in vec3 eye;
+
+out vec4 Fragment;
+
+
+float cubeProjection(vec3 pos, vec3 dir)
+{
+    vec3 P = step(0, dir);
+    vec3 T = (P - pos) / dir;
+    return min(min(T.x, T.y), T.z);
+}
+
+float brickExit(vec3 brick, vec3 pos, vec3 dir)
+{
+    vec3 P = (brick + step(0, dir)) * BrickSize / VolumeSize;
+    vec3 T = (P - pos) / dir;
+    return min(min(T.x, T.y), T.z);
+}
+
+// Voxel coordinates are relative to the brick, its slot has one more
+// voxel of the neighbours on each side
+float atlasValue(vec3 slot, vec3 voxel)
+{
+    vec3 texel = slot + 1.0 + clamp(voxel, -0.5, BrickSize + 0.5);
+    return texture(BrickAtlas, texel / AtlasSize).r;
+}
+
+void main()
+{
+    vec3 eyeDir = normalize(eye);
+    vec3 rayDir = -eyeDir;
+    float rayLength = cubeProjection(pos, rayDir);
+
+    vec3 dr = ds * rayDir;
+    int nbSteps = int(rayLength / ds);
+
+    ivec3 lastBrick = textureSize(PageTable, 0) - ivec3(1);
+    float windowScale = 1.0 / max(TransferWindow.y - TransferWindow.x, 1e-6);
+
+    vec3 colorAccum = vec3(0.0);
+    float alphaAccum = 1.0;
+    int nbSamples = 0;
+
+    for(int i=0; i<nbSteps; ++i)
+    {
+        vec3 fragPos = pos + float(i) * dr;
+        vec3 voxel = fragPos * VolumeSize;
+
+        ivec3 brick = clamp(ivec3(floor(voxel / BrickSize)),
+                            ivec3(0), lastBrick);
+        vec4 page = texelFetch(PageTable, brick, 0);
+        if(page.a <= 0.0)
+        {
+            // Whole steps, samples stay where they would have been
+            float tExit = brickExit(vec3(brick), fragPos, rayDir);
+            i += max(int(ceil(tExit / ds)), 1) - 1;
+            continue;
+        }
+
+        ++nbSamples;
+        vec3 local = voxel - vec3(brick) * BrickSize;
+        float value = atlasValue(page.xyz, local);
+        float level = clamp((value - TransferWindow.x) * windowScale, 0.0, 1.0);
+
+        float alpha = TransferOpacity * level;
+        if(StepScale != 1.0)
+            alpha = 1.0 - pow(max(1.0 - alpha, 0.0), StepScale);
+        if(alpha != 0.0)
+        {
+            vec3 gradient = vec3(
+                atlasValue(page.xyz, local + vec3(0.5, 0, 0)) -
+                atlasValue(page.xyz, local - vec3(0.5, 0, 0)),
+                atlasValue(page.xyz, local + vec3(0, 0.5, 0)) -
+                atlasValue(page.xyz, local - vec3(0, 0.5, 0)),
+                atlasValue(page.xyz, local + vec3(0, 0, 0.5)) -
+                atlasValue(page.xyz, local - vec3(0, 0, 0.5)));
+            float gradientLength = length(gradient);
+            vec3 normal = gradientLength > 0.0 ?
+                -gradient / gradientLength : eyeDir;
+
+            vec3 lightToFrag = normalize(fragPos - LightPos);
+            vec3 lightReflection = reflect(lightToFrag, normal);
+
+            vec3 fragToLight = -lightToFrag;
+
+            float directness = dot(fragToLight, normal);
+            float intensity = max(0.0, directness);
+            float shininess  = step(0.0, directness) * max(0.0, dot(lightReflection, eyeDir));
+
+            float diffuse = mix(LightAmbient, 1.0, intensity);
+            float specular = pow(shininess, LightShine);
+            vec3 color = diffuse*mix(LowColor, HighColor, level) + specular*LightColor;
+
+            colorAccum += alphaAccum*alpha*color;
+            alphaAccum *= (1.0 - alpha);
+
+            if(alphaAccum == 0.0)
+                break;
+        }
+    }
+
+    if(CountSamples)
+    {
+        Fragment = vec4(float(nbSamples), 1.0, 0.0, 0.0);
+        return;
+    }
+
+    vec3 background = textureCube(EnvironmentSampler, rayDir).xyz;
+    colorAccum += alphaAccum * background;
+    Fragment = vec4(colorAccum, 1.0);
+}
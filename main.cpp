@@ -5,6 +5,7 @@
 #include <GLM/glm.hpp>
 
 #include <QApplication>
+#include <QCoreApplication>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 
@@ -20,8 +21,11 @@
 #include "DemoChooserDialog/DemoChooserDialog.h"
 #include "Physics2D/Physics2DCharacter.h"
 #include "VolumeRendering/Visualizer.h"
+#include "VolumeRendering/VolumeSettings.h"
 #include "Fractal/FractalCharacter.h"
+#include "Fluid2D/FluidBatchRunner.h"
 #include "Fluid2D/FluidCharacter.h"
+#include "Fluid2D/FluidSettings.h"
 
 using namespace std;
 using namespace cellar;
@@ -29,6 +33,8 @@ using namespace prop3;
 using namespace scaena;
 
 std::shared_ptr<QWidget> view;
+FluidSettings fluidSettings;
+VolumeSettings volumeSettings;
 
 std::shared_ptr<Play> buildVolumeRendering()
 {
@@ -41,7 +47,7 @@ std::shared_ptr<Play> buildVolumeRendering()
 
     // Build the Play
     std::shared_ptr<Play> play(new Play("Volume Rendering"));
-    std::shared_ptr<Character> character(new Visualizer());
+    std::shared_ptr<Character> character(new Visualizer(volumeSettings));
     std::shared_ptr<Act> act(new Act("Main Act"));
     act->addCharacter(character);
     play->appendAct(act);
@@ -55,17 +61,20 @@ std::shared_ptr<Play> buildFluid2D()
     // Build default view
     QGlWidgetView* view = new QGlWidgetView("MainView");
     std::shared_ptr<View> pView(view);
-    view->setGlWindowSpace(
-        FluidCharacter::WIDTH  * FluidCharacter::POINT_SIZE,
-        FluidCharacter::HEIGHT * FluidCharacter::POINT_SIZE);
+    glm::ivec2 windowSize = fluidSettings.windowSize();
+    view->setGlWindowSpace(windowSize.x, windowSize.y);
     view->centerOnScreen();
     view->show();
 
     // Build the Play
     std::shared_ptr<Play> play(new Play("Fluid 2D"));
-    play->setUpdateRate(Play::DEACTIVATE_AUTOMATIC_REFRESH);
+    // Update ticks only schedule the fixed steps, draws run them
+    if(fluidSettings.schedule == EFluidSchedule::FIXED_STEP)
+        play->setUpdateRate(fluidSettings.updateRate);
+    else
+        play->setUpdateRate(Play::DEACTIVATE_AUTOMATIC_REFRESH);
     play->setDrawRate(Play::FASTEST_REFRESH_RATE_AVAILABLE);
-    std::shared_ptr<Character> character(new FluidCharacter());
+    std::shared_ptr<Character> character(new FluidCharacter(fluidSettings));
     std::shared_ptr<Act> act(new Act("Main Act"));
     act->addCharacter(character);
     play->appendAct(act);
@@ -116,6 +125,18 @@ std::shared_ptr<Play> buildPhysics2D()
 
 int main(int argc, char* argv[])
 {
+    // Demo options, before Qt takes its own arguments out
+    fluidSettings.parseArguments(argc, argv);
+    volumeSettings.parseArguments(argc, argv);
+
+    // Headless fluid benchmark, no window nor demo chooser
+    if(fluidSettings.batchSteps > 0)
+    {
+        QCoreApplication batchApp(argc, argv);
+        FluidBatchRunner runner(fluidSettings);
+        return runner.run();
+    }
+
     // Init application
     Application& app = getApplication();
     app.init(argc, argv);